@@ -1,6 +1,42 @@
 CXXFLAGS += -std=c++11 -Wfatal-errors -pthread
 LDFLAGS  += -pthread
 
+# The revision, which is recorded in the performance history (-H),
+# goes in a generated header rather than on the command line so that
+# only what includes it (history.cpp) depends on it, through the
+# usual header dependencies. The header is only rewritten when the
+# revision changes, so that nothing is rebuilt needlessly.
+P_UNZIP_SRC      := $(dir $(lastword $(MAKEFILE_LIST)))src
+P_UNZIP_REVISION := $(shell git -C $(P_UNZIP_SRC) describe --always \
+                        --dirty 2>/dev/null)
+ifeq ($(P_UNZIP_REVISION),)
+    P_UNZIP_REVISION := unknown
+endif
+P_UNZIP_VERSION  := $(P_UNZIP_SRC)/version.hpp
+P_UNZIP_HASH     := \#
+$(shell printf '%s\n' '// Generated by .project.mk; do not edit.' \
+    '$(P_UNZIP_HASH)pragma once' \
+    '$(P_UNZIP_HASH)define P_UNZIP_REVISION "$(P_UNZIP_REVISION)"' \
+    > $(P_UNZIP_VERSION).tmp && \
+    ( cmp -s $(P_UNZIP_VERSION).tmp $(P_UNZIP_VERSION) || \
+      mv -f $(P_UNZIP_VERSION).tmp $(P_UNZIP_VERSION) ); \
+    rm -f $(P_UNZIP_VERSION).tmp)
+
+# Optional inflate backends for the native reader (see
+# src/inflate.hpp), e.g. make WITH_LIBDEFLATE=1 WITH_ISAL=1
+ifdef WITH_LIBDEFLATE
+    CXXFLAGS     += -DP_UNZIP_LIBDEFLATE
+    INFLATE_LIBS += -ldeflate
+endif
+ifdef WITH_ZLIB_NG
+    CXXFLAGS     += -DP_UNZIP_ZLIB_NG
+    INFLATE_LIBS += -lz-ng
+endif
+ifdef WITH_ISAL
+    CXXFLAGS     += -DP_UNZIP_ISAL
+    INFLATE_LIBS += -lisal
+endif
+
 # Enable if you need to
 #STATIC_LIBSTDCXX=
 
@@ -0,0 +1,300 @@
+/****************************************************************
+* Archive analysis.
+****************************************************************/
+#include "analyze.hpp"
+#include "directory.hpp"
+#include "distribution.hpp"
+#include "sys.hpp"
+#include "unzip.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+namespace {
+
+// Number of largest entries reported.
+size_t const TOP_ENTRIES = 5;
+
+// Label for size class k (see SizeClass), e.g. "<64K".
+string class_label( size_t k ) {
+    return size_class_name( SizeClass( k ) );
+}
+
+// Estimated cost of extracting an entry, as entry_cost but from
+// the central directory record. Bit zero of the flags is set for
+// encrypted entries.
+double dir_cost( DirEntry const& e ) {
+    double factor = method_cost( e.method );
+    if( e.flags & 1 )
+        factor += 0.3;
+    return double( e.size )*factor;
+}
+
+// Choose the settings and say why.
+void recommend( ArchiveAnalysis& a, double total_cost,
+                double max_cost ) {
+    size_t cpus = effective_cpus();
+    auto reason = [&]( string const& s ){ a.reasons.push_back( s ); };
+    // The largest entry bounds the wall time from below, so there
+    // is no point in having more threads than it takes to finish
+    // everything else in that time.
+    double useful = max_cost > 0 ? total_cost/max_cost
+                                 : double( a.files );
+    a.jobs = max<size_t>( 1, min<size_t>( { cpus, a.files,
+                                            size_t( useful ) } ) );
+    if( a.jobs < cpus )
+        reason( "jobs: " + to_string( a.jobs ) + " of " +
+            to_string( cpus ) + " cpus; more would wait on the "
+            "largest entries" );
+    else
+        reason( "jobs: one per cpu" );
+    a.needs_intra_entry = cpus > 1 && useful < cpus/2.0;
+    if( a.needs_intra_entry )
+        reason( "the largest entry is " + to_string( int( 100*max_cost/
+            total_cost ) ) + "% of the work; only decompressing "
+            "entries in parallel would use the other cpus" );
+
+    // Methods with a real share of the bytes; if there are more
+    // than one then their speeds differ and bytes are a poor
+    // measure of the work.
+    size_t mixed = 0;
+    for( auto const& p : a.methods )
+        if( p.second.bytes*20 >= a.bytes )
+            ++mixed;
+    bool skewed = max_cost*a.jobs > 0.5*total_cost ||
+                  a.p99 > 16*max<uint64_t>( a.median, 1 );
+    if( skewed ) {
+        a.strategy = mixed > 1 ? "cost" : "bytes";
+        reason( "strategy: file sizes are skewed so large entries "
+            "must be spread first" + string( mixed > 1
+            ? ", weighted by method" : "" ) );
+    } else if( a.max_folder >= 256 && a.folders >= 2*a.jobs ) {
+        a.strategy = "folder_cost";
+        reason( "strategy: files are concentrated in large folders; "
+            "keeping each on one thread avoids directory contention" );
+    } else {
+        a.strategy = "cyclic";
+        reason( "strategy: file sizes are uniform so a cyclic "
+            "assignment balances well at no cost" );
+    }
+
+    // The chunk covers most files in one read, but is limited as
+    // with "-c auto" so that all the chunks together use only a
+    // small fraction of memory.
+    uint64_t chunk = DEFAULT_CHUNK;
+    while( chunk < a.p90 && chunk < (1 << 20) )
+        chunk *= 2;
+    uint64_t mem = effective_memory();
+    if( mem > 0 )
+        chunk = min<uint64_t>( chunk, max<uint64_t>( DEFAULT_CHUNK,
+            mem/64/a.jobs ) );
+    a.chunk = size_t( chunk );
+    reason( "chunk: holds 90% of files in a single read" );
+}
+
+void print_text( ArchiveAnalysis const& a, ostream& out ) {
+    auto key = [&]( string const& s ) -> ostream& {
+        out << left << setw(17) << s << ": ";
+        return out;
+    };
+    out << fixed << setprecision(1);
+    key( "files" )      << a.files << endl;
+    key( "folders" )    << a.folders << endl;
+    key( "bytes" )      << human_bytes( a.bytes ) << " (" <<
+                           human_bytes( a.comp_bytes ) <<
+                           " compressed)" << endl;
+    if( a.bytes > 0 )
+        key( "ratio" )  << 100.0*a.comp_bytes/a.bytes << "%" << endl;
+    key( "directory" )  << human_bytes( a.directory ) << endl;
+
+    out << endl;
+    key( "size: median" ) << human_bytes( a.median )  << endl;
+    key( "size: p90" )    << human_bytes( a.p90 )     << endl;
+    key( "size: p99" )    << human_bytes( a.p99 )     << endl;
+    key( "size: max" )    << human_bytes( a.largest ) << endl;
+    for( size_t k = 0; k < a.size_classes.size(); ++k )
+        key( "size: " + class_label( k ) ) << a.size_classes[k] << endl;
+
+    out << endl;
+    for( auto const& p : a.methods ) {
+        auto const& m = p.second;
+        key( "method: " + method_name( p.first ) ) << left << setw(10)
+            << m.files << human_bytes( m.bytes );
+        if( m.bytes > 0 )
+            out << " (" << 100.0*m.comp_bytes/m.bytes << "%)";
+        out << endl;
+    }
+
+    out << endl;
+    key( "fan-out" )    << a.fan_out << " files/folder" << endl;
+    key( "max folder" ) << a.max_folder << " files" << endl;
+    key( "duplicates" ) << 100*a.duplicate_ratio << "% of bytes"
+                        << endl;
+    for( auto const& t : a.top )
+        key( "largest" ) << setw(6) << right << 100*t.second << "%  "
+                         << t.first << endl;
+    out.unsetf( ios::floatfield );
+    out << setprecision( 6 ) << left;
+
+    out << endl;
+    key( "strategy" ) << a.strategy << endl;
+    key( "jobs" )     << a.jobs << endl;
+    key( "chunk" )    << a.chunk << endl;
+    if( a.needs_intra_entry )
+        key( "warning" ) << "needs intra-entry parallelism" << endl;
+    for( auto const& r : a.reasons )
+        out << "  " << r << endl;
+}
+
+void print_json( ArchiveAnalysis const& a, ostream& out ) {
+    string s = "{";
+    auto num = [&]( char const* name, double value ) {
+        char buf[64];
+        snprintf( buf, sizeof( buf ), "%s\"%s\":%.17g",
+                  s.back() == '{' ? "" : ",", name, value );
+        s += buf;
+    };
+    num( "files",           double( a.files ) );
+    num( "folders",         double( a.folders ) );
+    num( "bytes",           double( a.bytes ) );
+    num( "comp_bytes",      double( a.comp_bytes ) );
+    num( "directory",       double( a.directory ) );
+    num( "median",          double( a.median ) );
+    num( "p90",             double( a.p90 ) );
+    num( "p99",             double( a.p99 ) );
+    num( "largest",         double( a.largest ) );
+    num( "fan_out",         a.fan_out );
+    num( "max_folder",      double( a.max_folder ) );
+    num( "duplicate_ratio", a.duplicate_ratio );
+    s += ",\"size_classes\":{";
+    for( size_t k = 0; k < a.size_classes.size(); ++k )
+        num( class_label( k ).c_str(), double( a.size_classes[k] ) );
+    s += "},\"methods\":{";
+    for( auto const& p : a.methods ) {
+        s += s.back() == '{' ? "\"" : ",\"";
+        s += method_name( p.first ) + "\":{";
+        num( "files",      double( p.second.files ) );
+        num( "bytes",      double( p.second.bytes ) );
+        num( "comp_bytes", double( p.second.comp_bytes ) );
+        s += "}";
+    }
+    s += "},\"largest_entries\":[";
+    for( size_t i = 0; i < a.top.size(); ++i ) {
+        s += i ? ",{\"name\":" : "{\"name\":";
+        append_json_string( s, a.top[i].first.data(),
+                               a.top[i].first.size() );
+        num( "share", a.top[i].second );
+        s += "}";
+    }
+    s += "],\"recommend\":{\"strategy\":";
+    append_json_string( s, a.strategy.data(), a.strategy.size() );
+    num( "jobs",  double( a.jobs ) );
+    num( "chunk", double( a.chunk ) );
+    s += a.needs_intra_entry ? ",\"needs_intra_entry\":true"
+                             : ",\"needs_intra_entry\":false";
+    s += ",\"reasons\":[";
+    for( size_t i = 0; i < a.reasons.size(); ++i ) {
+        if( i ) s += ",";
+        append_json_string( s, a.reasons[i].data(),
+                               a.reasons[i].size() );
+    }
+    s += "]}}";
+    out << s << endl;
+}
+
+} // anon namespace
+
+/****************************************************************
+* Main interface for analysis.
+****************************************************************/
+ArchiveAnalysis p_analyze( string const& filename,
+                           bool          json,
+                           ostream&      out ) {
+    Directory dir = Directory::load( filename );
+
+    ArchiveAnalysis a = ArchiveAnalysis();
+    a.size_classes.resize( size_t( SizeClass::count ) );
+    a.directory = dir.cd_size();
+
+    vector<size_t>   files;
+    vector<double>   costs;
+    unordered_map<string, size_t>  per_folder;
+    unordered_set<string>          folders;
+    set<pair<uint64_t, uint32_t>>  seen;
+    uint64_t duplicate = 0;
+    for( size_t i = 0; i < dir.size(); ++i ) {
+        string name = dir.name( i );
+        if( dir.is_folder( i ) ) {
+            folders.insert( name.substr( 0, name.size()-1 ) );
+            continue;
+        }
+        DirEntry const& e = dir[i];
+        files.push_back( i );
+        costs.push_back( dir_cost( e ) );
+        a.bytes      += e.size;
+        a.comp_bytes += e.comp_size;
+        auto& m = a.methods[e.method];
+        m.files++; m.bytes += e.size; m.comp_bytes += e.comp_size;
+        a.size_classes[size_t( size_class( e.size ) )]++;
+        auto slash    = name.rfind( '/' );
+        string parent = slash == string::npos ? "" : name.substr( 0, slash );
+        per_folder[parent]++;
+        folders.insert( parent );
+        // Content is identified by size and CRC, which is  what
+        // the directory has; empty files are not counted.
+        if( e.size > 0 &&
+            !seen.insert( make_pair( e.size, e.crc ) ).second )
+            duplicate += e.size;
+    }
+    a.files   = files.size();
+    a.folders = folders.size();
+    if( a.files == 0 ) {
+        a.strategy = DEFAULT_DIST; a.jobs = 1; a.chunk = DEFAULT_CHUNK;
+        a.reasons.push_back( "the archive has no files" );
+        if( json ) print_json( a, out ); else print_text( a, out );
+        return a;
+    }
+
+    // Percentiles of the sizes.
+    vector<uint64_t> sizes;
+    sizes.reserve( files.size() );
+    for( auto i : files )
+        sizes.push_back( dir[i].size );
+    sort( sizes.begin(), sizes.end() );
+    auto pct = [&]( double p ) {
+        return sizes[min( sizes.size()-1, size_t( p*sizes.size() ) )];
+    };
+    a.median  = pct( 0.5 );
+    a.p90     = pct( 0.9 );
+    a.p99     = pct( 0.99 );
+    a.largest = sizes.back();
+
+    a.fan_out = double( a.files )/per_folder.size();
+    for( auto const& p : per_folder )
+        a.max_folder = max( a.max_folder, p.second );
+    a.duplicate_ratio = a.bytes ? double( duplicate )/a.bytes : 0;
+
+    // The entries with the largest estimated cost.
+    double total_cost = 0;
+    for( auto c : costs )
+        total_cost += c;
+    vector<size_t> order( files.size() );
+    for( size_t i = 0; i < order.size(); ++i )
+        order[i] = i;
+    size_t top = min( TOP_ENTRIES, order.size() );
+    partial_sort( order.begin(), order.begin()+top, order.end(),
+        [&]( size_t l, size_t r ){ return costs[l] > costs[r]; } );
+    for( size_t i = 0; i < top; ++i )
+        a.top.emplace_back( dir.name( files[order[i]] ), total_cost > 0
+            ? costs[order[i]]/total_cost : 0 );
+
+    recommend( a, total_cost, costs[order[0]] );
+    if( json ) print_json( a, out ); else print_text( a, out );
+    return a;
+}
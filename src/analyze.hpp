@@ -0,0 +1,71 @@
+/****************************************************************
+* Archive analysis. This looks only at the central directory (it
+* does not even read the rest of the archive) and describes  the
+* shape of the archive in the terms that matter for extracting it
+* in parallel, then recommends settings for doing so.
+****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/****************************************************************
+* The results of the analysis.
+****************************************************************/
+struct ArchiveAnalysis {
+    size_t   files;
+    size_t   folders;
+    // Total uncompressed and compressed bytes of the files.
+    uint64_t bytes;
+    uint64_t comp_bytes;
+    // Size of the central directory, which is about all that the
+    // analysis needs to read.
+    uint64_t directory;
+    // File size distribution: percentiles and the number of files
+    // in each size class, indexed by SizeClass (see unzip.hpp), the
+    // same classes as the summary of an extraction uses.
+    uint64_t median, p90, p99, largest;
+    std::vector<size_t> size_classes;
+    // Files, uncompressed and compressed bytes by method.
+    struct Method { size_t files; uint64_t bytes, comp_bytes; };
+    std::map<uint16_t, Method> methods;
+    // Files per folder: the mean, and the most in any one folder.
+    double   fan_out;
+    size_t   max_folder;
+    // Fraction of the bytes in files whose content (going by size
+    // and CRC) duplicates an earlier file.
+    double   duplicate_ratio;
+    // The largest files with their share of the total estimated
+    // cost (see entry_cost) of extraction.
+    std::vector<std::pair<std::string, double>> top;
+
+    // Recommended settings.
+    std::string strategy;
+    size_t      jobs;
+    size_t      chunk;
+    // Set if most of the work is in too few entries to keep the
+    // threads busy; such archives would need each entry to be de-
+    // compressed in parallel to go any faster.
+    bool        needs_intra_entry;
+    // Why the settings were chosen, one reason per line.
+    std::vector<std::string> reasons;
+};
+
+/****************************************************************
+* Main interface to analyze an archive.
+*****************************************************************
+* filename: path of zip file to be opened relative to CWD.
+*
+* json: when true, write one JSON object; otherwise a human read-
+* able report.
+*
+* out: where the report is written.
+*
+* This function will throw on any error. */
+ArchiveAnalysis p_analyze( std::string const& filename,
+                           bool               json,
+                           std::ostream&      out );
@@ -0,0 +1,618 @@
+/****************************************************************
+* Benchmarks.
+****************************************************************/
+#include "bench.hpp"
+#include "create.hpp"
+#include "directory.hpp"
+#include "fs.hpp"
+#include "inflate.hpp"
+#include "reader.hpp"
+#include "sys.hpp"
+#include "unzip.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+// Removes a scratch folder of ours, if it is there, when it goes
+// out of scope, so that a run which throws part way through does
+// not leave it behind (and block the next run).
+class ScratchFolder {
+
+public:
+    ScratchFolder( string const& path, size_t jobs )
+        : m_path( path ), m_jobs( jobs ) {
+        FAIL( file_size( path ),
+            path << " already exists; please remove it first" );
+    }
+
+    ~ScratchFolder() {
+        // Don't throw from here, and certainly not while unwinding.
+        try {
+            if( file_size( m_path ) )
+                remove_tree( m_path, m_jobs );
+        } catch( ... ) {}
+    }
+
+    ScratchFolder( ScratchFolder const& )            = delete;
+    ScratchFolder& operator=( ScratchFolder const& ) = delete;
+
+    string const& path() const { return m_path; }
+
+private:
+    string m_path;
+    size_t m_jobs;
+
+};
+
+// Least squares fit of a straight line y = intercept + slope*x.
+// With fewer than two distinct x there is no line to  fit,  and
+// `fitted` says so.
+struct LineFit {
+    LineFit() : n( 0 ), sx( 0 ), sy( 0 ), sxx( 0 ), sxy( 0 ) {}
+
+    void add( double x, double y ) {
+        n++; sx += x; sy += y; sxx += x*x; sxy += x*y;
+    }
+    double spread() const { return n > 0 ? sxx - sx*sx/n : 0; }
+    bool   fitted() const { return n > 1 && spread() > 0; }
+    double slope()  const {
+        return fitted() ? (sxy - sx*sy/n)/spread() : 0;
+    }
+    double intercept() const {
+        return n > 0 ? (sy - slope()*sx)/n : 0;
+    }
+
+    size_t n;
+    double sx, sy, sxx, sxy;
+};
+
+void print_run( ScalingRun const& r, bool json, ostream& out ) {
+    char buf[256];
+    double secs = r.nanoseconds/1e9;
+    double rate = secs > 0 ? r.bytes/secs : 0;
+    if( json )
+        snprintf( buf, sizeof( buf ), "{\"strategy\":\"%s\",\"jobs\":"
+            "%zu,\"ms\":%.3f,\"bytes_per_s\":%.0f,\"speedup\":%.3f,"
+            "\"efficiency\":%.3f}\n", r.strategy.c_str(), r.jobs,
+            r.nanoseconds/1e6, rate, r.speedup, r.efficiency );
+    else
+        snprintf( buf, sizeof( buf ), "%-16s %6zu %12s %12s %8.2fx "
+            "%9.1f%%\n", r.strategy.c_str(), r.jobs,
+            human_duration( r.nanoseconds ).c_str(),
+            ( human_bytes( uint64_t( rate ) ) + "/s" ).c_str(),
+            r.speedup, 100*r.efficiency );
+    out << buf;
+}
+
+void print_fit( ScalingFit const& f, bool json, ostream& out ) {
+    // With no serial part at all there is no limit to the speedup,
+    // which is given as zero.
+    char buf[256];
+    if( json )
+        snprintf( buf, sizeof( buf ), "{\"strategy\":\"%s\",\"serial\":"
+            "%.4f,\"max_speedup\":%.2f}\n", f.strategy.c_str(),
+            f.serial, f.max_speedup );
+    else if( f.max_speedup > 0 )
+        snprintf( buf, sizeof( buf ), "%-16s serial fraction %.1f%%, "
+            "max speedup %.1fx\n", f.strategy.c_str(), 100*f.serial,
+            f.max_speedup );
+    else
+        snprintf( buf, sizeof( buf ), "%-16s serial fraction 0%%, "
+            "no limit to speedup\n", f.strategy.c_str() );
+    out << buf;
+}
+
+/****************************************************************
+* Comparison benchmark
+****************************************************************/
+// An extractor, and how to get it to extract an archive into  a
+// folder.
+struct Extractor {
+    string name;
+    string path;
+    function<vector<string>( string const& path, string const& zip,
+                             string const& folder )> args;
+};
+
+// A synthetic archive shape: `files` files spread over  `folders`
+// folders nested `depth` deep, with sizes drawn  log-uniformly
+// between `min_size` and `max_size`. The sizes are kept modest so
+// that the whole comparison takes minutes and not hours.
+struct Shape {
+    char const* name;
+    size_t      files;
+    size_t      folders;
+    size_t      depth;
+    uint64_t    min_size;
+    uint64_t    max_size;
+};
+
+Shape const shapes[] = {
+    { "small", 5000, 100, 1, 1024,     8192     },
+    { "large", 4,    1,   1, 16 << 20, 16 << 20 },
+    { "mixed", 500,  50,  3, 64,       2 << 20  },
+};
+
+uint64_t xorshift( uint64_t& x ) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    return x;
+}
+
+// Write the files of a shape under `folder`. The contents are made
+// of words from a small vocabulary in a random order, which  com-
+// presses about as well as source code or text does.
+void make_shape( Shape const& shape, string const& folder ) {
+    static char const* const words[] = {
+        "the ", "data ", "zip ", "of ", "and ", "thread ", "file ",
+        "value ", "to ", "in ", "return ", "size ", "for ", "int ",
+        "{\n", "}\n", "(); ", "= ", "0, ", "const ", "string ",
+    };
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    Buffer text( 1 << 20 );
+    auto p = static_cast<char*>( text.get() );
+    for( size_t i = 0; i < text.size(); ) {
+        char const* w = words[xorshift( x ) % (sizeof( words )/
+                                                sizeof( words[0] ))];
+        while( *w && i < text.size() )
+            p[i++] = *w++;
+    }
+    vector<string> dirs;
+    for( size_t d = 0; d < shape.folders; ++d ) {
+        string dir = folder;
+        for( size_t level = 0; level < shape.depth; ++level )
+            dir += "/d" + to_string( (d >> level) % 10 + level*10 );
+        make_folders( dir );
+        dirs.push_back( dir );
+    }
+    double lo = log( double( shape.min_size ) );
+    double hi = log( double( shape.max_size ) );
+    for( size_t f = 0; f < shape.files; ++f ) {
+        double   r    = double( xorshift( x ) % 1000000 )/1000000;
+        uint64_t size = uint64_t( exp( lo + r*(hi-lo) ) );
+        File out( dirs[f % dirs.size()] + "/f" + to_string( f ) +
+                  ".txt", "wb" );
+        // Start each file at a different place in the text so that
+        // no two are the same.
+        uint64_t off = xorshift( x ) % text.size();
+        for( uint64_t left = size; left > 0; ) {
+            uint64_t count = min( left, uint64_t( text.size() - off ) );
+            out.write( p + off, count );
+            left -= count;
+            off   = 0;
+        }
+    }
+}
+
+// Check the files extracted under `folder` against the sizes and
+// CRCs in the central directory of the archive. Returns an empty
+// string if they all match, or else what the first problem was.
+string verify_tree( Directory const& dir, string const& folder,
+                    Buffer& buf ) {
+    for( size_t i = 0; i < dir.size(); ++i ) {
+        if( dir.is_folder( i ) )
+            continue;
+        string path = folder + "/" + dir.name( i );
+        auto size = file_size( path );
+        if( !size )
+            return "missing " + dir.name( i );
+        if( size.get() != dir[i].size )
+            return "wrong size for " + dir.name( i );
+        File f( path, "rb" );
+        uLong crc = crc32( 0L, Z_NULL, 0 );
+        // zlib's crc32 takes a 32 bit length, so the buffer must be
+        // no larger than that.
+        while( uint64_t got = f.read_some( buf ) )
+            crc = crc32( crc, (Bytef const*)buf.get(), uInt( got ) );
+        if( crc != dir[i].crc )
+            return "wrong CRC for " + dir.name( i );
+    }
+    return "";
+}
+
+// Run the command under strace and return the number of system
+// calls that it and its threads made, or zero if that fails.
+uint64_t count_syscalls( string const& strace, vector<string> const&
+                         args, string const& log ) {
+    vector<string> traced = { strace, "-f", "-c", "-o", log };
+    traced.insert( traced.end(), args.begin(), args.end() );
+    if( run_program( traced ).exit_code != 0 )
+        return 0;
+    // The summary ends with a line like:
+    //   100.00    0.001234           2       456        12 total
+    // where the fourth column is the number of calls.
+    ifstream in( log );
+    string line;
+    uint64_t calls = 0;
+    while( getline( in, line ) ) {
+        istringstream ss( line );
+        string pct, secs, per_call;
+        uint64_t n;
+        if( line.find( "total" ) != string::npos &&
+            ss >> pct >> secs >> per_call >> n )
+            calls = n;
+    }
+    remove_file( log );
+    return calls;
+}
+
+void print_compare( CompareRun const& r, uint64_t base, bool json,
+                    ostream& out ) {
+    char buf[512];
+    double ratio = base > 0 ? double( r.nanoseconds )/base : 0;
+    if( json ) {
+        string archive, mismatch;
+        append_json_string( archive, r.archive.data(), r.archive.size() );
+        append_json_string( mismatch, r.mismatch.data(),
+                            r.mismatch.size() );
+        snprintf( buf, sizeof( buf ), "{\"archive\":%s,\"tool\":"
+            "\"%s\",\"cache\":\"%s\",\"ms\":%.3f,\"cpu_ms\":%.3f,"
+            "\"max_rss\":%llu,\"syscalls\":%llu,\"vs_p_unzip\":"
+            "%.3f,\"exit_code\":%d,\"mismatch\":%s}\n",
+            archive.c_str(), r.tool.c_str(), r.cold ? "cold" : "warm",
+            r.nanoseconds/1e6, r.cpu_ns/1e6,
+            (unsigned long long)r.max_rss,
+            (unsigned long long)r.syscalls, ratio, r.exit_code,
+            mismatch.c_str() );
+        out << buf;
+        return;
+    }
+    string check = r.exit_code ? "exit " + to_string( r.exit_code )
+                 : r.mismatch.empty() ? string( "ok" ) : r.mismatch;
+    string calls = r.syscalls ? to_string( r.syscalls ) : "-";
+    if( r.exit_code ) {
+        snprintf( buf, sizeof( buf ), "%-16s %-8s %-5s %s\n",
+            r.archive.c_str(), r.tool.c_str(),
+            r.cold ? "cold" : "warm", check.c_str() );
+        out << buf;
+        return;
+    }
+    snprintf( buf, sizeof( buf ), "%-16s %-8s %-5s %10s %10s %10s "
+        "%7.2fx %9s  %s\n", r.archive.c_str(), r.tool.c_str(),
+        r.cold ? "cold" : "warm",
+        human_duration( r.nanoseconds ).c_str(),
+        human_duration( r.cpu_ns ).c_str(),
+        human_bytes( r.max_rss ).c_str(), ratio, calls.c_str(),
+        check.c_str() );
+    out << buf;
+}
+
+/****************************************************************
+* Inflate benchmark
+****************************************************************/
+// A rate, or "-" if there was nothing to time.
+string rate( uint64_t bytes, uint64_t ns ) {
+    if( ns == 0 )
+        return "-";
+    return human_bytes( uint64_t( bytes/(ns/1e9) ) ) + "/s";
+}
+
+void print_inflate( InflateRun const& r, bool json, ostream& out ) {
+    char buf[512];
+    auto per_s = []( uint64_t bytes, uint64_t ns ) {
+        return ns > 0 ? bytes/(ns/1e9) : 0;
+    };
+    if( json ) {
+        string plan;
+        append_json_string( plan, r.plan.data(), r.plan.size() );
+        snprintf( buf, sizeof( buf ), "{\"backend\":\"%s\",\"plan\":%s,"
+            "\"ms\":%.3f,\"bytes_per_s\":%.0f,\"small_bytes_per_s\":"
+            "%.0f,\"large_bytes_per_s\":%.0f,\"speedup\":%.3f}\n",
+            r.backend.c_str(), plan.c_str(), r.nanoseconds/1e6,
+            per_s( r.bytes, r.nanoseconds ),
+            per_s( r.small_bytes, r.small_ns ),
+            per_s( r.large_bytes, r.large_ns ), r.speedup );
+    } else
+        snprintf( buf, sizeof( buf ), "%-11s %10s %12s %12s %12s "
+            "%7.2fx  %s\n", r.backend.c_str(),
+            human_duration( r.nanoseconds ).c_str(),
+            rate( r.bytes, r.nanoseconds ).c_str(),
+            rate( r.small_bytes, r.small_ns ).c_str(),
+            rate( r.large_bytes, r.large_ns ).c_str(), r.speedup,
+            r.plan.c_str() );
+    out << buf;
+}
+
+} // anon namespace
+
+ScalingResult p_bench_scaling( string const&         filename,
+                               size_t                max_jobs,
+                               vector<string> const& strategies,
+                               size_t                chunk_size,
+                               string const&         output,
+                               bool                  evict,
+                               bool                  json,
+                               ostream&              out ) {
+    FAIL( max_jobs < 1, "invalid number of jobs: " << max_jobs );
+    vector<size_t> jobs;
+    for( size_t j = 1; j < max_jobs; j *= 2 )
+        jobs.push_back( j );
+    jobs.push_back( max_jobs );
+
+    // We delete this after each run, so it must be ours.
+    ScratchFolder guard( output.empty() ? "p-unzip-bench"
+                         : output + "/p-unzip-bench", max_jobs );
+    string const& scratch = guard.path();
+
+    if( !json )
+        out << "strategy           jobs         time   throughput  "
+               "speedup  efficiency" << endl;
+    ScalingResult res;
+    for( auto const& strategy : strategies ) {
+        // T(j) = T(1)*s + T(1)*(1-s)/j is a straight line in 1/j,
+        // so s comes from a least squares fit of the times against
+        // 1/j: intercept/(intercept + slope).
+        LineFit  fit;
+        uint64_t base = 0;
+        for( auto j : jobs ) {
+            FAIL( evict && !evict_from_cache( filename.c_str() ),
+                "cannot evict " << filename << " from the page cache" );
+            auto start = chrono::steady_clock::now();
+            auto info  = p_unzip( filename, j, true, scratch, strategy,
+                                  chunk_size );
+            uint64_t ns = uint64_t( chrono::duration_cast<
+                chrono::nanoseconds>( chrono::steady_clock::now() -
+                                      start ).count() );
+            remove_tree( scratch, j );
+            if( j == 1 )
+                base = ns;
+            ScalingRun run;
+            run.strategy    = strategy;
+            run.jobs        = j;
+            run.nanoseconds = ns;
+            run.bytes       = info.bytes;
+            run.speedup     = ns > 0 ? double( base )/ns : 0;
+            run.efficiency  = run.speedup/j;
+            fit.add( 1.0/j, double( ns ) );
+            print_run( run, json, out );
+            res.runs.push_back( run );
+        }
+        // With only one thread count there is nothing to fit.
+        if( !fit.fitted() )
+            continue;
+        ScalingFit f;
+        f.strategy = strategy;
+        // Noise can make either term come out negative; the serial
+        // fraction is clamped to [0, 1] accordingly.
+        double a = max( fit.intercept(), 0.0 );
+        double b = max( fit.slope(),     0.0 );
+        f.serial      = a + b > 0 ? a/(a + b) : 1;
+        f.max_speedup = f.serial > 0 ? 1/f.serial : 0;
+        res.fits.push_back( f );
+    }
+    if( !json )
+        out << endl;
+    for( auto const& f : res.fits )
+        print_fit( f, json, out );
+    return res;
+}
+
+vector<CompareRun> p_bench_compare( string const& filename,
+                                    size_t        reps,
+                                    size_t        jobs,
+                                    string const& strategy,
+                                    size_t        chunk_size,
+                                    string const& output,
+                                    bool          json,
+                                    ostream&      out ) {
+    FAIL( reps < 1, "invalid number of repetitions: " << reps );
+    string self = self_path();
+    FAIL( self.empty(), "cannot find the p-unzip executable" );
+
+    // The reference extractors that are installed, after our own.
+    vector<Extractor> tools;
+    tools.push_back( { "p-unzip", self,
+        [&]( string const& p, string const& zip, string const& to ) {
+            return vector<string>{ p, "-q", "-j", to_string( jobs ),
+                "-d", strategy, "-c", to_string( chunk_size ), "-o",
+                to, zip };
+        } } );
+    auto add = [&]( string const& name, vector<string> const& names,
+                    decltype( Extractor::args ) args ) {
+        for( auto const& n : names ) {
+            string path = find_program( n );
+            if( !path.empty() ) {
+                tools.push_back( { name, path, args } );
+                return;
+            }
+        }
+    };
+    add( "unzip", { "unzip" },
+        []( string const& p, string const& zip, string const& to ) {
+            return vector<string>{ p, "-qq", "-o", zip, "-d", to };
+        } );
+    add( "bsdtar", { "bsdtar" },
+        []( string const& p, string const& zip, string const& to ) {
+            return vector<string>{ p, "-xf", zip, "-C", to };
+        } );
+    add( "7z", { "7z", "7za", "7zz" },
+        []( string const& p, string const& zip, string const& to ) {
+            return vector<string>{ p, "x", "-y", "-o" + to, zip };
+        } );
+    string strace = find_program( "strace" );
+
+    // We delete this at the end, so it must be ours.
+    ScratchFolder guard( output.empty() ? "p-unzip-compare"
+                         : output + "/p-unzip-compare", jobs );
+    string const& scratch = guard.path();
+    make_folders( scratch );
+    string folder = scratch + "/out";
+
+    // (name, path) of each archive to run over.
+    vector<pair<string, string>> archives;
+    if( filename == "synthetic" ) {
+        for( auto const& shape : shapes ) {
+            string src = scratch + "/" + shape.name;
+            string zip = src + ".zip";
+            // This is done in a child process so that the memory
+            // that it uses does not count towards the peak RSS  of
+            // the extractors: on Linux a child starts with the RSS
+            // of its parent at the time of the fork as its peak.
+            auto made = run_in_child( [&]{
+                make_shape( shape, src );
+                p_zip( zip, src, jobs, true, strategy, chunk_size,
+                       ZIP_METHOD_DEFLATE, true );
+                remove_tree( src, jobs );
+            } );
+            FAIL( made.exit_code != 0,
+                "failed to make the " << shape.name << " archive" );
+            archives.emplace_back( shape.name, zip );
+        }
+    } else
+        archives.emplace_back( filename, filename );
+
+    bool can_evict = evict_from_cache( archives[0].second.c_str() );
+    if( !json ) {
+        if( !can_evict )
+            out << "note: cannot drop files from the page cache here, "
+                   "so there are no cold runs" << endl;
+        out << "archive          tool     cache       wall        cpu"
+               "        rss   vs p-unzip  syscalls  check" << endl;
+    }
+
+    vector<CompareRun> res;
+    Buffer buf( 1 << 20 );
+    for( auto const& archive : archives ) {
+        Directory dir = Directory::load( archive.second );
+        // Wall times of p-unzip for each of cold and warm, which the
+        // others are compared to.
+        uint64_t base[2] = { 0, 0 };
+        for( int cold = can_evict ? 1 : 0; cold >= 0; --cold ) {
+            for( auto const& tool : tools ) {
+                CompareRun r;
+                r.archive     = archive.first;
+                r.tool        = tool.name;
+                r.cold        = cold;
+                r.nanoseconds = r.cpu_ns = r.max_rss = 0;
+                r.syscalls    = 0;
+                r.exit_code   = 0;
+                auto args = tool.args( tool.path, archive.second, folder );
+                vector<uint64_t> wall, cpu;
+                bool checked = false;
+                // With a warm cache the first run is not  counted,
+                // since it is the one that warms the cache.
+                for( size_t i = cold ? 1 : 0; i <= reps; ++i ) {
+                    make_folders( folder );
+                    FAIL( cold && !evict_from_cache(
+                        archive.second.c_str() ), "cannot evict " <<
+                        archive.second << " from the page cache" );
+                    ChildRun run = run_program( args );
+                    if( run.exit_code == 0 && !checked ) {
+                        r.mismatch = verify_tree( dir, folder, buf );
+                        checked    = true;
+                    }
+                    remove_tree( folder, jobs );
+                    if( run.exit_code != 0 ) {
+                        r.exit_code = run.exit_code;
+                        break;
+                    }
+                    if( i == 0 )
+                        continue;
+                    wall.push_back( run.nanoseconds );
+                    cpu.push_back( run.cpu_ns );
+                    r.max_rss = max( r.max_rss, run.max_rss );
+                }
+                if( !wall.empty() ) {
+                    sort( wall.begin(), wall.end() );
+                    sort( cpu.begin(),  cpu.end()  );
+                    r.nanoseconds = wall[wall.size()/2];
+                    r.cpu_ns      = cpu[cpu.size()/2];
+                }
+                // strace slows the program down a lot, so the calls
+                // are counted in a run of their own.
+                if( !strace.empty() && r.exit_code == 0 ) {
+                    make_folders( folder );
+                    r.syscalls = count_syscalls( strace, args,
+                        scratch + "/strace.log" );
+                    remove_tree( folder, jobs );
+                }
+                if( tool.name == "p-unzip" )
+                    base[cold] = r.nanoseconds;
+                print_compare( r, base[cold], json, out );
+                res.push_back( r );
+            }
+        }
+    }
+    return res;
+}
+
+vector<InflateRun> p_bench_inflate( string const& filename,
+                                    size_t        reps,
+                                    size_t        chunk_size,
+                                    bool          json,
+                                    ostream&      out ) {
+    FAIL( reps < 1, "invalid number of repetitions: " << reps );
+    Buffer::SP zip = make_shared<Buffer>( File( filename, "rb" ).read() );
+    string why;
+    auto archive = NativeArchive::open( zip, why );
+    FAIL( !archive, "the inflate benchmark needs an archive that the "
+        "native reader can read, but " << why );
+    vector<uint64_t> deflated;
+    for( auto const& zs : archive->stats() )
+        if( zs.method() == ZIP_METHOD_DEFLATE )
+            deflated.push_back( zs.index() );
+    FAIL( deflated.empty(), filename << " has no deflated entries" );
+
+    if( !json ) {
+        char buf[256];
+        string whole = human_bytes( INFLATE_WHOLE_MAX );
+        snprintf( buf, sizeof( buf ), "%-11s %10s %12s %12s %12s %8s  "
+            "%s\n", "backend", "time", "throughput",
+            ( "<=" + whole ).c_str(), ( ">" + whole ).c_str(),
+            "vs zlib", "plan" );
+        out << buf;
+    }
+    vector<InflateRun> res;
+    Buffer buf( chunk_size );
+    for( auto const& name : inflate_plan_names() ) {
+        Inflater inflater( inflate_plan( name ) );
+        InflateRun r;
+        r.backend = name;
+        r.plan    = inflater.plan().describe();
+        r.bytes   = r.small_bytes = r.large_bytes = 0;
+        vector<uint64_t> all, small, large;
+        for( size_t rep = 0; rep < reps; ++rep ) {
+            uint64_t ns[2] = { 0, 0 };
+            for( auto idx : deflated ) {
+                ZipStat const& zs = archive->stats()[size_t( idx )];
+                bool is_large = zs.size() > INFLATE_WHOLE_MAX;
+                auto start = chrono::steady_clock::now();
+                FAIL( !archive->read( idx, inflater, buf,
+                    []( void const*, size_t ){}, why ), name << " failed "
+                    "on " << zs.name() << ": " << why );
+                ns[is_large] += uint64_t( chrono::duration_cast<
+                    chrono::nanoseconds>( chrono::steady_clock::now() -
+                                          start ).count() );
+                if( rep == 0 )
+                    ( is_large ? r.large_bytes : r.small_bytes ) +=
+                        zs.size();
+            }
+            small.push_back( ns[0] );
+            large.push_back( ns[1] );
+            all.push_back( ns[0] + ns[1] );
+        }
+        auto median = []( vector<uint64_t>& v ) {
+            sort( v.begin(), v.end() );
+            return v[v.size()/2];
+        };
+        r.bytes       = r.small_bytes + r.large_bytes;
+        r.nanoseconds = median( all );
+        r.small_ns    = median( small );
+        r.large_ns    = median( large );
+        // zlib is always built in, and is first.
+        r.speedup     = r.nanoseconds > 0 && !res.empty()
+                      ? double( res[0].nanoseconds )/r.nanoseconds : 1;
+        print_inflate( r, json, out );
+        res.push_back( r );
+    }
+    return res;
+}
@@ -0,0 +1,186 @@
+/****************************************************************
+* Benchmarks. The scaling benchmark extracts the same archive with
+* increasing numbers of threads and fits Amdahl's law to the wall
+* times, to show how much is to be gained from more CPUs. The com-
+* parison benchmark runs p-unzip and whichever of the  well  known
+* extractors are installed over the same archives, to show how we
+* measure up against them. The inflate benchmark times each of the
+* inflate backends that are built in (see inflate.hpp) on the de-
+* flated entries of an archive.
+****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/****************************************************************
+* One extraction of the sweep.
+****************************************************************/
+struct ScalingRun {
+    std::string strategy;
+    size_t      jobs;
+    // Wall time of the whole extraction, including loading  the
+    // archive and creating the folders.
+    uint64_t    nanoseconds;
+    uint64_t    bytes;
+    // Relative to the run with one thread of the same strategy.
+    double      speedup;
+    double      efficiency;
+};
+
+/****************************************************************
+* The fit of T(j) = T(1)*(s + (1-s)/j) for one strategy.
+****************************************************************/
+struct ScalingFit {
+    std::string strategy;
+    // The serial fraction s, and so the best possible speedup 1/s
+    // (zero if s is zero).
+    double      serial;
+    double      max_speedup;
+};
+
+struct ScalingResult {
+    std::vector<ScalingRun> runs;
+    // One per strategy, except when there was only one  number
+    // of threads to run with, as then there is nothing to fit.
+    std::vector<ScalingFit> fits;
+};
+
+/****************************************************************
+* Main interface to run the sweep.
+*****************************************************************
+* filename: path of zip file to be opened relative to CWD.
+*
+* max_jobs: the sweep runs with 1, 2, 4 ... threads and finishes
+* with max_jobs threads.
+*
+* strategies: the distribution strategies to sweep, each in turn.
+*
+* chunk_size: as for p_unzip.
+*
+* output: the folder under which to extract. Each run extracts into
+* a new folder named p-unzip-bench in it, which must not already
+* exist, and which is deleted after the run.
+*
+* evict: when true, ask the OS to drop the archive from the page
+* cache before each run, so that each one reads it from the device.
+*
+* json: when true, write one JSON object per run and per fit,  on
+* separate lines; otherwise a human readable table.
+*
+* out: where the report is written. */
+ScalingResult p_bench_scaling( std::string const&              filename,
+                               size_t                          max_jobs,
+                               std::vector<std::string> const& strategies,
+                               size_t                          chunk_size,
+                               std::string const&              output,
+                               bool                            evict,
+                               bool                            json,
+                               std::ostream&                   out );
+
+/****************************************************************
+* The runs of one extractor on one archive with either a cold or
+* a warm page cache.
+****************************************************************/
+struct CompareRun {
+    // The archive, or the name of the synthetic shape.
+    std::string archive;
+    // "p-unzip", "unzip", "bsdtar" or "7z".
+    std::string tool;
+    bool        cold;
+    // Medians over the repetitions of the wall and the CPU time.
+    uint64_t    nanoseconds;
+    uint64_t    cpu_ns;
+    // The highest peak RSS of any of the repetitions.
+    uint64_t    max_rss;
+    // System calls made by one run, counted in a separate  run
+    // under strace; zero if strace is not installed.
+    uint64_t    syscalls;
+    // Nonzero if any repetition failed, and then the others  are
+    // not run.
+    int         exit_code;
+    // Empty if the extracted files all had the sizes and CRCs  in
+    // the archive, otherwise what was wrong.
+    std::string mismatch;
+};
+
+/****************************************************************
+* Main interface to run the comparison.
+*****************************************************************
+* filename: path of zip file to be opened relative to CWD, or the
+* word "synthetic" to build three archives of different shapes
+* (many small files, a few large ones, and a deep tree of mixed
+* sizes) and to run over each of those.
+*
+* reps: the number of timed runs of each extractor with  a  cold
+* cache and with a warm one. Cold runs are left  out  if  the  OS
+* cannot be asked to drop the archive from the page cache.
+*
+* jobs, strategy, chunk_size: passed to p-unzip.
+*
+* output: the folder under which to work. Everything is done in a
+* new folder named p-unzip-compare in it, which must not already
+* exist, and which is deleted at the end.
+*
+* json: when true, write one JSON object per CompareRun on separate
+* lines; otherwise a human readable table.
+*
+* out: where the report is written. */
+std::vector<CompareRun> p_bench_compare( std::string const& filename,
+                                         size_t             reps,
+                                         size_t             jobs,
+                                         std::string const& strategy,
+                                         size_t             chunk_size,
+                                         std::string const& output,
+                                         bool               json,
+                                         std::ostream&      out );
+
+/****************************************************************
+* The decompression of the deflated entries of an archive with one
+* inflate backend.
+****************************************************************/
+struct InflateRun {
+    // As given to inflate_plan, e.g. "zlib" or "auto".
+    std::string backend;
+    // What that comes to, e.g. "libdeflate <= 8.0MB, isal".
+    std::string plan;
+    // Medians over the repetitions of the time spent  on  all  of
+    // the entries, and on just those of up to and over INFLATE_-
+    // WHOLE_MAX bytes.
+    uint64_t    nanoseconds;
+    uint64_t    small_ns;
+    uint64_t    large_ns;
+    // The uncompressed bytes of all of those entries, and of  the
+    // small and the large ones.
+    uint64_t    bytes;
+    uint64_t    small_bytes;
+    uint64_t    large_bytes;
+    // Relative to zlib.
+    double      speedup;
+};
+
+/****************************************************************
+* Main interface to run the inflate benchmark.
+*****************************************************************
+* filename: path of zip file to be opened relative to CWD. It must
+* be one that the native reader can read (see reader.hpp).
+*
+* reps: the number of times that each backend decompresses all of
+* the deflated entries, one after another on one thread, with the
+* data discarded (but checked). The archive is read into  memory
+* first, so this measures decompression and nothing else.
+*
+* chunk_size: the size of the buffer that is streamed into, as for
+* p_unzip.
+*
+* json: when true, write one JSON object per backend on separate
+* lines; otherwise a human readable table.
+*
+* out: where the report is written. */
+std::vector<InflateRun> p_bench_inflate( std::string const& filename,
+                                         size_t             reps,
+                                         size_t             chunk_size,
+                                         bool               json,
+                                         std::ostream&      out );
@@ -0,0 +1,642 @@
+/****************************************************************
+* Implementation of the API for parallel zip creation.
+****************************************************************/
+#include "config.hpp"
+#include "create.hpp"
+#include "distribution.hpp"
+#include "fs.hpp"
+#include "sys.hpp"
+#include "zip.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+uint32_t const MAX32 = numeric_limits<uint32_t>::max();
+uint16_t const MAX16 = numeric_limits<uint16_t>::max();
+
+// Version numbers (times ten) of the zip spec needed to extract
+// an entry; 4.5 is needed for Zip64.
+uint16_t const VERSION_DEFAULT = 20;
+uint16_t const VERSION_ZIP64   = 45;
+
+// Append little-endian integers to a byte string.
+void put16( string& s, uint16_t v ) {
+    s += char( v & 0xff ); s += char( v >> 8 );
+}
+void put32( string& s, uint32_t v ) {
+    put16( s, uint16_t( v ) ); put16( s, uint16_t( v >> 16 ) );
+}
+void put64( string& s, uint64_t v ) {
+    put32( s, uint32_t( v ) ); put32( s, uint32_t( v >> 32 ) );
+}
+
+// Files larger than this are compressed straight into the archive
+// (see Sequencer::stream) instead of in memory, so that the memory
+// used does not depend on the size of the largest file.
+uint64_t const STREAM_MIN  = uint64_t( 16 ) << 20;
+
+// The most bytes of compressed entries that are held in  memory
+// waiting for their turn to be written (see Sequencer::put).
+uint64_t const PENDING_MAX = uint64_t( 256 ) << 20;
+
+// A compressed entry on its way from a worker to the archive. The
+// data is empty for entries that are streamed.
+struct Item {
+    vector<char> data;
+    uint64_t     size;
+    uint64_t     comp_size;
+    uint32_t     crc;
+    uint16_t     method;
+};
+
+// Takes the (compressed) data of an entry piece by piece.
+using DataSink = function<void( void const* data, size_t size )>;
+
+// What we need to remember about each entry after it has been
+// written in order to produce the central directory.
+struct Record {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t comp_size;
+    uint32_t crc;
+    uint32_t dos_time;
+    uint16_t method;
+};
+
+/****************************************************************
+* Sequencer
+*****************************************************************
+* The workers finish their entries in an  unpredictable  order  but
+* the archive must be written  sequentially.  So  each  worker hands
+* its compressed entries to this object which holds  them  until
+* all the preceding entries have been written. Whichever  thread
+* deposits the next entry in sequence becomes  the  writer  and
+* keeps writing for as long as the following entries  are  ready,
+* doing the file I/O outside of the lock.
+*
+* To bound memory, a worker may only deposit an entry whose index
+* is within `window` of the next one to be written, and only while
+* the entries waiting hold no more than PENDING_MAX bytes; other-
+* wise it waits. The next entry to be written is always  taken.
+* This cannot deadlock as long as each thread processes its entries
+* in increasing order, because then the thread that owns the next
+* entry always has it in hand (or is compressing it) and is  never
+* the one waiting. Files larger than STREAM_MIN are not held at all
+* but are compressed straight into the archive by their worker when
+* their turn comes (see stream), so that at most  PENDING_MAX  plus
+* STREAM_MIN per worker are in memory. */
+class Sequencer {
+
+public:
+    Sequencer( File& out, vector<TreeEntry> const& entries,
+               size_t window )
+        : m_out( out ), m_entries( entries ), m_window( window )
+        , m_next( 0 ), m_pending_bytes( 0 ), m_writing( false )
+        , m_failed( false ), m_offset( 0 )
+        , m_records( entries.size() ) {}
+
+    // Hand over a compressed entry; may block (see above).
+    void put( size_t idx, Item&& item ) {
+        unique_lock<mutex> lock( m_mtx );
+        uint64_t bytes = item.data.size();
+        m_cv.wait( lock, [&]{
+            return m_failed || idx == m_next || ( idx < m_next + m_window
+                && m_pending_bytes + bytes <= PENDING_MAX ); } );
+        FAIL( m_failed, "archive writer has failed" );
+        m_pending.insert( make_pair( idx, move( item ) ) );
+        m_pending_bytes += bytes;
+        if( m_writing )
+            return; // the current writer will pick it up.
+        m_writing = true;
+        drain( lock );
+    }
+
+    // Wait until all of the entries before this one have been writ-
+    // ten, then write it as `produce` compresses it, and return its
+    // sizes and CRC. `size` is the size of the file, which says
+    // whether the local header needs room for Zip64 sizes.
+    Item stream( size_t idx, uint64_t size,
+                 function<Item( DataSink const& )> const& produce ) {
+        unique_lock<mutex> lock( m_mtx );
+        m_cv.wait( lock, [&]{
+            return m_failed || ( idx == m_next && !m_writing ); } );
+        FAIL( m_failed, "archive writer has failed" );
+        m_writing = true;
+        lock.unlock();
+        Item item;
+        try {
+            item = write_streamed( idx, size, produce );
+        } catch( ... ) {
+            abort();
+            throw;
+        }
+        lock.lock();
+        ++m_next;
+        m_cv.notify_all();
+        drain( lock );
+        return item;
+    }
+
+    // Called when a worker fails so that the others don't  wait
+    // forever for an entry that will never come.
+    void abort() {
+        lock_guard<mutex> lock( m_mtx );
+        m_failed = true;
+        m_cv.notify_all();
+    }
+
+    // These must only be called after all workers have finished.
+    uint64_t               offset()  const { return m_offset;  }
+    vector<Record> const&  records() const { return m_records; }
+    size_t                 written() const { return m_next;    }
+
+private:
+    // Write the pending entries that are next in sequence, for  as
+    // long as there are any. Called by the writer with  the  lock
+    // held, and lets the next writer in when it is done.
+    void drain( unique_lock<mutex>& lock ) {
+        while( has_key( m_pending, m_next ) ) {
+            Item next( move( m_pending[m_next] ) );
+            m_pending.erase( m_next );
+            lock.unlock();
+            try {
+                write( m_next, next );
+            } catch( ... ) {
+                abort();
+                throw;
+            }
+            lock.lock();
+            m_pending_bytes -= next.data.size();
+            ++m_next;
+            m_cv.notify_all();
+        }
+        m_writing = false;
+        m_cv.notify_all();
+    }
+
+    // The local header of an entry. In the local header the Zip64
+    // extra field, when present, must hold both sizes.
+    string local_header( TreeEntry const& e, Record const& r,
+                         bool z64 ) const {
+        string h;
+        put32( h, 0x04034b50 );
+        put16( h, z64 ? VERSION_ZIP64 : VERSION_DEFAULT );
+        put16( h, 0 ); // flags
+        put16( h, r.method );
+        put32( h, r.dos_time );
+        put32( h, r.crc );
+        put32( h, z64 ? MAX32 : uint32_t( r.comp_size ) );
+        put32( h, z64 ? MAX32 : uint32_t( r.size ) );
+        put16( h, uint16_t( e.path.size() ) );
+        put16( h, z64 ? 20 : 0 );
+        h += e.path;
+        if( z64 ) {
+            put16( h, 0x0001 ); put16( h, 16 );
+            put64( h, r.size ); put64( h, r.comp_size );
+        }
+        return h;
+    }
+
+    // Write the local header followed by the data.  Only  ever
+    // called by one thread at a time.
+    void write( size_t idx, Item const& item ) {
+        TreeEntry const& e = m_entries[idx];
+        Record& r   = m_records[idx];
+        r.offset    = m_offset;
+        r.size      = item.size;
+        r.comp_size = item.comp_size;
+        r.crc       = item.crc;
+        r.dos_time  = to_dos_time( e.mtime );
+        r.method    = item.method;
+        string h = local_header( e, r,
+                                 r.size >= MAX32 || r.comp_size >= MAX32 );
+        m_out.write( h.data(), h.size() );
+        if( !item.data.empty() )
+            m_out.write( item.data.data(), item.data.size() );
+        m_offset += h.size() + item.data.size();
+    }
+
+    // Write a local header with blank sizes and CRC, then the data
+    // as it is compressed, then go back and fill them in. Deflate
+    // can make incompressible data a little larger, so the  Zip64
+    // field is put in if the file is close to needing it.
+    Item write_streamed( size_t idx, uint64_t size,
+                         function<Item( DataSink const& )> const& produce ) {
+        TreeEntry const& e = m_entries[idx];
+        Record& r   = m_records[idx];
+        r.offset    = m_offset;
+        r.size      = r.comp_size = 0;
+        r.crc       = 0;
+        r.dos_time  = to_dos_time( e.mtime );
+        r.method    = ZIP_METHOD_STORE;
+        bool z64 = size + size/1000 + 1024 >= MAX32;
+        string h = local_header( e, r, z64 );
+        m_out.write( h.data(), h.size() );
+        Item item = produce( [&]( void const* data, size_t n ){
+            m_out.write( data, n );
+        } );
+        r.size      = item.size;
+        r.comp_size = item.comp_size;
+        r.crc       = item.crc;
+        r.method    = item.method;
+        FAIL( !z64 && ( r.size >= MAX32 || r.comp_size >= MAX32 ),
+            e.path << " grew while archiving" );
+        m_out.seek( r.offset );
+        h = local_header( e, r, z64 );
+        m_out.write( h.data(), h.size() );
+        m_offset += h.size() + r.comp_size;
+        m_out.seek( m_offset );
+        return item;
+    }
+
+    File&                    m_out;
+    vector<TreeEntry> const& m_entries;
+    size_t                   m_window;
+
+    mutex                    m_mtx;
+    condition_variable       m_cv;
+    map<size_t, Item>        m_pending;
+    size_t                   m_next;
+    uint64_t                 m_pending_bytes;
+    bool                     m_writing;
+    bool                     m_failed;
+
+    // Only touched by the current writer.
+    uint64_t                 m_offset;
+    vector<Record>           m_records;
+
+};
+
+// Write the central directory and the end  of  central  directory
+// records (including the Zip64 ones if needed) after  the  entries.
+void write_central_dir( File& out, vector<TreeEntry> const& entries,
+                        vector<Record> const& records,
+                        uint64_t cd_offset ) {
+    // Upper byte of "version made by" is the host system, which
+    // determines how the external attributes are interpreted.
+    uint16_t made_by = uint16_t( OS_SWITCH( 3, 0 ) << 8 |
+                                 VERSION_ZIP64 );
+    string cd;
+    for( size_t i = 0; i < entries.size(); ++i ) {
+        TreeEntry const& e = entries[i];
+        Record    const& r = records[i];
+        // Only the fields that overflow go into the Zip64 extra
+        // field here, and in this order.
+        string z64;
+        if( r.size      >= MAX32 ) put64( z64, r.size );
+        if( r.comp_size >= MAX32 ) put64( z64, r.comp_size );
+        if( r.offset    >= MAX32 ) put64( z64, r.offset );
+        put32( cd, 0x02014b50 );
+        put16( cd, made_by );
+        put16( cd, z64.empty() ? VERSION_DEFAULT : VERSION_ZIP64 );
+        put16( cd, 0 ); // flags
+        put16( cd, r.method );
+        put32( cd, r.dos_time );
+        put32( cd, r.crc );
+        put32( cd, uint32_t( min<uint64_t>( r.comp_size, MAX32 ) ) );
+        put32( cd, uint32_t( min<uint64_t>( r.size,      MAX32 ) ) );
+        put16( cd, uint16_t( e.path.size() ) );
+        put16( cd, uint16_t( z64.empty() ? 0 : z64.size()+4 ) );
+        put16( cd, 0 ); // comment length
+        put16( cd, 0 ); // disk number
+        put16( cd, 0 ); // internal attributes
+        // External attributes: unix mode in the upper 16  bits  and
+        // the MS-DOS directory bit in the lowest byte.
+        put32( cd, e.is_folder ? ( 040755u << 16 | 0x10 )
+                               : ( 0100644u << 16 ) );
+        put32( cd, uint32_t( min<uint64_t>( r.offset, MAX32 ) ) );
+        cd += e.path;
+        if( !z64.empty() ) {
+            put16( cd, 0x0001 );
+            put16( cd, uint16_t( z64.size() ) );
+            cd += z64;
+        }
+    }
+    uint64_t count   = entries.size();
+    uint64_t cd_size = cd.size();
+    if( count >= MAX16 || cd_size >= MAX32 || cd_offset >= MAX32 ) {
+        uint64_t z64_offset = cd_offset + cd_size;
+        put32( cd, 0x06064b50 );
+        put64( cd, 44 ); // size of remainder of this record
+        put16( cd, made_by );
+        put16( cd, VERSION_ZIP64 );
+        put32( cd, 0 ); put32( cd, 0 ); // disk numbers
+        put64( cd, count ); put64( cd, count );
+        put64( cd, cd_size );
+        put64( cd, cd_offset );
+        // Locator
+        put32( cd, 0x07064b50 );
+        put32( cd, 0 );
+        put64( cd, z64_offset );
+        put32( cd, 1 ); // total number of disks
+    }
+    put32( cd, 0x06054b50 );
+    put32( cd, 0 ); // disk numbers
+    put16( cd, uint16_t( min<uint64_t>( count, MAX16 ) ) );
+    put16( cd, uint16_t( min<uint64_t>( count, MAX16 ) ) );
+    put32( cd, uint32_t( min<uint64_t>( cd_size,   MAX32 ) ) );
+    put32( cd, uint32_t( min<uint64_t>( cd_offset, MAX32 ) ) );
+    put16( cd, 0 ); // comment length
+    out.write( cd.data(), cd.size() );
+}
+
+// Read the file at `path` in chunks of buf.size(), computing the
+// CRC and, if method is deflate, compressing the data  with  the
+// supplied deflate stream (into `out`) as it is  read.  The  data
+// that results is passed to `sink`, and the sizes and CRC are re-
+// turned in an Item with no data.
+Item compress( string const& path, uint16_t method, Buffer& buf,
+               Buffer& out, z_stream& zs, DataSink const& sink ) {
+    Item item;
+    item.size      = 0;
+    item.comp_size = 0;
+    item.crc       = crc32( 0L, Z_NULL, 0 );
+    item.method    = method;
+    File in( path, "rb" );
+    if( method == ZIP_METHOD_DEFLATE ) {
+        FAIL_( deflateReset( &zs ) != Z_OK );
+        int  ret = Z_OK;
+        bool eof = false;
+        while( !eof ) {
+            auto read = in.read_some( buf );
+            eof = read < buf.size();
+            item.crc  = crc32( item.crc, (Bytef const*)buf.get(),
+                               uInt( read ) );
+            item.size += read;
+            zs.next_in  = (Bytef*)buf.get();
+            zs.avail_in = uInt( read );
+            // Keep calling deflate until it stops filling up all
+            // of the output space we give it.
+            do {
+                zs.next_out  = (Bytef*)out.get();
+                zs.avail_out = uInt( out.size() );
+                ret = deflate( &zs, eof ? Z_FINISH : Z_NO_FLUSH );
+                FAIL_( ret == Z_STREAM_ERROR );
+                size_t n = out.size() - zs.avail_out;
+                if( n > 0 )
+                    sink( out.get(), n );
+                item.comp_size += n;
+            } while( zs.avail_out == 0 );
+        }
+        FAIL_( ret != Z_STREAM_END );
+        return item;
+    }
+    FAIL_( method != ZIP_METHOD_STORE );
+    while( true ) {
+        auto read = in.read_some( buf );
+        item.crc  = crc32( item.crc, (Bytef const*)buf.get(),
+                           uInt( read ) );
+        item.size += read;
+        if( read > 0 )
+            sink( buf.get(), size_t( read ) );
+        if( read < buf.size() )
+            break;
+    }
+    item.comp_size = item.size;
+    return item;
+}
+
+// Compress a file into memory. If deflating does not make it any
+// smaller then it is re-read and stored instead.
+Item compress_in_memory( string const& path, uint16_t method,
+                         Buffer& buf, Buffer& out, z_stream& zs ) {
+    vector<char> data;
+    DataSink sink = [&]( void const* p, size_t n ) {
+        auto c = static_cast<char const*>( p );
+        data.insert( data.end(), c, c+n );
+    };
+    Item item = compress( path, method, buf, out, zs, sink );
+    if( item.method == ZIP_METHOD_DEFLATE &&
+        item.comp_size >= item.size ) {
+        uint32_t crc = item.crc;
+        data.clear();
+        item = compress( path, ZIP_METHOD_STORE, buf, out, zs, sink );
+        FAIL( item.crc != crc, path << " changed while archiving" );
+    }
+    item.data = move( data );
+    return item;
+}
+
+// Data returned from each zip worker thread.
+struct thread_output {
+    thread_output()
+        : watch(), files( 0 ), bytes( 0 ), ret( false ) {}
+    StopWatch watch;
+    size_t    files;
+    uint64_t  bytes;
+    bool      ret;
+};
+
+/****************************************************************
+* This is the function that will be given to each  of  the  thread
+* objects. It compresses the entries whose indexes are in `idxs`
+* (which must be increasing) and hands them to the sequencer.
+****************************************************************/
+void zip_worker( size_t                   thread_idx,
+                 string const&            root,
+                 vector<TreeEntry> const& entries,
+                 index_list const&        idxs,
+                 size_t                   chunk_size,
+                 bool                     quiet,
+                 uint16_t                 method,
+                 Sequencer&               seq,
+                 thread_output&           data )
+{
+    static mutex log_name_mtx;
+
+    TRY
+    data.watch.start( "zip" );
+    Buffer   buf( chunk_size );
+    Buffer   out( chunk_size );
+    z_stream zs;
+    zs.zalloc = Z_NULL; zs.zfree = Z_NULL; zs.opaque = Z_NULL;
+    // Negative window bits means raw deflate  data  with  no  zlib
+    // header or trailer, which is what goes into a zip file.
+    FAIL_( deflateInit2( &zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK );
+    // !! Should not throw until deflateEnd is called
+    try {
+        for( auto idx : idxs ) {
+            TreeEntry const& e = entries[idx];
+            if( e.is_folder ) {
+                seq.put( idx, Item{ {}, 0, 0, 0, ZIP_METHOD_STORE } );
+                continue;
+            }
+            if( !quiet ) {
+                lock_guard<mutex> lock( log_name_mtx );
+                cerr << left << setw( 4 ) <<
+                    to_string( thread_idx ) + "> " << e.path << endl;
+            }
+            string path = root + "/" + e.path;
+            if( e.size > STREAM_MIN ) {
+                // Large files are not kept whole in memory, and  are
+                // left deflated even if that did not make them smaller.
+                Item item = seq.stream( idx, e.size,
+                    [&]( DataSink const& sink ) {
+                        return compress( path, method, buf, out, zs, sink );
+                    } );
+                data.files++; data.bytes += item.size;
+                continue;
+            }
+            Item item = compress_in_memory( path, method, buf, out, zs );
+            data.files++; data.bytes += item.size;
+            seq.put( idx, move( item ) );
+        }
+    } catch( ... ) {
+        deflateEnd( &zs );
+        seq.abort();
+        throw;
+    }
+    deflateEnd( &zs );
+    data.ret = true;
+    CATCH_ALL
+    data.watch.stop( "zip" );
+}
+
+} // anon namespace
+
+/****************************************************************
+* Main interface for parallel zip creation.
+****************************************************************/
+UnzipSummary p_zip( string   filename,
+                    string   folder,
+                    size_t   jobs,
+                    bool     quiet,
+                    string   strategy,
+                    size_t   chunk_size,
+                    uint16_t method,
+                    bool     deterministic )
+{
+    UnzipSummary res( jobs, effective_cpus() );
+    res.watch.start( "total" );
+    // Memory and I/O are accounted over the same steps as the timing.
+    res.memory.start();
+    res.io_samples.emplace_back( "start", process_io() );
+    auto step = [&]( char const* name ) {
+        res.memory.step( name );
+        res.io_samples.emplace_back( name, process_io() );
+    };
+
+    FAIL( chunk_size < 1, "Invalid chunk size: " << chunk_size );
+    // zlib works with 32 bit lengths.
+    chunk_size = min( chunk_size, size_t( 1 ) << 30 );
+    res.chunk_size_used = chunk_size;
+    FAIL( method != ZIP_METHOD_STORE && method != ZIP_METHOD_DEFLATE,
+        "unsupported compression method " << method );
+
+    /************************************************************
+    * Find everything that needs to go into the archive
+    ************************************************************/
+    vector<TreeEntry> entries;
+    res.watch.run( "walk", [&]{
+        entries = walk_tree( folder, jobs );
+        if( deterministic )
+            sort( entries.begin(), entries.end(),
+                []( TreeEntry const& l, TreeEntry const& r ) {
+                    return l.path < r.path;
+                } );
+    });
+    step( "walk" );
+
+    /************************************************************
+    * Distribution of entries to the threads
+    *************************************************************
+    * The strategies work on ZipStats, so we make one for each
+    * entry with the fields that they use. Each thread's list of
+    * indexes is then sorted, which the sequencer requires. */
+    vector<ZipStat> stats;
+    for( size_t i = 0; i < entries.size(); ++i ) {
+        zip_stat_t st;
+        zip_stat_init( &st );
+        st.valid       = ZIP_STAT_NAME | ZIP_STAT_INDEX |
+                         ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE |
+                         ZIP_STAT_MTIME | ZIP_STAT_COMP_METHOD |
+                         ZIP_STAT_ENCRYPTION_METHOD;
+        st.name        = entries[i].path.c_str();
+        st.index       = i;
+        st.size        = entries[i].size;
+        st.comp_size   = entries[i].size;
+        st.mtime       = entries[i].mtime;
+        st.comp_method = method;
+        st.encryption_method = ZIP_EM_NONE;
+        stats.emplace_back( st );
+    }
+    distributor_t distributor = find_strategy( strategy );
+    index_lists thread_idxs;
+    res.watch.run( "distribute", [&]{
+        thread_idxs = distributor(
+            jobs, make_range( stats.begin(), stats.end() ) );
+        for( auto& ti : thread_idxs )
+            sort( ti.begin(), ti.end() );
+    });
+    FAIL_( thread_idxs.size() != jobs );
+    step( "distribute" );
+    res.strategy_used = strategy;
+
+    /************************************************************
+    * Compress in parallel and write in order
+    ************************************************************/
+    File      out( filename, "wb" );
+    Sequencer seq( out, entries, 4*jobs );
+
+    vector<thread_output> outputs( jobs );
+    vector<thread>        threads( jobs );
+
+    res.watch.start( "zip" );
+    for( size_t i = 0; i < jobs; ++i )
+        threads[i] = thread( zip_worker,
+                             i,
+                             ref( folder ),
+                             ref( entries ),
+                             ref( thread_idxs[i] ),
+                             chunk_size,
+                             quiet,
+                             method,
+                             ref( seq ),
+                             ref( outputs[i] ) );
+    for( auto& t : threads )
+        t.join();
+    res.watch.stop( "zip" );
+    step( "zip" );
+
+    for( size_t i = 0; i < jobs; ++i )
+        FAIL_( !outputs[i].ret );
+    FAIL_( seq.written() != entries.size() );
+
+    res.watch.run( "central_dir", [&]{
+        write_central_dir( out, entries, seq.records(), seq.offset() );
+    });
+    step( "central_dir" );
+    // Each worker reads into one chunk and deflates into another.
+    res.memory.chunks = 2*uint64_t( chunk_size )*jobs;
+    res.memory.finish();
+
+    res.watch.stop( "total" );
+
+    /************************************************************
+    * Summary
+    ************************************************************/
+    for( size_t i = 0; i < jobs; ++i ) {
+        res.files      += outputs[i].files;
+        res.bytes      += outputs[i].bytes;
+        res.files_ts[i] = outputs[i].files;
+        res.bytes_ts[i] = outputs[i].bytes;
+        res.watches[i]  = move( outputs[i].watch );
+    }
+    res.folders  = size_t( count_if( entries.begin(), entries.end(),
+        []( TreeEntry const& e ){ return e.is_folder; } ) );
+    FAIL_( res.files + res.folders != entries.size() );
+    res.filename = filename;
+    res.mode     = UnzipMode::create;
+    return res;
+}
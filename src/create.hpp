@@ -0,0 +1,57 @@
+/****************************************************************
+* Interface to the parallel zip creation functionality. This is
+* the reverse of p_unzip: it reuses the  distribution  strategies
+* to  spread  the compression work among threads and reports its
+* diagnostics through the same UnzipSummary structure.
+****************************************************************/
+#pragma once
+
+#include "directory.hpp"
+#include "unzip.hpp"
+
+#include <string>
+
+/****************************************************************
+* Main interface to create an archive in parallel.
+*****************************************************************
+* filename: path of the zip file to be created (or overwritten).
+*
+* folder: the folder whose contents are to be archived. Entry names
+* in the archive are relative to this folder and do  not  include
+* it, i.e., this is like running `zip -r` from inside the folder.
+*
+* jobs: this many threads will be used both for walking the folder
+* tree and for compressing.
+*
+* quiet: when false, the name of each file is echoed as  it  is
+* compressed.
+*
+* strategy: name of the strategy used to distribute  the  entries
+* among the threads, as for p_unzip.
+*
+* chunk_size: files are read (and fed to the compressor) in chunks
+* of this size.
+*
+* method: either ZIP_METHOD_STORE or ZIP_METHOD_DEFLATE. Entries
+* that do not shrink when deflated are stored instead,  except  for
+* files of more than 16MB, which are compressed straight into the
+* archive.
+*
+* deterministic: the folder walk is parallel so the order in which
+* it finds things varies from run to run; when this  is  true  the
+* entries are sorted by name so that the same folder tree always
+* yields an identical archive.
+*
+* The compressed entries are written  to  the  archive  in  entry
+* order by whichever thread completes the next one in sequence, so
+* the output is a normal sequential zip file. Zip64 records  are
+* written automatically where sizes, offsets or the  entry  count
+* need them. This function will throw on any error. */
+UnzipSummary p_zip( std::string filename,
+                    std::string folder,
+                    size_t      jobs          = 1,
+                    bool        quiet         = true,
+                    std::string strategy      = DEFAULT_DIST,
+                    size_t      chunk_size    = DEFAULT_CHUNK,
+                    uint16_t    method        = ZIP_METHOD_DEFLATE,
+                    bool        deterministic = false );
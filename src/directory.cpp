@@ -0,0 +1,281 @@
+/****************************************************************
+* Compact central directory parsed straight from the archive.
+****************************************************************/
+#include "config.hpp"
+#include "directory.hpp"
+#include "fs.hpp"
+#include "macros.hpp"
+
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+// Signatures of the various zip records that we need to read.
+uint32_t const SIG_EOCD          = 0x06054b50;
+uint32_t const SIG_ZIP64_EOCD    = 0x06064b50;
+uint32_t const SIG_ZIP64_LOCATOR = 0x07064b50;
+uint32_t const SIG_CENTRAL       = 0x02014b50;
+
+// Fixed sizes of those records (not including variable parts).
+size_t const EOCD_SIZE          = 22;
+size_t const ZIP64_LOCATOR_SIZE = 20;
+size_t const CENTRAL_SIZE       = 46;
+
+// Zip64 extended information extra field.
+uint16_t const EXTRA_ZIP64 = 0x0001;
+
+/* Bounds-checked little-endian reader over a region of the buf-
+ * fer. All the integers in a zip file are little endian, so  we
+ * assemble them byte by byte which also avoids alignment issues. */
+class Reader {
+
+public:
+    Reader( uint8_t const* start, uint8_t const* end )
+        : m_p( start ), m_end( end ) {}
+
+    uint16_t u16() {
+        need( 2 );
+        uint16_t res = uint16_t( m_p[0] | (m_p[1] << 8) );
+        m_p += 2;
+        return res;
+    }
+    uint32_t u32() {
+        uint32_t lo = u16();
+        return lo | (uint32_t( u16() ) << 16);
+    }
+    uint64_t u64() {
+        uint64_t lo = u32();
+        return lo | (uint64_t( u32() ) << 32);
+    }
+    void skip( size_t n ) { need( n ); m_p += n; }
+
+    uint8_t const* pos()  const { return m_p; }
+    size_t         left() const { return size_t( m_end - m_p ); }
+
+private:
+    void need( size_t n ) const {
+        FAIL( left() < n, "zip directory is truncated" );
+    }
+
+    uint8_t const* m_p;
+    uint8_t const* m_end;
+
+};
+
+// Where the central directory is, from the end of central directory
+// record (and its Zip64 counterpart if there is one).
+struct Location {
+    uint64_t count;
+    uint64_t cd_offset;
+    uint64_t cd_size;
+    // The lowest offset in the file that is needed to  parse  the
+    // directory. If this is below the start of the buffer  then
+    // more of the file must be read.
+    uint64_t start;
+};
+
+// Find the central directory given a buffer holding the end of an
+// archive, starting at offset `base_off` in the file.
+Location locate( uint8_t const* base, size_t size, uint64_t base_off ) {
+    FAIL( size < EOCD_SIZE, "file too small to be a zip archive" );
+
+    // The end of central directory record is at the very end  of
+    // the file, followed only by a comment of up  to  64K.  So we
+    // scan backwards looking for its signature.
+    size_t lowest = ( size > EOCD_SIZE + 0xFFFF )
+                  ? size - EOCD_SIZE - 0xFFFF : 0;
+    size_t eocd   = size - EOCD_SIZE;
+    while( true ) {
+        if( Reader( base+eocd, base+size ).u32() == SIG_EOCD )
+            break;
+        FAIL( eocd == lowest, "cannot find end of central directory" );
+        --eocd;
+    }
+    Location loc;
+    Reader r( base+eocd+4, base+size );
+    r.skip( 4 ); // disk numbers
+    loc.count     = r.u16();
+    r.skip( 2 ); // total entries (across all disks)
+    loc.cd_size   = r.u32();
+    loc.cd_offset = r.u32();
+    loc.start     = loc.cd_offset;
+
+    // If there is a Zip64 locator right in front of the EOCD then
+    // the real values are in the Zip64 end of central directory.
+    if( eocd >= ZIP64_LOCATOR_SIZE ) {
+        Reader l( base+eocd-ZIP64_LOCATOR_SIZE, base+eocd );
+        if( l.u32() == SIG_ZIP64_LOCATOR ) {
+            l.skip( 4 ); // disk number
+            uint64_t z64 = l.u64();
+            if( z64 < base_off ) {
+                loc.start = z64;
+                return loc;
+            }
+            FAIL( z64 - base_off >= size,
+                "bad zip64 end of central directory" );
+            Reader r64( base+(z64-base_off), base+size );
+            FAIL( r64.u32() != SIG_ZIP64_EOCD,
+                "bad zip64 end of central directory signature" );
+            r64.skip( 8+2+2+4+4+8 );
+            loc.count     = r64.u64();
+            loc.cd_size   = r64.u64();
+            loc.cd_offset = r64.u64();
+            loc.start     = min( z64, loc.cd_offset );
+        }
+    }
+    return loc;
+}
+
+} // anon namespace
+
+// Get a short human readable name for a compression method.
+string method_name( uint16_t method ) {
+    switch( method ) {
+        case 0:  return "store";
+        case 8:  return "deflate";
+        case 9:  return "deflate64";
+        case 12: return "bzip2";
+        case 14: return "lzma";
+        case 93: return "zstd";
+        case 95: return "xz";
+        case 98: return "ppmd";
+        case 99: return "aes";
+    }
+    return "m" + to_string( method );
+}
+
+// Convert a time_t into an MS-DOS date/time in local time.
+uint32_t to_dos_time( time_t t ) {
+    struct tm tm;
+#ifdef POSIX
+    FAIL_( !localtime_r( &t, &tm ) );
+#else
+    FAIL_( localtime_s( &tm, &t ) != 0 );
+#endif
+    if( tm.tm_year < 80 )
+        return (1 << 21) | (1 << 16);
+    return uint32_t( tm.tm_year - 80 ) << 25 |
+           uint32_t( tm.tm_mon  +  1 ) << 21 |
+           uint32_t( tm.tm_mday      ) << 16 |
+           uint32_t( tm.tm_hour      ) << 11 |
+           uint32_t( tm.tm_min       ) <<  5 |
+           uint32_t( tm.tm_sec       ) >>  1;
+}
+
+/****************************************************************
+* Directory
+****************************************************************/
+Directory::Directory( Buffer const& zip, uint64_t base_off )
+    : m_entries(), m_names(), m_cd_offset( 0 ), m_cd_size( 0 ) {
+    auto   base = static_cast<uint8_t const*>( zip.get() );
+    size_t size = zip.size();
+    Location loc = locate( base, size, base_off );
+    uint64_t count = loc.count;
+    m_cd_size      = loc.cd_size;
+    m_cd_offset    = loc.cd_offset;
+    FAIL( m_cd_offset < base_off || m_cd_offset - base_off > size ||
+          m_cd_size > size - (m_cd_offset - base_off),
+        "central directory lies outside of the archive" );
+
+    // Each central directory record is at least CENTRAL_SIZE bytes
+    // so this caps the reservation for corrupt counts.
+    m_entries.reserve( size_t( min( count, m_cd_size/CENTRAL_SIZE ) ) );
+
+    auto cd_start = base+(m_cd_offset-base_off);
+    Reader cd( cd_start, cd_start+m_cd_size );
+    for( uint64_t i = 0; i < count; ++i ) {
+        FAIL( cd.u32() != SIG_CENTRAL,
+            "bad central directory record for entry " << i );
+        DirEntry e;
+        cd.skip( 2+2 ); // versions
+        e.flags     = cd.u16();
+        e.method    = cd.u16();
+        uint32_t t  = cd.u16();
+        e.dos_time  = (uint32_t( cd.u16() ) << 16) | t;
+        e.crc       = cd.u32();
+        e.comp_size = cd.u32();
+        e.size      = cd.u32();
+        e.name_len  = cd.u16();
+        uint16_t extra_len   = cd.u16();
+        uint16_t comment_len = cd.u16();
+        cd.skip( 2+2+4 ); // disk start, attributes
+        e.offset    = cd.u32();
+
+        e.name_off = m_names.size();
+        auto name  = reinterpret_cast<char const*>( cd.pos() );
+        cd.skip( e.name_len );
+        m_names.append( name, e.name_len );
+
+        // Walk the extra fields looking for Zip64 values. These are
+        // present only for those fields which are maxed  out  in
+        // the fixed part of the record, and in this order.
+        Reader extra( cd.pos(), cd.pos()+extra_len );
+        cd.skip( extra_len );
+        while( extra.left() >= 4 ) {
+            uint16_t id  = extra.u16();
+            uint16_t len = extra.u16();
+            Reader field( extra.pos(), extra.pos()+min<size_t>(
+                len, extra.left() ) );
+            extra.skip( min<size_t>( len, extra.left() ) );
+            if( id != EXTRA_ZIP64 )
+                continue;
+            uint32_t const max32 = numeric_limits<uint32_t>::max();
+            if( e.size      == max32 ) e.size      = field.u64();
+            if( e.comp_size == max32 ) e.comp_size = field.u64();
+            if( e.offset    == max32 ) e.offset    = field.u64();
+        }
+        cd.skip( comment_len );
+        m_entries.push_back( e );
+    }
+}
+
+Directory Directory::load( string const& filename ) {
+    auto size = file_size( filename );
+    FAIL( !size, "failed to open " << filename );
+    File f( filename, "rb" );
+    // Start with the most that the end records plus a comment can
+    // take up, and go back further if they say that we need to.
+    uint64_t start = size.get() - min<uint64_t>( size.get(),
+        EOCD_SIZE + 0xFFFF + ZIP64_LOCATOR_SIZE );
+    while( true ) {
+        Buffer buf( size_t( size.get() - start ) );
+        f.seek( start );
+        FAIL( f.read_some( buf ) != buf.size(),
+            "failed to read " << filename );
+        Location loc = locate( static_cast<uint8_t const*>(
+            buf.get() ), buf.size(), start );
+        if( loc.start >= start )
+            return Directory( buf, start );
+        start = loc.start;
+    }
+}
+
+string Directory::name( size_t idx ) const {
+    return string( name_data( idx ), m_entries[idx].name_len );
+}
+
+bool Directory::is_folder( size_t idx ) const {
+    auto len = m_entries[idx].name_len;
+    return len > 0 && name_data( idx )[len-1] == '/';
+}
+
+// Convert the MS-DOS  date/time  into  a  time_t.  DOS  timestamps
+// carry no timezone and have two-second resolution; like  libzip,
+// we treat them as local time and let the C runtime  figure  out
+// daylight savings.
+time_t Directory::mtime( size_t idx ) const {
+    uint32_t dt = m_entries[idx].dos_time;
+    struct tm tm;
+    memset( &tm, 0, sizeof( tm ) );
+    tm.tm_year  = int( (dt >> 25) & 0x7f ) + 80;
+    tm.tm_mon   = int( (dt >> 21) & 0x0f ) - 1;
+    tm.tm_mday  = int( (dt >> 16) & 0x1f );
+    tm.tm_hour  = int( (dt >> 11) & 0x1f );
+    tm.tm_min   = int( (dt >>  5) & 0x3f );
+    tm.tm_sec   = int( (dt & 0x1f) * 2 );
+    tm.tm_isdst = -1;
+    return mktime( &tm );
+}
@@ -0,0 +1,105 @@
+/****************************************************************
+* Compact central directory
+*****************************************************************
+* This is a read-only table of the entries in a zip archive which
+* is parsed directly out of the central directory sitting in  the
+* in-memory archive buffer. It does not go through libzip, and it
+* stores each entry in a small fixed-size record with  all  names
+* packed into a single string, so that it is cheap to build  and
+* to scan even for archives with millions of entries.
+****************************************************************/
+#pragma once
+
+#include "utils.hpp"
+
+#include <string>
+#include <time.h>
+#include <vector>
+
+// Compression method numbers as defined by the zip spec.
+enum : uint16_t {
+    ZIP_METHOD_STORE   = 0,
+    ZIP_METHOD_DEFLATE = 8
+};
+
+// Get a short human readable name for a zip compression  method,
+// e.g. "deflate". Unknown methods come out as "m<number>".
+std::string method_name( uint16_t method );
+
+// Convert a time_t into an MS-DOS date (high 16 bits)  and  time
+// (low 16 bits) in local time, as stored in zip headers. Times
+// before 1980 are clamped to 1980-01-01.
+uint32_t to_dos_time( time_t t );
+
+/****************************************************************
+* DirEntry: one record of the central directory. The index of an
+* entry is its position in the Directory, which is the same as
+* the index used by libzip.
+****************************************************************/
+struct DirEntry {
+    // Offset of the local file header in the archive.
+    uint64_t offset;
+    // Uncompressed and compressed sizes.
+    uint64_t size;
+    uint64_t comp_size;
+    // Offset of the name in the Directory's name pool.
+    uint64_t name_off;
+    // CRC-32 of the uncompressed data.
+    uint32_t crc;
+    // MS-DOS date (high 16 bits) and time (low 16 bits).
+    uint32_t dos_time;
+    uint16_t name_len;
+    uint16_t method;
+    // General purpose bit flags.
+    uint16_t flags;
+};
+
+/****************************************************************
+* Directory
+****************************************************************/
+class Directory {
+
+public:
+    // Parse the central directory of the zip archive whose entire
+    // contents are in `zip`. Will throw if the archive is malformed.
+    // Zip64 archives are supported. If `base` is given then `zip`
+    // holds only the end of the archive, starting at that offset,
+    // which must include the whole central directory.
+    Directory( Buffer const& zip, uint64_t base = 0 );
+
+    // Read only as much of the end of the file as is needed to
+    // parse the central directory, which is usually a tiny part of
+    // it, instead of the whole archive.
+    static Directory load( std::string const& filename );
+
+    size_t size() const { return m_entries.size(); }
+
+    DirEntry const& operator[]( size_t idx ) const {
+        return m_entries[idx];
+    }
+
+    // Name of the entry. The second version avoids an allocation;
+    // the pointed-to name is not null terminated.
+    std::string name( size_t idx ) const;
+    char const* name_data( size_t idx ) const {
+        return m_names.data() + m_entries[idx].name_off;
+    }
+
+    // True if the name of the entry ends in a forward slash.
+    bool is_folder( size_t idx ) const;
+
+    // Last mod time of the entry, interpreting the DOS timestamp as
+    // local time (as libzip does).
+    time_t mtime( size_t idx ) const;
+
+    // Offset and size of the central directory itself.
+    uint64_t cd_offset() const { return m_cd_offset; }
+    uint64_t cd_size()   const { return m_cd_size;   }
+
+private:
+    std::vector<DirEntry> m_entries;
+    std::string           m_names;
+    uint64_t              m_cd_offset;
+    uint64_t              m_cd_size;
+
+};
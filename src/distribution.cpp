@@ -6,9 +6,14 @@
 ****************************************************************/
 #include "macros.hpp"
 #include "distribution.hpp"
+#include "plugin.hpp"
 
 #include <algorithm>
-#include <set>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
@@ -30,14 +35,41 @@ using namespace std;
 // Global dictionary is located  and  populated  in  this  module.
 map<string, distributor_t> distribute;
 
+// Relative cost per byte of each compression method (estimates).
+double method_cost( uint16_t method ) {
+    switch( method ) {
+        case ZIP_CM_STORE:     return 0.4;
+        case ZIP_CM_DEFLATE:   return 1.0;
+        case ZIP_CM_DEFLATE64: return 1.2;
+        case ZIP_CM_ZSTD:      return 0.6;
+        case ZIP_CM_BZIP2:     return 4.0;
+        case ZIP_CM_LZMA:      return 3.0;
+        case ZIP_CM_XZ:        return 3.0;
+    }
+    // Something exotic; assume it is slow.
+    return 3.0;
+}
+
+// Estimated cost of extracting an entry. Encrypted entries must
+// also be decrypted and authenticated, which even  with  hardware
+// AES costs something per byte, plus a key derivation per entry.
+uint64_t entry_cost( ZipStat const& zs ) {
+    double factor = method_cost( zs.method() );
+    if( zs.encryption() != ZIP_EM_NONE )
+        factor += 0.3;
+    return uint64_t( double( zs.size() )*factor );
+}
+
 // This is a wrapper  around  each  of the distribution functions
 // that will perform some sanity checking  post  facto.  All  the
 // distribution functions get run by way of this wrapper.
-index_lists wrapper( size_t             threads,
-                     files_range const& files,
-                     distributor_t      func ) {
+index_lists wrapper( size_t               threads,
+                     files_range const&   files,
+                     distributor_t const& func ) {
     // Call the actual distribution function.
-    vector<vector<uint64_t>> thread_idxs = func( threads, files );
+    index_lists thread_idxs = func( threads, files );
+    // There must be one list per thread.
+    FAIL_( thread_idxs.size() != threads );
     // Now a sanity check to make sure we got pricisely the right
     // number of files.
     size_t count = 0;
@@ -45,22 +77,107 @@ index_lists wrapper( size_t             threads,
         count += ti.size();
     FAIL_( count != files.size() );
     // Another sanity check to make sure that each index  appears
-    // only once both within a  single  thread and across threads.
-    set<uint64_t> idxs;
+    // only once both within a  single  thread and across threads,
+    // and that it is one of the files we were given. Since the
+    // counts match, this means every file has been assigned. The
+    // indices are dense (they are positions in the archive) so we
+    // track them with bitmaps, which for millions of entries is
+    // far cheaper than a tree of them.
+    uint64_t limit = 0;
+    for( auto const& zs : files )
+        limit = max( limit, zs.index()+1 );
+    vector<bool> given( limit ), seen( limit );
+    for( auto const& zs : files )
+        given[zs.index()] = true;
     for( auto const& ti : thread_idxs ) {
         for( uint64_t idx : ti ) {
-            FAIL_( has_key( idxs, idx ) );
-            idxs.insert( idx );
+            FAIL( idx >= limit || !given[idx],
+                "strategy assigned unknown entry " << idx );
+            FAIL_( seen[idx] );
+            seen[idx] = true;
         }
     }
     return thread_idxs;
 }
 
+// Look up a built-in strategy or load one from a plugin.
+distributor_t find_strategy( string const& name ) {
+    string const prefix( PLUGIN_PREFIX );
+    if( name.compare( 0, prefix.size(), prefix ) != 0 ) {
+        FAIL( !has_key( distribute, name ),
+            "strategy " << name << " is invalid." );
+        return distribute[name];
+    }
+    distributor_t func = load_plugin_strategy(
+        name.substr( prefix.size() ) );
+    return [func]( size_t threads, files_range const& files ) {
+        return wrapper( threads, files, func );
+    };
+}
+
 /****************************************************************
 * The functions below will take a number of threads and a list of
 * zip  entries  and  will  distribute them according to the given
 * strategy.
+*****************************************************************
+* Archives can have millions of entries, so the strategies  work
+* on arrays of positions into `files` (and of  whatever  per-entry
+* keys they need, computed up front in parallel) rather than  on
+* copies of the ZipStats, and they use the number of threads that
+* they are distributing to for their own sorting and grouping.
 ****************************************************************/
+namespace {
+
+// Positions into `files`.
+using positions = vector<uint32_t>;
+
+// Fill a vector with func( zs ) for each entry, in parallel.
+template<typename FuncT>
+auto per_entry( size_t threads, files_range const& files, FuncT func )
+    -> vector<decltype( func( *files.begin() ) )> {
+    vector<decltype( func( *files.begin() ) )> res( files.size() );
+    auto first = files.begin();
+    parallel_chunks( files.size(), threads,
+        [&]( size_t, size_t begin, size_t end ){
+            for( size_t i = begin; i < end; ++i )
+                res[i] = func( first[i] );
+        } );
+    return res;
+}
+
+// The positions 0, 1, ..., n-1.
+positions identity( size_t n ) {
+    FAIL( n > numeric_limits<uint32_t>::max(),
+        "too many entries to distribute: " << n );
+    positions res( n );
+    for( size_t i = 0; i < n; ++i )
+        res[i] = uint32_t( i );
+    return res;
+}
+
+// Assign items, taken in the given order, each to  the  thread
+// with the smallest running total of weight so far (the lowest
+// numbered one in a tie), and return that thread for each  item.
+// A heap keeps this at O(log threads) per item.
+vector<uint32_t> greedy( size_t                  threads,
+                         positions const&        order,
+                         vector<uint64_t> const& weight ) {
+    using slot = pair<uint64_t, uint32_t>; // total, thread
+    priority_queue<slot, vector<slot>, greater<slot>> heap;
+    for( size_t t = 0; t < threads; ++t )
+        heap.push( slot( 0, uint32_t( t ) ) );
+    vector<uint32_t> where( weight.size() );
+    for( auto i : order ) {
+        slot s = heap.top();
+        heap.pop();
+        where[i] = s.second;
+        s.first += weight[i];
+        heap.push( s );
+    }
+    return where;
+}
+
+} // anon namespace
 
 // The  "cyclic"  strategy will first sort the files by path name,
 // then will iterate through the sorted list while cycling
@@ -69,7 +186,9 @@ index_lists wrapper( size_t             threads,
 // thread, the Nth file to the (N % threads) thread.
 index_lists distribution_cyclic( size_t             threads,
                                  files_range const& files ) {
-    vector<vector<uint64_t>> thread_idxs( threads );
+    index_lists thread_idxs( threads );
+    for( auto& ti : thread_idxs )
+        ti.reserve( files.size()/threads + 1 );
     size_t count = 0;
     for( auto& zs : files )
         thread_idxs[count++ % threads].push_back( zs.index() );
@@ -86,40 +205,47 @@ STRATEGY( cyclic ) // Register this strategy
 // go  to  the  first  thread  and  the second half to the second.
 index_lists distribution_sliced( size_t             threads,
                                  files_range const& files ) {
-    // First we copy the zip stats and sort them  by  name.  Typi-
-    // cally they will already be sorted, but just in case
-    // they're  not,  we do it here. This is important because we
-    // want to minimize the  number  of  folders  whose files are
-    // split among multiple threads.
-    vector<ZipStat> stats( files.begin(), files.end() );
-    auto by_name = []( ZipStat const& l, ZipStat const& r ) {
-        return l.name() < r.name();
+    // First we sort the files by name. Typically they will  al-
+    // ready be sorted (which is checked  first  since  it  is  far
+    // cheaper), but just in case they're not, we do it here. This
+    // is  important  because we want to minimize  the  number  of
+    // folders whose files are split among multiple threads.
+    auto names = per_entry( threads, files, []( ZipStat const& zs ) {
+        return zs.name_data();
+    } );
+    auto by_name = [&]( uint32_t l, uint32_t r ) {
+        return strcmp( names[l], names[r] ) < 0;
     };
-    sort( stats.begin(), stats.end(), by_name );
+    positions order = identity( files.size() );
+    if( !is_sorted( order.begin(), order.end(), by_name ) )
+        parallel_sort( order, threads, by_name );
     // Now calculate how many files  we  can  give to each thread.
     // Each thread is given an equal number of files, minus a few
     // (<  threads)  that are residual at the end. These residual
     // ones  will  be distributed as in the cyclic strategy since
     // there are so few of them that it doesn't really matter how
     // they're distributed.
-    vector<vector<uint64_t>> thread_idxs( threads );
-    size_t chunk = max( stats.size()/threads, size_t( 1 ) );
-    size_t residual   = stats.size() % threads;
-    size_t sliced_end = stats.size() - residual;
+    index_lists thread_idxs( threads );
+    size_t chunk = max( order.size()/threads, size_t( 1 ) );
+    size_t residual   = order.size() % threads;
+    size_t sliced_end = order.size() - residual;
     FAIL_( chunk < 1 );
-    FAIL_( chunk > stats.size() );
+    FAIL_( chunk > order.size() );
     FAIL_( residual > threads );
-    FAIL_( sliced_end > stats.size() );
+    FAIL_( sliced_end > order.size() );
+    for( auto& ti : thread_idxs )
+        ti.reserve( chunk+1 );
     // Now proceed to distribute to the threads.
+    auto first = files.begin();
     size_t count = 0;
-    for( auto const& zs : stats ) {
+    for( auto i : order ) {
         // This  branch will be true most of the time. It will be
         // false at the very end  of  the  range  when we hit the
         // residual items.
         size_t where = (count < sliced_end) ? count / chunk
                                             : count % threads;
         FAIL_( where >= threads );
-        thread_idxs[where].push_back( zs.index() );
+        thread_idxs[where].push_back( first[i].index() );
         ++count;
     }
     return thread_idxs;
@@ -128,6 +254,30 @@ STRATEGY( sliced ) // Register this strategy
 
 // ______________________________________________________________
 
+// This function, which is a template for a strategy, will  sort
+// the files in descending order by the given metric and then give
+// each one in turn to the thread with  the  smallest  total  so
+// far. Distributing the large files first makes it more  likely
+// that in the end we will be able to balance  them  out  using
+// the small ones. The signature of MetricFunc is:
+// uint64_t( ZipStat const& ).
+template<typename MetricFunc>
+index_lists by_weight( size_t             threads,
+                       files_range const& files,
+                       MetricFunc         metric ) {
+    vector<uint64_t> weight = per_entry( threads, files, metric );
+    positions order = identity( files.size() );
+    parallel_sort( order, threads, [&]( uint32_t l, uint32_t r ) {
+        return weight[l] > weight[r];
+    } );
+    vector<uint32_t> where = greedy( threads, order, weight );
+    index_lists thread_idxs( threads );
+    auto first = files.begin();
+    for( auto i : order )
+        thread_idxs[where[i]].push_back( first[i].index() );
+    return thread_idxs;
+}
+
 // The  "bytes"  strategy  will try to assign each thread roughly
 // the  same number of total bytes to write. However, in practice
 // the  number  bytes  written by each thread will not be exactly
@@ -135,33 +285,62 @@ STRATEGY( sliced ) // Register this strategy
 // thread in its entirety.
 index_lists distribution_bytes(  size_t             threads,
                                  files_range const& files ) {
-    // First we copy the zip  stats  and sort in descending order
-    // by size. This is because, if we distribute the large files
-    // first,  it  is more likely in the end that we will be able
-    // to balance them out using the small ones.
-    vector<ZipStat> stats( files.begin(), files.end() );
-    auto by_size = []( ZipStat const& l, ZipStat const& r ) {
-        return l.size() > r.size();
-    };
-    sort( stats.begin(), stats.end(), by_size );
-    vector<vector<uint64_t>> thread_idxs( threads );
-    // These will hold the  running  sums of total (uncompressed)
-    // bytes that each thread will have to extract. We  want  ide-
-    // ally (in this strategy at least) to balance them.
-    vector<uint64_t> totals( threads, 0 );
-    for( auto const& zs : stats ) {
-        auto where = min_element( totals.begin(), totals.end() )
-                   - totals.begin();
-        FAIL_( where < 0 || size_t( where ) >= threads );
-        thread_idxs[where].push_back( zs.index() );
-        totals[where] += zs.size();
-    }
-    return thread_idxs;
+    return by_weight( threads, files, []( ZipStat const& zs ) {
+        return uint64_t( zs.size() );
+    } );
 }
 STRATEGY( bytes ) // Register this strategy
 
 // ______________________________________________________________
 
+// The "cost" strategy is like  "bytes"  except  that  each  file's
+// size is weighted by the relative cost of decompressing its com-
+// pression method (see method_cost).  For archives that  use  a
+// single method this gives the same result as "bytes".
+index_lists distribution_cost(   size_t             threads,
+                                 files_range const& files ) {
+    return by_weight( threads, files, []( ZipStat const& zs ) {
+        return entry_cost( zs );
+    } );
+}
+STRATEGY( cost ) // Register this strategy
+
+// ______________________________________________________________
+
+namespace {
+
+// The folder part of an entry's name (everything up to the last
+// slash), identified without copying it, along with its hash.
+struct FolderKey {
+    char const* name;
+    size_t      len;
+    uint64_t    hash;
+
+    bool operator==( FolderKey const& rhs ) const {
+        return len == rhs.len && !memcmp( name, rhs.name, len );
+    }
+};
+
+struct FolderHash {
+    size_t operator()( FolderKey const& k ) const {
+        return size_t( k.hash );
+    }
+};
+
+FolderKey folder_key( ZipStat const& zs ) {
+    FolderKey k{ zs.name_data(), 0, 0 };
+    if( char const* slash = strrchr( k.name, '/' ) )
+        k.len = size_t( slash - k.name );
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for( size_t i = 0; i < k.len; ++i )
+        h = (h ^ uint8_t( k.name[i] )) * 1099511628211ULL;
+    k.hash = h;
+    return k;
+}
+
+} // anon namespace
+
 // This function, which is a template for a  strategy,  will  com-
 // pile a list of all folders along with metrics computed on each
 // folder, which are  calculated  using  the  metric function sup-
@@ -182,51 +361,102 @@ template<typename MetricFunc>
 index_lists by_folder( size_t             threads,
                        files_range const& files,
                        MetricFunc         metric ) {
-    // This structure will hold information about a single
-    // folder: this includes the  metric  and  list of indexes of
-    // files inside this folder. Note, it is important  that  the
-    // metric  be  proportional to runtime to the greatest extent
-    // possible.
-    struct Data {
-        Data() : m_metric( 0 ) {}
-        // Add a new file and update the metric.
-        void add( ZipStat const& zs, uint64_t delta ) {
-            m_idxs.push_back( zs.index() );
-            m_metric += delta;
-        }
-        // These  are  indexes  of  files that are in this folder.
-        vector<uint64_t> m_idxs;
-        uint64_t         m_metric;
-    };
-    // First  we  need  to  aggregate  files that are in the same
-    // folder.
-    map<FilePath, Data> folder_map;
-    for( auto const& zs : files )
-        folder_map[zs.folder()].add( zs, metric( zs ) );
-    // Now  copy  all  the Data objects into a vector for sorting.
-    vector<Data> folder_infos;
-    for( auto p : folder_map )
-        folder_infos.push_back( p.second );
-    // Sort that in descending order (it is important  that  they
-    // are descending and not ascending) by the metric.
-    auto by_metric = []( Data const& l, Data const& r ) {
-        return l.m_metric > r.m_metric;
+    size_t n = files.size();
+    positions all = identity( n );
+    // Compute the folder key and metric of each file in parallel.
+    auto keys   = per_entry( threads, files, folder_key );
+    auto deltas = per_entry( threads, files, metric );
+    // Now we need to aggregate files that are in the same folder.
+    // The folders are split into one shard per thread by hash and
+    // each thread groups its own shard in a hash table, numbering
+    // the folders it finds and totalling their metrics.  The files
+    // are first bucketed by shard in one (stable) pass, so that each
+    // thread only goes over its own files.
+    size_t           shards = threads;
+    vector<size_t>   bucket( shards+1, 0 );
+    for( auto i : all )
+        bucket[keys[i].hash % shards + 1]++;
+    for( size_t s = 0; s < shards; ++s )
+        bucket[s+1] += bucket[s];
+    positions by_shard( n );
+    {
+        vector<size_t> next( bucket.begin(), bucket.end()-1 );
+        for( auto i : all )
+            by_shard[next[keys[i].hash % shards]++] = i;
+    }
+    struct Shard {
+        vector<uint64_t> metrics;   // per folder
+        vector<uint32_t> firsts;    // first file of each folder
+        vector<uint32_t> counts;    // files in each folder
     };
-    sort( folder_infos.begin(), folder_infos.end(), by_metric );
+    vector<Shard>    shard( shards );
+    vector<uint32_t> local( n ); // folder number within shard
+    parallel_chunks( shards, shards, [&]( size_t s, size_t, size_t ){
+        unordered_map<FolderKey, uint32_t, FolderHash> ids;
+        Shard& sh = shard[s];
+        for( size_t k = bucket[s]; k < bucket[s+1]; ++k ) {
+            auto i = by_shard[k];
+            auto ins = ids.insert( make_pair( keys[i],
+                                   uint32_t( sh.metrics.size() ) ) );
+            if( ins.second ) {
+                sh.metrics.push_back( 0 );
+                sh.firsts.push_back( i );
+                sh.counts.push_back( 0 );
+            }
+            uint32_t f = ins.first->second;
+            sh.metrics[f] += deltas[i];
+            sh.counts[f]++;
+            local[i] = f;
+        }
+    } );
+    // Number the folders globally and sort them in descending order
+    // (it is important that they are descending and not ascending)
+    // by the metric. Ties are broken by the position of the first
+    // file so that the result does not depend on the hashing.
+    vector<size_t> offset( shards+1, 0 );
+    for( size_t s = 0; s < shards; ++s )
+        offset[s+1] = offset[s] + shard[s].metrics.size();
+    size_t folders = offset[shards];
+    vector<uint64_t> metrics( folders );
+    vector<uint32_t> firsts( folders ), counts( folders );
+    for( size_t s = 0; s < shards; ++s ) {
+        copy( shard[s].metrics.begin(), shard[s].metrics.end(),
+              metrics.begin()+offset[s] );
+        copy( shard[s].firsts.begin(), shard[s].firsts.end(),
+              firsts.begin()+offset[s] );
+        copy( shard[s].counts.begin(), shard[s].counts.end(),
+              counts.begin()+offset[s] );
+    }
+    positions order = identity( folders );
+    parallel_sort( order, threads, [&]( uint32_t l, uint32_t r ) {
+        return metrics[l] != metrics[r] ? metrics[l] > metrics[r]
+                                        : firsts[l] < firsts[r];
+    } );
     // At  this  point  we  have a list of folders along with the
     // total metric of each folder,  so  now just do an equitable
     // distribution of folders among the threads.
-    vector<vector<uint64_t>> thread_idxs( threads );
-    vector<uint64_t>         metrics( threads );
-
-    for( auto const& info : folder_infos ) {
-        auto idx = min_element( metrics.begin(), metrics.end() )
-                 - metrics.begin();
-        FAIL_( idx < 0 || size_t( idx ) >= threads );
-        auto& ti = thread_idxs[idx];
-        // Give  all  the indexes from this folder to this thread.
-        ti.insert( ti.end(), info.m_idxs.begin(), info.m_idxs.end() );
-        metrics[idx] += info.m_metric;
+    vector<uint32_t> where = greedy( threads, order, metrics );
+    // Lay the files out grouped by folder,  in  the  order  just
+    // computed, keeping archive order within each folder. Then all
+    // the files of a folder go to that folder's thread.
+    vector<size_t> start( folders );
+    size_t pos = 0;
+    for( auto f : order ) {
+        start[f] = pos;
+        pos += counts[f];
+    }
+    positions grouped( n );
+    for( auto i : all ) {
+        auto f = uint32_t( offset[keys[i].hash % shards] + local[i] );
+        grouped[start[f]++] = i;
+    }
+    index_lists thread_idxs( threads );
+    auto first = files.begin();
+    pos = 0;
+    for( auto f : order ) {
+        auto& ti = thread_idxs[where[f]];
+        for( size_t k = 0; k < counts[f]; ++k )
+            ti.push_back( first[grouped[pos++]].index() );
     }
     // At  this  point  the  files in a given folder should be as-
     // signed exclusively to a single thread and the  metric  for
@@ -243,7 +473,7 @@ index_lists by_folder( size_t             threads,
 index_lists distribution_folder_files( size_t             threads,
                                        files_range const& files ) {
     return by_folder( threads, files, []( ZipStat const& ) {
-        return 1;
+        return uint64_t( 1 );
     } );
 }
 STRATEGY( folder_files ) // Register this strategy
@@ -257,7 +487,20 @@ STRATEGY( folder_files ) // Register this strategy
 index_lists distribution_folder_bytes( size_t             threads,
                                        files_range const& files ) {
     return by_folder( threads, files, []( ZipStat const& zs ) {
-        return zs.size();
+        return uint64_t( zs.size() );
     } );
 }
 STRATEGY( folder_bytes ) // Register this strategy
+
+// ______________________________________________________________
+
+// This is a "by_folder" strategy  whose  metric  for a given zip
+// entry is its size weighted by the cost of its compression  me-
+// thod, i.e., the folder equivalent of the "cost" strategy.
+index_lists distribution_folder_cost( size_t             threads,
+                                      files_range const& files ) {
+    return by_folder( threads, files, []( ZipStat const& zs ) {
+        return entry_cost( zs );
+    } );
+}
+STRATEGY( folder_cost ) // Register this strategy
@@ -4,18 +4,47 @@
 ****************************************************************/
 #pragma once
 
+#include "memory.hpp"
 #include "utils.hpp"
 #include "zip.hpp"
 
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
 
-using index_lists = std::vector<std::vector<uint64_t>>;
+// The entries assigned to one thread, and to each of the threads.
+using index_list  = std::vector<uint64_t, CountingAllocator<uint64_t,
+                                          MemTag::distribution>>;
+using index_lists = std::vector<index_list>;
 using files_range = Range<std::vector<ZipStat>::iterator>;
-typedef index_lists (*distributor_t)( size_t, files_range const& );
+using distributor_t =
+    std::function<index_lists( size_t, files_range const& )>;
 
 // This  is  the  global dictionary that will hold a mapping from
-// strategy  name to function pointer. When called, that function
-// will distribute zip entries  among  a  given number of threads.
+// strategy  name to function. When called, that  function  will
+// distribute zip entries among a given number of threads.
 extern std::map<std::string, distributor_t> distribute;
+
+// Look up a strategy by name. This is either one of the built-in
+// strategies in `distribute`, or "plugin:<path>[:<function>]" to
+// load one from a shared object (see strategy_abi.h). Either way
+// the result is wrapped with the same sanity checking. Will throw
+// if the strategy cannot be found.
+distributor_t find_strategy( std::string const& name );
+
+// The relative cost of decompressing (and writing) one byte  of
+// data compressed with the given method (ZIP_CM_*), normalized so
+// that deflate is 1.0. Different methods decompress at very dif-
+// ferent speeds (bzip2 and lzma are several times  slower  than
+// deflate, zstd is faster and stored data needs no  decompression
+// at all), so balancing the threads purely on bytes can be  far
+// off when the archive mixes methods. These are rough estimates
+// of the relative speeds of the usual libraries and have not been
+// measured here; the per method breakdown in the summary (-g) shows
+// the actual times for an archive.
+double method_cost( uint16_t method );
+
+// The estimated cost of extracting an entry: its  uncompressed
+// size weighted by method_cost (plus a surcharge if encrypted).
+uint64_t entry_cost( ZipStat const& zs );
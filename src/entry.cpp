@@ -43,6 +43,7 @@ int main( int argc, char* argv[] )
                              argv,
                              opt_all,
                              opt_val,
+                             usage::long_options,
                              opt_result ) )
             exit( 1 );
 
@@ -8,9 +8,13 @@
 #include "utils.hpp"
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <limits>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 
 using namespace std;
 
@@ -19,6 +23,7 @@ using namespace std;
 ****************************************************************/
 #ifndef POSIX
 #   include <windows.h>
+#   include <io.h>
 #endif
 
 // Apparently these work on Windows as well as posix.
@@ -32,6 +37,12 @@ using namespace std;
 #   include <sys/utime.h>
 #endif
 
+// For listing and removing folders
+#ifdef POSIX
+#   include <dirent.h>
+#   include <unistd.h>
+#endif
+
 // Someone is defining this somewhere and it's f'ing things up.
 #undef max
 
@@ -80,13 +91,80 @@ void create_folder( char const* path ) {
 #endif
 }
 
+/* Remove an empty folder. */
+void remove_folder( char const* path ) {
+#ifdef POSIX
+    FAIL( rmdir( path ), "failed to remove folder " << path );
+#else
+    FAIL( !RemoveDirectory( path ), "failed to remove folder " << path );
+#endif
+}
+
+/* Read the immediate children of the folder at `root`/`rel`  (rel
+ * is empty or ends with a slash) and append them to `out` with
+ * paths relative to `root`. Symbolic links and anything that  is
+ * not a regular file or folder are skipped. */
+void list_folder( string const& root, string const& rel,
+                  vector<TreeEntry>& out ) {
+    string folder = rel.empty() ? root : root + "/" + rel;
+#ifdef POSIX
+    DIR* dir = opendir( folder.c_str() );
+    FAIL( !dir, "failed to open folder " << folder );
+    // !! Should not throw until closedir is called
+    bool ok = true;
+    while( struct dirent* d = readdir( dir ) ) {
+        string name( d->d_name );
+        if( name == "." || name == ".." )
+            continue;
+        struct stat buf;
+        if( lstat( (folder + "/" + name).c_str(), &buf ) != 0 ) {
+            ok = false;
+            break;
+        }
+        bool is_folder = S_ISDIR( buf.st_mode );
+        if( !is_folder && !S_ISREG( buf.st_mode ) )
+            continue;
+        out.push_back( TreeEntry{
+            rel + name + ( is_folder ? "/" : "" ),
+            is_folder ? 0 : uint64_t( buf.st_size ),
+            buf.st_mtime, is_folder } );
+    }
+    // !! Close immediately to avoid resource leak.
+    closedir( dir );
+    FAIL( !ok, "failed to stat an entry in folder " << folder );
+#else
+    WIN32_FIND_DATA fd;
+    HANDLE h = FindFirstFile( (folder + "\\*").c_str(), &fd );
+    FAIL( h == INVALID_HANDLE_VALUE,
+        "failed to open folder " << folder );
+    do {
+        string name( fd.cFileName );
+        if( name == "." || name == ".." )
+            continue;
+        if( fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT )
+            continue;
+        bool is_folder =
+            ( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) != 0;
+        // FILETIME is in 100ns units since 1601-01-01.
+        uint64_t ft = ( uint64_t( fd.ftLastWriteTime.dwHighDateTime )
+                        << 32 ) | fd.ftLastWriteTime.dwLowDateTime;
+        out.push_back( TreeEntry{
+            rel + name + ( is_folder ? "/" : "" ),
+            is_folder ? 0 : ( uint64_t( fd.nFileSizeHigh ) << 32 |
+                              fd.nFileSizeLow ),
+            time_t( ft/10000000 - 11644473600ULL ), is_folder } );
+    } while( FindNextFile( h, &fd ) );
+    FindClose( h );
+#endif
+}
+
 } // namespace
 
 /****************************************************************
 * File
 ****************************************************************/
 File::File( string const& s, char const* m ) : mode( m ) {
-    FAIL( mode != "rb" && mode != "wb",
+    FAIL( mode != "rb" && mode != "wb" && mode != "ab",
         "unrecognized mode " << mode );
     p = fopen( s.c_str(), m );
     FAIL( !p, "failed to open " << s << " with mode " << mode );
@@ -110,19 +188,58 @@ Buffer File::read() {
     return buffer;
 }
 
+// Will read up to buffer.size() bytes from the current file posi-
+// tion into the buffer and return the number of bytes read.
+uint64_t File::read_some( Buffer& buffer ) {
+    FAIL( mode != "rb", "attempted read in mode " << mode );
+    size_t length_read = fread( buffer.get(), 1, buffer.size(), p );
+    FAIL_( length_read < buffer.size() && ferror( p ) );
+    return length_read;
+}
+
+void File::seek( uint64_t offset ) {
+    FAIL( OS_SWITCH( fseeko, _fseeki64 )( p, OS_SWITCH( off_t, __int64 )(
+        offset ), SEEK_SET ) != 0, "failed to seek to " << offset );
+}
+
 // Will write the entire contents of buffer to file starting from
 // the  file's current position. Will throw if not all bytes writ-
 // ten.
 void File::write( Buffer const& buffer, uint64_t count ) {
-    FAIL( mode != "wb", "attempted write in mode " << mode );
     FAIL_( count > buffer.size() );
+    write( buffer.get(), count );
+}
+
+// Will write `count` bytes starting at `data` to the file at the
+// file's current position. Will throw if not all bytes written.
+void File::write( void const* data, uint64_t count ) {
+    FAIL( mode == "rb", "attempted write in mode " << mode );
     // Make sure that count is not too large since we're going to
     // cast it down to a size_t which may be 32 bit.
     FAIL_( count > numeric_limits<size_t>::max() );
-    size_t written = fwrite( buffer.get(), 1, size_t( count ), p );
+    size_t written = fwrite( data, 1, size_t( count ), p );
     FAIL_( written != count );
 }
 
+// Hand buffered data over to the OS.
+void File::flush() {
+    FAIL( mode == "rb", "attempted flush in mode " << mode );
+    FAIL( fflush( p ) != 0, "failed to flush file" );
+}
+
+// Flush, and then wait for the OS to write  the  data  to  disk.
+// Only the data matters here, so fdatasync where there is one.
+void File::sync() {
+    flush();
+#if defined( POSIX ) && defined( _POSIX_SYNCHRONIZED_IO ) && \
+    _POSIX_SYNCHRONIZED_IO > 0 && !defined( __APPLE__ )
+    FAIL( fdatasync( fileno( p ) ) != 0, "failed to sync file" );
+#else
+    FAIL( OS_SWITCH( fsync, _commit )( OS_SWITCH( fileno, _fileno )( p ) )
+          != 0, "failed to sync file" );
+#endif
+}
+
 /****************************************************************
 * FilePath class
 *****************************************************************
@@ -323,6 +440,62 @@ void set_timestamp( string const& path, time_t time ) {
     FAIL( res == -1, "failed to set timestamp on " << path );
 }
 
+// Create a folder and its parents given a plain path. Each prefix
+// ending just before a slash is created if it does not exist.
+void make_folders( string const& path ) {
+    for( size_t pos = 0; pos != string::npos; ) {
+        pos = path.find_first_of( "/\\", pos+1 );
+        string prefix = path.substr( 0, pos );
+        if( prefix.empty() || ( prefix.size() == 2 && prefix[1] == ':' ) )
+            continue;
+        Stat st = stat( prefix.c_str() );
+        if( !st.exists )
+            create_folder( prefix.c_str() );
+        else
+            FAIL( !st.is_folder, prefix << " is not a folder" );
+    }
+}
+
+// Size of a file, or no value if it does not exist.
+Optional<uint64_t> file_size( string const& path ) {
+    struct OS_SWITCH( stat, _stat64 ) buf;
+    auto ret = ::OS_SWITCH( stat, _stat64 )( path.c_str(), &buf );
+    if( ret != 0 ) {
+        FAIL( errno != ENOENT, "failed to stat " << path );
+        return Optional<uint64_t>();
+    }
+    return Optional<uint64_t>( uint64_t( buf.st_size ) );
+}
+
+// Delete a file if it exists.
+void remove_file( string const& path ) {
+    if( ::remove( path.c_str() ) != 0 )
+        FAIL( errno != ENOENT, "failed to remove " << path );
+}
+
+void remove_tree( string const& root, size_t jobs ) {
+    if( !stat( root.c_str() ).exists )
+        return;
+    vector<string> files, folders;
+    for( auto& e : walk_tree( root, jobs ) )
+        ( e.is_folder ? folders : files ).push_back(
+            root + "/" + e.path );
+    parallel_chunks( files.size(), jobs,
+        [&]( size_t, size_t begin, size_t end ){
+            for( size_t i = begin; i < end; ++i )
+                remove_file( files[i] );
+        } );
+    // A folder's path is longer than those of its parents, so this
+    // removes each folder after everything in it.
+    sort( folders.begin(), folders.end(),
+        []( string const& l, string const& r ){
+            return l.size() > r.size();
+        } );
+    for( auto const& f : folders )
+        remove_folder( f.c_str() );
+    remove_folder( root.c_str() );
+}
+
 // Rename a file. Will  detect  when  arguments  are equal and do
 // nothing. Will  replace  the  destination  file  if  it  exists.
 void rename_file( string const& path, string const& path_new ) {
@@ -343,3 +516,65 @@ void rename_file( string const& path, string const& path_new ) {
     FAIL( func( path.c_str(), path_new.c_str() ),
         "error renaming " << path << " to " << path_new );
 }
+
+/* Recursively list everything under `root` using multiple threads.
+ * There is a shared queue of folders waiting to be listed. Each
+ * thread pops a folder, lists it, and pushes any subfolders back
+ * onto the queue. The walk is over when the queue is empty and no
+ * thread is in the middle of listing a folder (since that  thread
+ * might yet push more). */
+vector<TreeEntry> walk_tree( string const& root, size_t jobs ) {
+    FAIL_( jobs < 1 );
+    Stat info( stat( root.c_str() ) );
+    FAIL( !info.exists || !info.is_folder,
+        root << " is not a folder" );
+
+    mutex              mtx;
+    condition_variable cv;
+    deque<string>      queue( 1, string() );
+    size_t             busy   = 0;
+    bool               failed = false;
+    vector<TreeEntry>  result;
+
+    auto worker = [&]{
+        vector<TreeEntry> found;
+        TRY
+        unique_lock<mutex> lock( mtx );
+        while( true ) {
+            cv.wait( lock, [&]{
+                return failed || !queue.empty() || busy == 0; } );
+            if( failed || queue.empty() )
+                break;
+            string rel = move( queue.front() );
+            queue.pop_front();
+            ++busy;
+            lock.unlock();
+            found.clear();
+            // If this throws then `busy`  stays  nonzero, but that
+            // is ok since we also set `failed` below which  releases
+            // the other threads.
+            list_folder( root, rel, found );
+            lock.lock();
+            --busy;
+            for( auto& e : found ) {
+                if( e.is_folder )
+                    queue.push_back( e.path );
+                result.push_back( move( e ) );
+            }
+            cv.notify_all();
+        }
+        return;
+        CATCH_ALL
+        lock_guard<mutex> lock( mtx );
+        failed = true;
+        cv.notify_all();
+    };
+
+    vector<thread> threads;
+    for( size_t i = 0; i < jobs; ++i )
+        threads.emplace_back( worker );
+    for( auto& t : threads )
+        t.join();
+    FAIL( failed, "failed to walk folder " << root );
+    return result;
+}
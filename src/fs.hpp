@@ -17,6 +17,7 @@ class File : public Handle<FILE, File> {
     std::string mode;
 
 public:
+    // The mode is one of "rb", "wb" or "ab" (append).
     File( std::string const& s, char const* mode );
 
     void destroyer();
@@ -25,10 +26,29 @@ public:
     // File position and  will  leave  the  file  position at EOF.
     Buffer read();
 
+    // Will read up to buffer.size() bytes from the current  file
+    // position  into  the buffer and return the number of bytes
+    // read, which is less than that only at EOF.
+    uint64_t read_some( Buffer& buffer );
+
+    // Move the file position to `offset` bytes from the start.
+    void seek( uint64_t offset );
+
     // Will  write  `count` bytes of buffer to file starting from
     // the file's current position. Will  throw  if not all bytes
     // written.
     void write( Buffer const& buffer, uint64_t count );
+
+    // Same as above but takes a raw pointer to the data.
+    void write( void const* data, uint64_t count );
+
+    // Hand anything buffered by the C runtime over to the OS, so
+    // that it survives the process being killed.
+    void flush();
+
+    // Flush, and then have the OS write the file's data through to
+    // the disk, so that it survives the machine going down too.
+    void sync();
 };
 
 /****************************************************************
@@ -132,6 +152,11 @@ OptPairStr split_ext( std::string const& s );
 // mkdirs_p below as it will be more efficient.
 void mkdir_p( FilePath const& path );
 
+// Like mkdir_p but takes a plain path, which (unlike a FilePath)
+// may be absolute. This is for folders given by the user for our
+// own use, such as the journal, rather than for extraction.
+void make_folders( std::string const& path );
+
 // Has the effect of calling mkdir_p on each of the  elements  in
 // the  list. Implementation is efficient in that it will use a a
 // cache to avoid redundant calls to the filesystem.
@@ -149,7 +174,37 @@ void mkdirs_p( std::vector<FilePath> const& paths );
 // files  that  are  zipped  and  unzipped in different timezones.
 void set_timestamp( std::string const& path, time_t time );
 
+// Size of the file at the given path, or no value if there is  no
+// such file. Will throw on any other error.
+Optional<uint64_t> file_size( std::string const& path );
+
+// Delete a file. Does nothing if it does not exist.
+void remove_file( std::string const& path );
+
+// Delete a folder and everything in it, deleting the files  with
+// `jobs` threads. Does nothing if it does not exist. Will throw if
+// anything cannot be deleted.
+void remove_tree( std::string const& root, size_t jobs );
+
 // Rename a file. Will  detect  when  arguments  are equal and do
 // nothing.
 void rename_file( std::string const& path,
                   std::string const& path_new );
+
+// Information about one file or folder found by walk_tree.
+struct TreeEntry {
+    // Path relative to the root of the walk, with forward slashes.
+    // Folder paths end with a forward slash.
+    std::string path;
+    uint64_t    size;
+    time_t      mtime;
+    bool        is_folder;
+};
+
+// Recursively  list all regular files and folders under `root`
+// (not including `root` itself) using `jobs` threads  which  pull
+// folders  from  a  shared  queue. Symbolic links and special
+// files are skipped. The order of the  result  depends  on  timing
+// and so is not deterministic. Will throw on any error.
+std::vector<TreeEntry> walk_tree( std::string const& root,
+                                  size_t             jobs );
@@ -0,0 +1,355 @@
+/****************************************************************
+* Local performance history.
+****************************************************************/
+#include "config.hpp"
+#include "directory.hpp"
+#include "fs.hpp"
+#include "history.hpp"
+#include "macros.hpp"
+#include "profile.hpp"
+#include "sys.hpp"
+#include "version.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <zip.h>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+char const* const HEADER = "time,host,revision,libzip,archive,"
+                           "fingerprint,settings,files,bytes,ms,summary";
+
+string history_file() {
+    string folder = profile_folder();
+    return folder.empty() ? "" : folder + "/history.csv";
+}
+
+/****************************************************************
+* Statistics
+****************************************************************/
+// Continued fraction for the incomplete beta function (modified
+// Lentz's method).
+double beta_cf( double a, double b, double x ) {
+    double const tiny = 1e-300;
+    auto clamp = [=]( double v ){ return fabs( v ) < tiny ? tiny : v; };
+    double c = 1, d = 1/clamp( 1 - (a+b)*x/(a+1) ), h = d;
+    for( int m = 1; m <= 300; ++m ) {
+        double aa = m*(b-m)*x / ((a+2*m-1)*(a+2*m));
+        d = 1/clamp( 1 + aa*d ); c = clamp( 1 + aa/c ); h *= d*c;
+        aa = -(a+m)*(a+b+m)*x / ((a+2*m)*(a+2*m+1));
+        d = 1/clamp( 1 + aa*d ); c = clamp( 1 + aa/c ); h *= d*c;
+        if( fabs( d*c - 1 ) < 1e-12 )
+            break;
+    }
+    return h;
+}
+
+// The regularized incomplete beta function I_x(a, b).
+double inc_beta( double a, double b, double x ) {
+    if( x <= 0 ) return 0;
+    if( x >= 1 ) return 1;
+    double front = exp( lgamma( a+b ) - lgamma( a ) - lgamma( b ) +
+                        a*log( x ) + b*log( 1-x ) );
+    if( x < (a+1)/(a+b+2) )
+        return front*beta_cf( a, b, x )/a;
+    return 1 - front*beta_cf( b, a, 1-x )/b;
+}
+
+// P(T > t) for Student's t distribution with df degrees of freedom.
+double t_upper( double t, double df ) {
+    double tail = 0.5*inc_beta( df/2, 0.5, df/(df + t*t) );
+    return t > 0 ? tail : 1 - tail;
+}
+
+// The wall times of a group of runs of one version.
+struct Group {
+    Group() : n( 0 ), mean( 0 ), var( 0 ) {}
+    Group( string v, vector<double> const& ms )
+        : version( v ), n( ms.size() ), mean( 0 ), var( 0 ) {
+        for( auto x : ms ) mean += x;
+        mean /= max<size_t>( n, 1 );
+        for( auto x : ms ) var += (x-mean)*(x-mean);
+        var /= max<size_t>( n, 2 ) - 1;
+    }
+    string version;
+    size_t n;
+    double mean;
+    double var;
+};
+
+// One sided p-value for the latest group being slower than the
+// baseline: Welch's t-test, or if there is only one latest  run,
+// the test of whether it falls outside of the baseline's spread.
+double p_slower( Group const& base, Group const& latest ) {
+    double se2, df;
+    if( latest.n > 1 ) {
+        double a = latest.var/latest.n, b = base.var/base.n;
+        se2 = a + b;
+        df  = se2*se2 / (a*a/(latest.n-1) + b*b/(base.n-1));
+    } else {
+        se2 = base.var*(1 + 1.0/base.n);
+        df  = double( base.n - 1 );
+    }
+    if( se2 <= 0 )
+        return latest.mean > base.mean ? 0 : 1;
+    return t_upper( (latest.mean - base.mean)/sqrt( se2 ), df );
+}
+
+void print_group( char const* label, Group const& g, bool json,
+                  ostream& out ) {
+    char buf[512];
+    double sd = sqrt( g.var );
+    if( json ) {
+        string v;
+        append_json_string( v, g.version.data(), g.version.size() );
+        snprintf( buf, sizeof( buf ), "\"%s\":{\"version\":%s,\"runs\":"
+            "%zu,\"mean_ms\":%.3f,\"sd_ms\":%.3f},", label, v.c_str(),
+            g.n, g.mean, sd );
+    } else
+        snprintf( buf, sizeof( buf ), "%-10s %zu run%s of %s, mean "
+            "%.1fms, sd %.1fms\n", label, g.n, g.n == 1 ? "" : "s",
+            g.version.c_str(), g.mean, sd );
+    out << buf;
+}
+
+} // anon namespace
+
+double p_slower( vector<double> const& base,
+                 vector<double> const& latest ) {
+    FAIL_( base.size() < 2 || latest.empty() );
+    return p_slower( Group( "base", base ), Group( "latest", latest ) );
+}
+
+string csv_field( string const& s ) {
+    if( s.find_first_of( ",\"\r\n" ) == string::npos )
+        return s;
+    string res = "\"";
+    for( char c : s ) {
+        if( c == '"' )
+            res += '"';
+        res += c;
+    }
+    return res + "\"";
+}
+
+bool csv_read( istream& in, vector<string>& fields ) {
+    fields.assign( 1, string() );
+    string line;
+    if( !getline( in, line ) )
+        return false;
+    bool quoted = false;
+    while( true ) {
+        for( size_t i = 0; i < line.size(); ++i ) {
+            char c = line[i];
+            if( quoted ) {
+                if( c != '"' )
+                    fields.back() += c;
+                else if( i+1 < line.size() && line[i+1] == '"' )
+                    fields.back() += line[++i];
+                else
+                    quoted = false;
+            } else if( c == '"' )
+                quoted = true;
+            else if( c == ',' )
+                fields.emplace_back();
+            else
+                fields.back() += c;
+        }
+        // A quoted field goes on to the next line, with the newline
+        // that getline took off put back. If the file ends first the
+        // record was torn, and is returned as far as it goes.
+        if( !quoted || !getline( in, line ) )
+            return true;
+        fields.back() += '\n';
+    }
+}
+
+string history_settings( size_t             jobs,
+                         string const&      strategy,
+                         size_t             chunk,
+                         UnzipMode          mode,
+                         ZipEngine          engine,
+                         InflatePlan const& plan ) {
+    ostringstream out;
+    out << "j=" << jobs << " d=" << strategy << " c=" << chunk
+        << " m=" << mode_name( mode );
+    if( engine == ZipEngine::native )
+        out << " e=native i=" << plan.describe();
+    else
+        out << " e=libzip";
+    return out.str();
+}
+
+string archive_fingerprint( string const& filename ) {
+    Directory dir = Directory::load( filename );
+    uLong crc = crc32( 0L, Z_NULL, 0 );
+    for( size_t i = 0; i < dir.size(); ++i ) {
+        // The sizes are hashed as written (little endian  on  the
+        // machines that we run on), which only has to be consistent
+        // on one host.
+        DirEntry const& e = dir[i];
+        crc = crc32( crc, (Bytef const*)dir.name_data( i ), e.name_len );
+        crc = crc32( crc, (Bytef const*)&e.size, sizeof( e.size ) );
+        crc = crc32( crc, (Bytef const*)&e.crc,  sizeof( e.crc  ) );
+    }
+    char buf[64];
+    snprintf( buf, sizeof( buf ), "%08lx-%zu", (unsigned long)crc,
+              dir.size() );
+    return buf;
+}
+
+void append_history( string const&       filename,
+                     string const&       settings,
+                     UnzipSummary const& us ) {
+    string path = history_file();
+    FAIL( path.empty(), "nowhere to save the history; please set "
+        "XDG_CACHE_HOME" );
+    make_folders( profile_folder() );
+    ostringstream summary;
+    print_json( summary, us );
+    string json = summary.str();
+    while( !json.empty() && json.back() == '\n' )
+        json.pop_back();
+
+    ostringstream line;
+    if( !file_size( path ) )
+        line << HEADER << endl;
+    line << time( nullptr )                           << ","
+         << csv_field( host_name() )                  << ","
+         << csv_field( P_UNZIP_REVISION )             << ","
+         << csv_field( zip_libzip_version() )         << ","
+         << csv_field( filename )                     << ","
+         << archive_fingerprint( filename )           << ","
+         << csv_field( settings )                     << ","
+         << us.files << "," << us.bytes               << ","
+         << us.watch.microseconds( "total" )/1000.0   << ","
+         << csv_field( json ) << endl;
+    // Each run is appended with one write so  that  concurrent  runs
+    // do not interleave their lines.
+    string text = line.str();
+    File f( path, "ab" );
+    f.write( text.data(), text.size() );
+}
+
+vector<HistoryRecord> load_history() {
+    vector<HistoryRecord> res;
+    string path = history_file();
+    if( path.empty() )
+        return res;
+    ifstream in( path );
+    vector<string> f;
+    while( csv_read( in, f ) ) {
+        // Skip the header and anything that we can't make out.
+        if( f.size() < 11 || f[0] == "time" )
+            continue;
+        HistoryRecord r;
+        try {
+            r.when        = to_uint<time_t>( f[0] );
+            r.files       = to_uint<size_t>( f[7] );
+            r.bytes       = to_uint<uint64_t>( f[8] );
+            r.ms          = stod( f[9] );
+        } catch( ... ) { continue; }
+        r.host        = f[1];
+        r.revision    = f[2];
+        r.libzip      = f[3];
+        r.archive     = f[4];
+        r.fingerprint = f[5];
+        r.settings    = f[6];
+        r.summary     = f[10];
+        res.push_back( r );
+    }
+    return res;
+}
+
+bool compare_history( string const& filename,
+                      string const& settings,
+                      string const& baseline,
+                      bool          json,
+                      ostream&      out ) {
+    string fingerprint = archive_fingerprint( filename );
+    string host        = host_name();
+    // The wall times of the matching runs of each version, and the
+    // order in which the versions were last seen.
+    map<string, vector<double>> times;
+    vector<string>              order;
+    for( auto const& r : load_history() ) {
+        if( r.fingerprint != fingerprint || r.settings != settings ||
+            r.host != host )
+            continue;
+        string version = r.revision + " / libzip " + r.libzip;
+        times[version].push_back( r.ms );
+        order.erase( remove( order.begin(), order.end(), version ),
+                     order.end() );
+        order.push_back( version );
+    }
+
+    Group base, latest;
+    if( !baseline.empty() && !order.empty() ) {
+        // The most recent other version whose name starts with the
+        // one given, so that just the revision is enough.
+        string prev;
+        for( size_t i = 0; i+1 < order.size(); ++i )
+            if( order[i].compare( 0, baseline.size(), baseline ) == 0 )
+                prev = order[i];
+        FAIL( prev.empty(), "there are no runs of " << baseline <<
+            " (other than the latest version) to compare with" );
+        latest = Group( order.back(), times[order.back()] );
+        base   = Group( prev, times[prev] );
+    } else if( order.size() > 1 ) {
+        latest = Group( order.back(), times[order.back()] );
+        string prev = order[order.size()-2];
+        base   = Group( prev, times[prev] );
+    } else if( !order.empty() ) {
+        // Only one version: the latest run against those before.
+        auto ms = times[order.back()];
+        latest = Group( order.back(), { ms.back() } );
+        ms.pop_back();
+        base   = Group( order.back(), ms );
+    }
+    bool   enough = base.n >= 2 && latest.n >= 1;
+    double change = enough && base.mean > 0
+                  ? latest.mean/base.mean - 1 : 0;
+    double p      = enough ? p_slower( base, latest ) : 1;
+    bool   slower = enough && p < HISTORY_ALPHA &&
+                    change >= HISTORY_MIN_SLOWDOWN;
+
+    char buf[512];
+    if( json ) {
+        string a, s;
+        append_json_string( a, filename.data(), filename.size() );
+        append_json_string( s, settings.data(), settings.size() );
+        out << "{\"archive\":" << a << ",\"fingerprint\":\""
+            << fingerprint << "\",\"settings\":" << s << ",";
+        if( enough ) {
+            print_group( "baseline", base,   true, out );
+            print_group( "latest",   latest, true, out );
+            snprintf( buf, sizeof( buf ), "\"change\":%.4f,\"p\":%.4g,",
+                      change, p );
+            out << buf;
+        }
+        out << "\"regression\":" << ( slower ? "true" : "false" )
+            << "}" << endl;
+        return slower;
+    }
+    out << "archive:   " << filename << " (" << fingerprint << ")"
+        << endl;
+    out << "settings:  " << settings << endl;
+    if( !enough ) {
+        out << "not enough runs to compare; record some with -H"
+            << endl;
+        return false;
+    }
+    print_group( "baseline:", base,   false, out );
+    print_group( "latest:",   latest, false, out );
+    snprintf( buf, sizeof( buf ), "change:    %+.1f%% (p = %.3g): %s\n",
+              100*change, p, slower ? "SLOWER" : "no regression" );
+    out << buf;
+    return slower;
+}
@@ -0,0 +1,108 @@
+/****************************************************************
+* Local performance history
+*****************************************************************
+* With -H the summary of each run is appended to a CSV file  next
+* to the host profile (see profile.hpp), along with what is needed
+* to tell the runs apart: a fingerprint of the archive, the host,
+* the revision of p-unzip, the version of libzip and the settings.
+* The compare command then looks among the runs on this host of one
+* archive with one set of settings for a slowdown that is too large
+* to put down to noise, such as after upgrading p-unzip or libzip.
+****************************************************************/
+#pragma once
+
+#include "unzip.hpp"
+
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A slowdown is only flagged if it is significant at this level
+// (one sided) and is also at least this large a fraction, so that
+// tiny but consistent changes are not reported.
+#define HISTORY_ALPHA         0.05
+#define HISTORY_MIN_SLOWDOWN  0.05
+
+/****************************************************************
+* One run, as kept in the history file.
+****************************************************************/
+struct HistoryRecord {
+    time_t      when;
+    std::string host;
+    std::string revision;
+    std::string libzip;
+    std::string archive;
+    std::string fingerprint;
+    std::string settings;
+    size_t      files;
+    uint64_t    bytes;
+    // Wall time of the whole run.
+    double      ms;
+    // The summary as written by print_json.
+    std::string summary;
+};
+
+// The settings that determine how fast a run is, as one string,
+// e.g. "j=4 d=cyclic c=4096 m=extract e=native i=zlib-ng". Runs are
+// only compared with others that have the same settings. The plan
+// only matters with the native engine, as libzip inflates itself.
+std::string history_settings( size_t             jobs,
+                              std::string const& strategy,
+                              size_t             chunk,
+                              UnzipMode          mode,
+                              ZipEngine          engine,
+                              InflatePlan const& plan );
+
+// Identifies the contents of an archive without reading all of
+// it: a CRC of the names, sizes and CRCs of the entries in  its
+// central directory, and the number of entries.
+std::string archive_fingerprint( std::string const& filename );
+
+// Append a run to the history. Will throw if it cannot be written.
+void append_history( std::string const&  filename,
+                     std::string const&  settings,
+                     UnzipSummary const& summary );
+
+// All the runs in the history, oldest first.
+std::vector<HistoryRecord> load_history();
+
+/****************************************************************
+* Compare the latest runs of the archive with the given settings
+* against earlier ones.
+*****************************************************************
+* The runs are grouped by version (revision of p-unzip and version
+* of libzip, e.g. "v1.2-3-gabc123 / libzip 1.10.1"). The runs of the
+* version of the latest run are tested against those of a baseline
+* version with Welch's t-test. The baseline is  the  most  recent
+* version whose name starts with `baseline` (just the revision will
+* do), or if that is empty, simply the version before the latest;
+* older versions are then not looked at, so a slowdown that crept
+* in over several versions needs an explicit baseline to show up.
+* If there is no other version yet, the latest run alone is tested
+* against the ones before it. Prints the comparison to `out` (as
+* JSON if `json`) and returns true if there is a slowdown. Will
+* throw if a baseline is given and there are no runs of it.  */
+bool compare_history( std::string const& filename,
+                      std::string const& settings,
+                      std::string const& baseline,
+                      bool               json,
+                      std::ostream&      out );
+
+// One sided p-value for the times in `latest` being slower than
+// those in `base`, by Welch's t-test; or, if there is only one latest
+// time, by whether it falls outside of the spread of the  base  (a
+// prediction interval). `base` needs at least two times.
+double p_slower( std::vector<double> const& base,
+                 std::vector<double> const& latest );
+
+/****************************************************************
+* CSV, as used for the history file
+****************************************************************/
+// Quote a CSV field if it needs it, doubling any quotes.
+std::string csv_field( std::string const& s );
+
+// Read one record from `in` into `fields`. A quoted field may have
+// newlines in it, in which case the record spans several lines.
+// Returns false if there is nothing left to read.
+bool csv_read( std::istream& in, std::vector<std::string>& fields );
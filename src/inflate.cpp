@@ -0,0 +1,459 @@
+/****************************************************************
+* Inflate backends.
+****************************************************************/
+#include "inflate.hpp"
+#include "macros.hpp"
+#include "phases.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+#ifdef P_UNZIP_LIBDEFLATE
+#   include <libdeflate.h>
+#endif
+#ifdef P_UNZIP_ZLIB_NG
+#   include <zlib-ng.h>
+#endif
+#ifdef P_UNZIP_ISAL
+#   include <isa-l/igzip_lib.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// The streaming interfaces take 32 bit lengths, so they are never
+// given more than this in one go.
+size_t const MAX_CHUNK = size_t( 1 ) << 30;
+
+// The most of the buffer for whole entries that an Inflater keeps
+// between entries (see Inflater::whole).
+size_t const WHOLE_KEEP = size_t( 1 ) << 20;
+
+char const* backend_name( InflateBackend b ) {
+    switch( b ) {
+        case InflateBackend::zlib:    return "zlib";
+        case InflateBackend::zlib_ng: return "zlib-ng";
+        case InflateBackend::isal:    return "isal";
+    }
+    return "?";
+}
+
+#if defined( P_UNZIP_ISAL ) && defined( P_UNZIP_ZLIB_NG )
+// ISA-L's inflate is ahead of zlib-ng's where it has its AVX2 code
+// (and on ARM, where it has NEON code); elsewhere it falls back to
+// generic code which is not.
+bool isal_is_fast() {
+#if defined( __aarch64__ )
+    return true;
+#elif defined( __x86_64__ ) && defined( __GNUC__ )
+    return __builtin_cpu_supports( "avx2" );
+#else
+    return false;
+#endif
+}
+#endif
+
+// One call of a streaming decompressor.
+enum class Step { more, end, error };
+
+} // anon namespace
+
+string InflatePlan::describe() const {
+    string res;
+    if( whole_max > 0 )
+        res = "libdeflate <= " + human_bytes( whole_max ) + ", ";
+    return res + backend_name( stream );
+}
+
+InflatePlan best_inflate_plan() {
+    InflatePlan res;
+#ifdef P_UNZIP_LIBDEFLATE
+    res.whole_max = INFLATE_WHOLE_MAX;
+#endif
+#ifdef P_UNZIP_ZLIB_NG
+    res.stream = InflateBackend::zlib_ng;
+#endif
+#ifdef P_UNZIP_ISAL
+#   ifdef P_UNZIP_ZLIB_NG
+    if( isal_is_fast() )
+#   endif
+        res.stream = InflateBackend::isal;
+#endif
+    return res;
+}
+
+InflatePlan inflate_plan( string const& name ) {
+    auto names = inflate_plan_names();
+    if( find( names.begin(), names.end(), name ) == names.end() ) {
+        string have;
+        for( auto const& n : names )
+            have += ( have.empty() ? "" : ", " ) + n;
+        FAIL( true, "inflate backend " << name << " is not available; "
+            "this build has: " << have );
+    }
+    InflatePlan res;
+    if( name == "auto" )
+        res = best_inflate_plan();
+    else if( name == "libdeflate" )
+        // Whole entries take memory of their size, so the  larger
+        // ones are still streamed, with plain zlib.
+        res.whole_max = INFLATE_WHOLE_MAX;
+    else if( name == "zlib-ng" )
+        res.stream = InflateBackend::zlib_ng;
+    else if( name == "isal" )
+        res.stream = InflateBackend::isal;
+    return res;
+}
+
+vector<string> inflate_plan_names() {
+    vector<string> res{ "zlib" };
+#ifdef P_UNZIP_ZLIB_NG
+    res.push_back( "zlib-ng" );
+#endif
+#ifdef P_UNZIP_ISAL
+    res.push_back( "isal" );
+#endif
+#ifdef P_UNZIP_LIBDEFLATE
+    res.push_back( "libdeflate" );
+#endif
+    res.push_back( "auto" );
+    return res;
+}
+
+uint32_t inflate_crc32( uint32_t crc, void const* data, size_t size ) {
+#ifdef P_UNZIP_LIBDEFLATE
+    return libdeflate_crc32( crc, data, size );
+#else
+    auto p = static_cast<Bytef const*>( data );
+    for( ; size > 0; ) {
+        size_t n = min( size, MAX_CHUNK );
+        crc   = uint32_t( crc32( crc, p, uInt( n ) ) );
+        p    += n;
+        size -= n;
+    }
+    return crc;
+#endif
+}
+
+/****************************************************************
+* Inflater
+****************************************************************/
+struct Inflater::State {
+    z_stream zlib;
+#ifdef P_UNZIP_ZLIB_NG
+    zng_stream ng;
+#endif
+#ifdef P_UNZIP_ISAL
+    inflate_state isal;
+#endif
+#ifdef P_UNZIP_LIBDEFLATE
+    libdeflate_decompressor* whole = nullptr;
+    // Where whole entries go that are larger than the caller's
+    // buffer.
+    vector<uint8_t>          out;
+#endif
+};
+
+// Only the backends in the plan are set up.
+Inflater::Inflater( InflatePlan const& plan )
+    : m_plan( plan ), m_state( new State ) {
+    State& s = *m_state;
+    if( m_plan.stream == InflateBackend::zlib ) {
+        memset( &s.zlib, 0, sizeof( s.zlib ) );
+        // Negative window bits: raw deflate data.
+        FAIL( inflateInit2( &s.zlib, -MAX_WBITS ) != Z_OK,
+            "failed to initialize zlib" );
+    }
+#ifdef P_UNZIP_ZLIB_NG
+    else if( m_plan.stream == InflateBackend::zlib_ng ) {
+        memset( &s.ng, 0, sizeof( s.ng ) );
+        FAIL( zng_inflateInit2( &s.ng, -MAX_WBITS ) != Z_OK,
+            "failed to initialize zlib-ng" );
+    }
+#endif
+#ifdef P_UNZIP_ISAL
+    else if( m_plan.stream == InflateBackend::isal )
+        isal_inflate_init( &s.isal );
+#endif
+    else
+        FAIL( true, "inflate backend " << backend_name( m_plan.stream )
+            << " is not built in" );
+    if( m_plan.whole_max > 0 ) {
+#ifdef P_UNZIP_LIBDEFLATE
+        s.whole = libdeflate_alloc_decompressor();
+        FAIL( !s.whole, "failed to initialize libdeflate" );
+#else
+        FAIL( true, "libdeflate is not built in" );
+#endif
+    }
+}
+
+Inflater::~Inflater() {
+    State& s = *m_state;
+    if( m_plan.stream == InflateBackend::zlib )
+        inflateEnd( &s.zlib );
+#ifdef P_UNZIP_ZLIB_NG
+    if( m_plan.stream == InflateBackend::zlib_ng )
+        zng_inflateEnd( &s.ng );
+#endif
+#ifdef P_UNZIP_LIBDEFLATE
+    if( s.whole )
+        libdeflate_free_decompressor( s.whole );
+#endif
+}
+
+namespace {
+
+// Drive a streaming decompressor over the input. `step` is called
+// with the input that is left and an output chunk, and must  say
+// how much of each it used. With a sink, each chunk is decompressed
+// to the start of `out` (which has `room` bytes) and passed to the
+// sink; without one, `out` is the destination for the whole entry
+// and the chunks follow each other there.
+template<typename StepF>
+bool stream( uint8_t const* in, uint64_t comp_size, uint64_t size,
+             uint8_t* out, size_t room, Inflater::Sink const* sink,
+             uint32_t& crc, string& why, StepF step ) {
+    uint64_t       in_left = comp_size;
+    uint64_t       total   = 0;
+    uint8_t const* next    = nullptr;
+    uint32_t       avail   = 0;
+    Step           res     = Step::more;
+    // Once the destination is full, output goes here, just so that
+    // data past the size can be told apart from the end.
+    uint8_t        spare[1];
+    while( res != Step::end ) {
+        if( avail == 0 && in_left > 0 ) {
+            avail    = uint32_t( min<uint64_t>( in_left, MAX_CHUNK ) );
+            next     = in;
+            in      += avail;
+            in_left -= avail;
+        }
+        uint8_t* to    = out;
+        size_t   chunk = min( room, MAX_CHUNK );
+        if( !sink && total < size ) {
+            to    = out + total;
+            chunk = size_t( min<uint64_t>( size - total, MAX_CHUNK ) );
+        } else if( !sink ) {
+            to    = spare;
+            chunk = sizeof( spare );
+        }
+        size_t produced = 0;
+        {
+            PhaseScope timer( Phase::inflate );
+            res = step( next, avail, to, uint32_t( chunk ), produced );
+            crc = inflate_crc32( crc, to, produced );
+        }
+        if( res == Step::error )
+            return false;
+        if( res == Step::more && produced == 0 && avail == 0 &&
+            in_left == 0 ) {
+            why = "compressed data is truncated";
+            return false;
+        }
+        total += produced;
+        if( total > size ) {
+            why = "more data than the size of " + to_string( size );
+            return false;
+        }
+        if( produced > 0 && sink )
+            (*sink)( to, produced );
+    }
+    if( total != size ) {
+        why = "size mismatch: expected " + to_string( size ) +
+              ", got " + to_string( total );
+        return false;
+    }
+    return true;
+}
+
+} // anon namespace
+
+bool Inflater::inflate( uint8_t const* in,
+                        uint64_t       comp_size,
+                        uint64_t       size,
+                        Buffer&        buf,
+                        Sink const&    sink,
+                        uint32_t&      crc,
+                        string&        why ) {
+    FAIL_( buf.size() == 0 );
+    return run( in, comp_size, size, static_cast<uint8_t*>( buf.get() ),
+                buf.size(), &sink, crc, why );
+}
+
+bool Inflater::inflate_into( uint8_t const* in,
+                             uint64_t       comp_size,
+                             uint64_t       size,
+                             void*          dest,
+                             uint32_t&      crc,
+                             string&        why ) {
+    FAIL_( size > numeric_limits<size_t>::max() );
+    return run( in, comp_size, size, static_cast<uint8_t*>( dest ),
+                size_t( size ), nullptr, crc, why );
+}
+
+bool Inflater::run( uint8_t const* in,
+                    uint64_t       comp_size,
+                    uint64_t       size,
+                    uint8_t*       out,
+                    size_t         room,
+                    Sink const*    sink,
+                    uint32_t&      crc,
+                    string&        why ) {
+    if( m_plan.whole_max > 0 && size <= m_plan.whole_max )
+        return whole( in, comp_size, size, out, room, sink, crc, why );
+    State& s = *m_state;
+    switch( m_plan.stream ) {
+        case InflateBackend::zlib: {
+            z_stream& z = s.zlib;
+            FAIL( inflateReset( &z ) != Z_OK, "failed to reset zlib" );
+            return stream( in, comp_size, size, out, room, sink, crc, why,
+                [&]( uint8_t const*& next, uint32_t& avail, uint8_t* out,
+                     uint32_t chunk, size_t& produced ){
+                    z.next_in   = const_cast<Bytef*>( next );
+                    z.avail_in  = avail;
+                    z.next_out  = out;
+                    z.avail_out = chunk;
+                    int ret     = ::inflate( &z, Z_NO_FLUSH );
+                    next        = z.next_in;
+                    avail       = z.avail_in;
+                    produced    = chunk - z.avail_out;
+                    if( ret == Z_STREAM_END )
+                        return Step::end;
+                    if( ret == Z_OK || ret == Z_BUF_ERROR )
+                        return Step::more;
+                    why = string( "bad compressed data: " ) + ( z.msg
+                        ? z.msg : "zlib error " + to_string( ret ) );
+                    return Step::error;
+                } );
+        }
+#ifdef P_UNZIP_ZLIB_NG
+        case InflateBackend::zlib_ng: {
+            zng_stream& z = s.ng;
+            FAIL( zng_inflateReset( &z ) != Z_OK,
+                "failed to reset zlib-ng" );
+            return stream( in, comp_size, size, out, room, sink, crc, why,
+                [&]( uint8_t const*& next, uint32_t& avail, uint8_t* out,
+                     uint32_t chunk, size_t& produced ){
+                    z.next_in   = next;
+                    z.avail_in  = avail;
+                    z.next_out  = out;
+                    z.avail_out = chunk;
+                    int ret     = zng_inflate( &z, Z_NO_FLUSH );
+                    next        = z.next_in;
+                    avail       = z.avail_in;
+                    produced    = chunk - z.avail_out;
+                    if( ret == Z_STREAM_END )
+                        return Step::end;
+                    if( ret == Z_OK || ret == Z_BUF_ERROR )
+                        return Step::more;
+                    why = string( "bad compressed data: " ) + ( z.msg
+                        ? z.msg : "zlib-ng error " + to_string( ret ) );
+                    return Step::error;
+                } );
+        }
+#endif
+#ifdef P_UNZIP_ISAL
+        case InflateBackend::isal: {
+            inflate_state& z = s.isal;
+            isal_inflate_reset( &z );
+            z.crc_flag = ISAL_DEFLATE;
+            return stream( in, comp_size, size, out, room, sink, crc, why,
+                [&]( uint8_t const*& next, uint32_t& avail, uint8_t* out,
+                     uint32_t chunk, size_t& produced ){
+                    z.next_in   = const_cast<uint8_t*>( next );
+                    z.avail_in  = avail;
+                    z.next_out  = out;
+                    z.avail_out = chunk;
+                    int ret     = isal_inflate( &z );
+                    next        = z.next_in;
+                    avail       = z.avail_in;
+                    produced    = chunk - z.avail_out;
+                    if( ret < 0 ) {
+                        why = "bad compressed data: isal error " +
+                              to_string( ret );
+                        return Step::error;
+                    }
+                    return z.block_state == ISAL_BLOCK_FINISH
+                         ? Step::end : Step::more;
+                } );
+        }
+#endif
+        default:
+            FAIL_( true );
+    }
+    return false;
+}
+
+// Decompress the entry in one call: with a sink, into the caller's
+// buffer if it is large enough, and then hand it over in pieces of
+// that size; without one, straight into the destination.
+bool Inflater::whole( uint8_t const* in,
+                      uint64_t       comp_size,
+                      uint64_t       size,
+                      uint8_t*       out,
+                      size_t         room,
+                      Sink const*    sink,
+                      uint32_t&      crc,
+                      string&        why ) {
+#ifdef P_UNZIP_LIBDEFLATE
+    // The plans never go above this, so size fits in a size_t and
+    // the buffer that we keep stays small.
+    FAIL_( size > INFLATE_WHOLE_MAX );
+    State& s = *m_state;
+    // Only a small buffer is kept from one entry to the next; after
+    // the (rarer) larger ones it is released, even if the sink throws.
+    struct Trim {
+        vector<uint8_t>& v;
+        ~Trim() {
+            if( v.size() > WHOLE_KEEP )
+                vector<uint8_t>().swap( v );
+        }
+    } trim{ s.out };
+    uint8_t* dest = out;
+    if( size > room ) {
+        if( s.out.size() < size )
+            s.out.resize( size_t( size ) );
+        dest = s.out.data();
+    }
+    size_t actual = 0;
+    libdeflate_result ret;
+    {
+        PhaseScope timer( Phase::inflate );
+        // Room for exactly `size` bytes, so that anything more  is
+        // reported rather than written past the end.
+        ret = libdeflate_deflate_decompress( s.whole, in, comp_size,
+            dest, size_t( size ), &actual );
+        if( ret == LIBDEFLATE_SUCCESS )
+            crc = inflate_crc32( crc, dest, actual );
+    }
+    if( ret == LIBDEFLATE_INSUFFICIENT_SPACE ) {
+        why = "more data than the size of " + to_string( size );
+        return false;
+    }
+    if( ret != LIBDEFLATE_SUCCESS ) {
+        why = "bad compressed data: libdeflate error " +
+              to_string( int( ret ) );
+        return false;
+    }
+    if( actual != size ) {
+        why = "size mismatch: expected " + to_string( size ) +
+              ", got " + to_string( actual );
+        return false;
+    }
+    for( size_t done = 0; sink && done < actual; ) {
+        size_t n = min( actual - done, room );
+        (*sink)( dest + done, n );
+        done += n;
+    }
+    return true;
+#else
+    (void)in; (void)comp_size; (void)size; (void)out; (void)room;
+    (void)sink; (void)crc; (void)why;
+    FAIL_( true );
+    return false;
+#endif
+}
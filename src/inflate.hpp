@@ -0,0 +1,139 @@
+/****************************************************************
+* Inflate backends
+*****************************************************************
+* The native reader (see reader.hpp) decompresses deflated entries
+* through this layer rather than calling zlib directly, so that a
+* faster library can be used where there is one. Besides zlib, any
+* of these can be built in (see .project.mk):
+*
+*   libdeflate: decompresses a whole entry in one call, from the
+*               archive buffer into memory, with none of the over-
+*               head of streaming. Used for the entries of up to
+*               INFLATE_WHOLE_MAX bytes, which are the most common.
+*   zlib-ng:    streaming, through its native (zng_) interface.
+*   ISA-L:      streaming (igzip), fastest on x86 with AVX2.
+*
+* The entries too large to decompress in one go are streamed with
+* the best of the streaming backends that are built in, chosen at
+* run time from the features of the CPU. Each of the libraries then
+* picks its own code paths (SSE, AVX2, NEON ...) for the CPU. When
+* none of them are built in, this is all plain zlib, as before.
+****************************************************************/
+#pragma once
+
+#include "utils.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Entries of up to this many bytes are decompressed whole  (with
+// libdeflate); larger ones are always streamed. When the  caller's
+// buffer is smaller than the entry, it goes into a buffer of  the
+// Inflater's instead, so this is also the most memory that  takes.
+// Only up to 1MB of that is kept from one entry to the next.
+#define INFLATE_WHOLE_MAX  (uint64_t( 8 ) << 20)
+
+// The streaming backends.
+enum class InflateBackend {
+    zlib,
+    zlib_ng,
+    isal
+};
+
+/****************************************************************
+* How to decompress the entries: whole, with libdeflate, if  they
+* are no larger than `whole_max` (zero if libdeflate is not used,
+* and never more than INFLATE_WHOLE_MAX) and otherwise streamed with
+* `stream`.
+****************************************************************/
+struct InflatePlan {
+    InflatePlan() : stream( InflateBackend::zlib ), whole_max( 0 ) {}
+
+    InflateBackend stream;
+    uint64_t       whole_max;
+
+    // E.g. "libdeflate <= 8.0MB, zlib-ng".
+    std::string describe() const;
+};
+
+// The best plan with the backends that are built in on this CPU.
+InflatePlan best_inflate_plan();
+
+// The plan for a name as given on the command line: "auto" for the
+// best one, or the name of one backend to use: zlib, zlib-ng, isal
+// or libdeflate. As libdeflate only takes whole entries, with it the
+// entries larger than INFLATE_WHOLE_MAX are streamed with zlib. Will
+// throw if that backend was not built in.
+InflatePlan inflate_plan( std::string const& name );
+
+// The names that inflate_plan takes in this build, "auto" last.
+std::vector<std::string> inflate_plan_names();
+
+// CRC-32 of some data, starting from `crc`, with  the  fastest
+// implementation that is built in (libdeflate's uses PCLMUL).
+uint32_t inflate_crc32( uint32_t crc, void const* data, size_t size );
+
+/****************************************************************
+* Inflater: decompresses raw deflate data (as stored  in  zips)
+* according to a plan. Each one keeps its decompressor state (and
+* buffer, for whole entries) from one entry to the next, so each
+* thread should have its own.
+****************************************************************/
+class Inflater {
+
+public:
+    explicit Inflater( InflatePlan const& plan = best_inflate_plan() );
+    ~Inflater();
+
+    Inflater( Inflater const& )            = delete;
+    Inflater& operator=( Inflater const& ) = delete;
+
+    InflatePlan const& plan() const { return m_plan; }
+
+    // Called with each piece of the uncompressed data.
+    using Sink = std::function<void( void const* data, size_t size )>;
+
+    // Decompress `comp_size` bytes at `in`, which should come  to
+    // exactly `size` bytes, and pass them to `sink` in pieces of at
+    // most buf.size() bytes, along with their CRC-32 in `crc`. When
+    // streaming, `buf` is where they are decompressed to. Returns
+    // false, with the reason in `why`, if the data is bad or is not
+    // of the right size; the sink may already have been given some
+    // of it. Exceptions from the sink go through.
+    bool inflate( uint8_t const* in,
+                  uint64_t       comp_size,
+                  uint64_t       size,
+                  Buffer&        buf,
+                  Sink const&    sink,
+                  uint32_t&      crc,
+                  std::string&   why );
+
+    // The same, but decompress straight into `dest`, which must have
+    // room for `size` bytes, instead of going through a sink.
+    bool inflate_into( uint8_t const* in,
+                       uint64_t       comp_size,
+                       uint64_t       size,
+                       void*          dest,
+                       uint32_t&      crc,
+                       std::string&   why );
+
+private:
+    // Both of the above: with a sink, `out` is a buffer of  `room`
+    // bytes to pass the data through; without, it is the destination.
+    bool run( uint8_t const* in, uint64_t comp_size, uint64_t size,
+              uint8_t* out, size_t room, Sink const* sink,
+              uint32_t& crc, std::string& why );
+    bool whole( uint8_t const* in, uint64_t comp_size, uint64_t size,
+                uint8_t* out, size_t room, Sink const* sink,
+                uint32_t& crc, std::string& why );
+
+    InflatePlan m_plan;
+    // The state of each backend that is used, which  is  defined
+    // in the implementation so that their headers stay there.
+    struct State;
+    std::unique_ptr<State> m_state;
+
+};
@@ -0,0 +1,135 @@
+/****************************************************************
+* Checkpoint journal for resumable extraction.
+****************************************************************/
+#include "journal.hpp"
+#include "macros.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+// Parse the decimal index on each complete line of the file at
+// `path` and append them to `out`. A missing file is fine, and a
+// last line without a newline (torn by a crash) is ignored.
+void read_indices( string const& path, vector<uint64_t>& out ) {
+    if( !file_size( path ) )
+        return;
+    Buffer buf = File( path, "rb" ).read();
+    auto   p   = static_cast<char const*>( buf.get() );
+    auto   end = p + buf.size();
+    while( true ) {
+        auto nl = static_cast<char const*>(
+            memchr( p, '\n', size_t( end - p ) ) );
+        if( !nl )
+            break;
+        char* stop;
+        uint64_t idx = strtoull( p, &stop, 10 );
+        FAIL( stop != nl, "corrupt journal " << path );
+        out.push_back( idx );
+        p = nl+1;
+    }
+}
+
+} // anon namespace
+
+/****************************************************************
+* JournalLog
+****************************************************************/
+JournalLog::JournalLog( string const& path )
+    : m_file( path, "wb" ), m_pending(), m_count( 0 ) {}
+
+void JournalLog::done( uint64_t idx ) {
+    m_pending += to_string( idx );
+    m_pending += '\n';
+    if( ++m_count % JOURNAL_BATCH == 0 )
+        flush();
+}
+
+void JournalLog::flush() {
+    if( m_pending.empty() )
+        return;
+    m_file.write( m_pending.data(), m_pending.size() );
+    m_file.sync();
+    m_pending.clear();
+}
+
+/****************************************************************
+* Journal
+****************************************************************/
+Journal::Journal( string const& folder,
+                  string const& archive,
+                  bool          resume,
+                  size_t        jobs )
+    : m_folder( folder ), m_completed() {
+    make_folders( folder );
+
+    // Find out what is there from last time, if anything.
+    size_t old_jobs = 0;
+    if( file_size( path( "info" ) ) ) {
+        Buffer buf = File( path( "info" ), "rb" ).read();
+        istringstream in( string( static_cast<char const*>(
+            buf.get() ), buf.size() ) );
+        string old_archive;
+        getline( in, old_archive );
+        in >> old_jobs;
+        FAIL( resume && old_archive != archive, "journal in " <<
+            folder << " is for a different archive" );
+    }
+
+    // Gather up everything recorded so far and write it all into
+    // a single file, replacing the old one atomically, before the
+    // thread logs are removed; that way a crash at  any  point  in
+    // here loses nothing.
+    if( resume ) {
+        read_indices( path( "done" ), m_completed );
+        for( size_t i = 0; i < old_jobs; ++i )
+            read_indices( path( "thread-" + to_string( i ) ),
+                          m_completed );
+        sort( m_completed.begin(), m_completed.end() );
+        m_completed.erase( unique( m_completed.begin(),
+                                   m_completed.end() ),
+                           m_completed.end() );
+        string text;
+        for( auto idx : m_completed )
+            text += to_string( idx ) + '\n';
+        {
+            File f( path( "done.tmp" ), "wb" );
+            f.write( text.data(), text.size() );
+        }
+        rename_file( path( "done.tmp" ), path( "done" ) );
+    } else
+        remove_file( path( "done" ) );
+    for( size_t i = 0; i < old_jobs; ++i )
+        remove_file( path( "thread-" + to_string( i ) ) );
+
+    string info = archive + '\n' + to_string( jobs ) + '\n';
+    File( path( "info" ), "wb" ).write( info.data(), info.size() );
+}
+
+unique_ptr<JournalLog> Journal::log( size_t thread ) const {
+    return unique_ptr<JournalLog>( new JournalLog(
+        path( "thread-" + to_string( thread ) ) ) );
+}
+
+string Journal::path( string const& name ) const {
+    return m_folder + "/" + name;
+}
+
+// Identify an archive by its size and the CRC of its last  mega-
+// byte, which covers the central directory of all but the largest
+// archives (and, in those, most of it).
+string archive_id( Buffer const& zip ) {
+    size_t tail  = min( zip.size(), size_t( 1 ) << 20 );
+    auto   start = static_cast<Bytef const*>( zip.get() )
+                 + zip.size() - tail;
+    uLong  crc   = crc32( crc32( 0L, Z_NULL, 0 ), start, uInt( tail ) );
+    ostringstream out;
+    out << "size " << zip.size() << " crc " << hex << crc;
+    return out.str();
+}
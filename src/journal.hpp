@@ -0,0 +1,101 @@
+/****************************************************************
+* Checkpoint journal for resumable extraction
+*****************************************************************
+* The journal lives in a folder of its own and records which en-
+* tries of an archive have been completely extracted, so that an
+* extraction which dies part way through can be resumed instead of
+* started over. It holds these files:
+*
+*   info     : identifies the archive and the number of threads
+*              that last wrote to the journal.
+*   done     : entries completed by earlier runs, consolidated.
+*   thread-N : entries completed by thread N of the current run.
+*
+* Each entry is recorded as its index in decimal on a line of its
+* own, so a line torn by a crash is recognizable and ignored. Each
+* thread writes its own file, and in batches, so there is no con-
+* tention between the threads and few system calls.
+*
+* A resume can be trusted after the process was killed or crashed.
+* After a power loss it can not: the extracted files are not synced
+* to disk (that would cost far more than the extraction itself), so
+* entries in the journal may have lost data; start over instead.
+****************************************************************/
+#pragma once
+
+#include "fs.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Number of entries that each thread records before  syncing  its
+// log to disk. If we die, at most this many entries  per  thread
+// will be redone, so this just trades syncs against redone work.
+#define JOURNAL_BATCH 256
+
+/****************************************************************
+* JournalLog: the log written by one thread.
+****************************************************************/
+class JournalLog {
+
+public:
+    JournalLog( std::string const& path );
+
+    // Record that the entry is completely extracted. This  buffers
+    // the record and flushes every JOURNAL_BATCH entries.
+    void done( uint64_t idx );
+
+    // Write out any buffered records and sync them to disk. This
+    // does not make the checkpoint safe against a power loss: the
+    // extracted files are not synced, so their data may be lost
+    // even though the journal lists them. What it covers is  the
+    // process dying (killed or crashed).
+    void flush();
+
+private:
+    File        m_file;
+    std::string m_pending;
+    size_t      m_count;
+
+};
+
+/****************************************************************
+* Journal
+****************************************************************/
+class Journal {
+
+public:
+    // Open the journal in `folder`, creating  the  folder  if  nec-
+    // essary. `archive` is a string identifying the archive being
+    // extracted (see archive_id). If `resume` is true then the re-
+    // cords left by earlier runs are read in and consolidated, and
+    // this will throw if they are for a different archive;  other-
+    // wise any old journal is discarded. `jobs` is the number  of
+    // threads that will write to it in this run.
+    Journal( std::string const& folder,
+             std::string const& archive,
+             bool               resume,
+             size_t             jobs );
+
+    // Indices of the entries recorded as done by earlier runs, in
+    // no particular order. These are only claims: the caller should
+    // check that the files are really there.
+    std::vector<uint64_t> const& completed() const {
+        return m_completed;
+    }
+
+    // Create the log to be written by the given thread.
+    std::unique_ptr<JournalLog> log( size_t thread ) const;
+
+private:
+    std::string path( std::string const& name ) const;
+
+    std::string           m_folder;
+    std::vector<uint64_t> m_completed;
+
+};
+
+// Make a string identifying an archive from its contents: its size
+// and a checksum of its tail, which holds the central directory.
+std::string archive_id( Buffer const& zip );
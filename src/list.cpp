@@ -0,0 +1,199 @@
+/****************************************************************
+* Implementation of the archive listing.
+****************************************************************/
+#include "directory.hpp"
+#include "fs.hpp"
+#include "list.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+using namespace std;
+
+namespace {
+
+// Percent of space saved by compression, as shown by most  zip
+// tools. Entries with zero size are reported as zero.
+double saved( DirEntry const& e ) {
+    if( e.size == 0 ) return 0;
+    return 100.0*( 1.0 - double( e.comp_size )/double( e.size ) );
+}
+
+// Append the DOS timestamp of an entry as YYYY-MM-DD?HH:MM:SS,
+// where `sep` is the character separating date from time. We do
+// this straight from the bit fields rather than through mktime
+// because it is much faster and  the  result  does  not  depend on
+// the local timezone.
+void append_time( string& s, uint32_t dt, char sep ) {
+    char buf[32];
+    snprintf( buf, sizeof( buf ), "%04u-%02u-%02u%c%02u:%02u:%02u",
+        ((dt >> 25) & 0x7f) + 1980, (dt >> 21) & 0x0f,
+        (dt >> 16) & 0x1f, sep, (dt >> 11) & 0x1f,
+        (dt >> 5) & 0x3f, (dt & 0x1f)*2 );
+    s += buf;
+}
+
+// Format one line of the listing for the given entry and append
+// it to `s`. We use snprintf here instead of streams because this
+// is the hot loop when listing millions of entries.
+void format_entry( string& s, Directory const& dir, size_t idx,
+                   bool json ) {
+    DirEntry const& e = dir[idx];
+    char buf[160];
+    if( json ) {
+        snprintf( buf, sizeof( buf ), "{\"index\":%zu,\"name\":", idx );
+        s += buf;
+        append_json_string( s, dir.name_data( idx ), e.name_len );
+        snprintf( buf, sizeof( buf ),
+            ",\"size\":%llu,\"comp_size\":%llu,\"method\":\"%s\","
+            "\"ratio\":%.1f,\"crc\":\"%08x\",\"time\":\"",
+            (unsigned long long)e.size,
+            (unsigned long long)e.comp_size,
+            method_name( e.method ).c_str(), saved( e ), e.crc );
+        s += buf;
+        append_time( s, e.dos_time, 'T' );
+        snprintf( buf, sizeof( buf ), "\",\"offset\":%llu}\n",
+            (unsigned long long)e.offset );
+        s += buf;
+    } else {
+        snprintf( buf, sizeof( buf ), "%12llu  %-9s %12llu %4.0f%%  ",
+            (unsigned long long)e.size, method_name( e.method ).c_str(),
+            (unsigned long long)e.comp_size, saved( e ) );
+        s += buf;
+        append_time( s, e.dos_time, ' ' );
+        snprintf( buf, sizeof( buf ), "  %08x %12llu  ", e.crc,
+            (unsigned long long)e.offset );
+        s += buf;
+        s.append( dir.name_data( idx ), e.name_len );
+        s += '\n';
+    }
+}
+
+// Return a comparator over entry indexes for the given sort key.
+// Ties are broken by index (using stable_sort) so that the result
+// is deterministic.
+function<bool( size_t, size_t )> comparator( Directory const& dir,
+                                             string const& key ) {
+    if( key == "name" )
+        return [&dir]( size_t l, size_t r ) {
+            auto ll = dir[l].name_len, rl = dir[r].name_len;
+            int c = memcmp( dir.name_data( l ), dir.name_data( r ),
+                            min( ll, rl ) );
+            return c < 0 || ( c == 0 && ll < rl );
+        };
+    if( key == "size" )
+        return [&dir]( size_t l, size_t r ) {
+            return dir[l].size < dir[r].size;
+        };
+    if( key == "comp_size" )
+        return [&dir]( size_t l, size_t r ) {
+            return dir[l].comp_size < dir[r].comp_size;
+        };
+    if( key == "ratio" )
+        return [&dir]( size_t l, size_t r ) {
+            return saved( dir[l] ) < saved( dir[r] );
+        };
+    if( key == "offset" )
+        return [&dir]( size_t l, size_t r ) {
+            return dir[l].offset < dir[r].offset;
+        };
+    FAIL( true, "invalid sort key " << key << "; must be one of: "
+                LIST_SORT_KEYS );
+    return nullptr;
+}
+
+} // anon namespace
+
+/****************************************************************
+* Main interface for listing.
+****************************************************************/
+ListSummary p_list( string const& filename,
+                    size_t        jobs,
+                    string const& sort,
+                    string const& filter,
+                    bool          json,
+                    ostream&      out ) {
+    FAIL_( jobs < 1 );
+    Buffer    zip( File( filename, "rb" ).read() );
+    Directory dir( zip );
+
+    // First select the entries that match the filter. Each chunk
+    // collects its matches separately and  then  we  concatenate
+    // them, which preserves archive order.
+    vector<vector<size_t>> selected( jobs );
+    parallel_chunks( dir.size(), jobs,
+        [&]( size_t c, size_t begin, size_t end ) {
+            for( size_t i = begin; i < end; ++i )
+                if( filter.empty() || glob_match( filter.c_str(),
+                        dir.name_data( i ), dir[i].name_len ) )
+                    selected[c].push_back( i );
+        } );
+    vector<size_t> idxs;
+    for( auto const& s : selected )
+        idxs.insert( idxs.end(), s.begin(), s.end() );
+
+    // Sort if requested.
+    if( !sort.empty() ) {
+        string key( sort );
+        bool   desc = false;
+        auto   colon = key.find( ':' );
+        if( colon != string::npos ) {
+            FAIL( key.substr( colon+1 ) != "desc",
+                "invalid sort order in " << sort );
+            desc = true;
+            key  = key.substr( 0, colon );
+        }
+        auto less = comparator( dir, key );
+        if( desc )
+            stable_sort( idxs.begin(), idxs.end(),
+                [&less]( size_t l, size_t r ){ return less( r, l ); } );
+        else
+            stable_sort( idxs.begin(), idxs.end(), less );
+    }
+
+    // Now format the lines in parallel chunks  and  write  the
+    // chunks out in order. Totals are summed per chunk as well.
+    vector<string>      text( jobs );
+    vector<ListSummary> sums( jobs, ListSummary{ 0, 0, 0 } );
+    parallel_chunks( idxs.size(), jobs,
+        [&]( size_t c, size_t begin, size_t end ) {
+            for( size_t i = begin; i < end; ++i ) {
+                format_entry( text[c], dir, idxs[i], json );
+                sums[c].entries++;
+                sums[c].size      += dir[idxs[i]].size;
+                sums[c].comp_size += dir[idxs[i]].comp_size;
+            }
+        } );
+
+    ListSummary total{ 0, 0, 0 };
+    char buf[160];
+    if( !json ) {
+        snprintf( buf, sizeof( buf ), "%12s  %-9s %12s %5s  %-19s  "
+            "%-8s %12s  %s\n", "Length", "Method", "Size", "Cmpr",
+            "Date/Time", "CRC-32", "Offset", "Name" );
+        out << buf;
+    }
+    for( size_t c = 0; c < jobs; ++c ) {
+        out << text[c];
+        total.entries   += sums[c].entries;
+        total.size      += sums[c].size;
+        total.comp_size += sums[c].comp_size;
+    }
+
+    DirEntry t = DirEntry();
+    t.size = total.size; t.comp_size = total.comp_size;
+    if( json )
+        snprintf( buf, sizeof( buf ), "{\"totals\":{\"entries\":%zu,"
+            "\"size\":%llu,\"comp_size\":%llu,\"ratio\":%.1f}}\n",
+            total.entries, (unsigned long long)total.size,
+            (unsigned long long)total.comp_size, saved( t ) );
+    else
+        snprintf( buf, sizeof( buf ), "%12llu  %-9s %12llu %4.0f%%"
+            "  %zu entries\n", (unsigned long long)total.size, "",
+            (unsigned long long)total.comp_size, saved( t ),
+            total.entries );
+    out << buf;
+    return total;
+}
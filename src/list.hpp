@@ -0,0 +1,53 @@
+/****************************************************************
+* Interface for listing the contents of an archive. This works off
+* of the compact central directory and never decompresses or even
+* opens the individual entries.
+****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Keys by which the listing can be sorted (see p_list).
+#define LIST_SORT_KEYS "name, size, comp_size, ratio, offset"
+
+/****************************************************************
+* This structure is used to return totals for the entries that
+* were listed.
+****************************************************************/
+struct ListSummary {
+    size_t   entries;
+    uint64_t size;
+    uint64_t comp_size;
+};
+
+/****************************************************************
+* Main interface to list the entries in an archive.
+*****************************************************************
+* filename: path of zip file to be opened relative to CWD.
+*
+* jobs: the matching and formatting of the entries is split into
+* this many contiguous chunks which are processed in parallel and
+* then written out in order.
+*
+* sort: empty to list in archive order, otherwise one of the keys
+* in LIST_SORT_KEYS, optionally followed by ":desc" to  sort  in
+* descending order.
+*
+* filter: if not empty then only entries whose names  match  this
+* wildcard pattern (see glob_match) will be listed.
+*
+* json: when true, write one JSON object per  entry  per  line,
+* followed by a final line holding the totals; otherwise write a
+* human readable table.
+*
+* out: where the listing is written.
+*
+* This function will throw on any error. */
+ListSummary p_list( std::string const& filename,
+                    size_t             jobs,
+                    std::string const& sort,
+                    std::string const& filter,
+                    bool               json,
+                    std::ostream&      out );
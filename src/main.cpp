@@ -8,11 +8,22 @@
 * the  threads in the specified way in order to take advantage of
 * the opportunity  for  parallelism  while  unzipping  an archive.
 ****************************************************************/
+#include "analyze.hpp"
+#include "bench.hpp"
+#include "create.hpp"
+#include "distribution.hpp"
+#include "history.hpp"
+#include "list.hpp"
 #include "options.hpp"
+#include "profile.hpp"
+#include "simulate.hpp"
+#include "sys.hpp"
 #include "unzip.hpp"
 
+#include <algorithm>
 #include <cstdlib>
-#include <thread>
+#include <fstream>
+#include <iostream>
 
 using namespace std;
 using options::option_get;
@@ -32,6 +43,13 @@ int main_( options::positional positional,
     bool q    = has_key( options, 'q' ); // quiet
     bool exts = has_key( options, 'a' ); // no long extensions
     bool g    = has_key( options, 'g' ); // diagnostic info
+    bool T    = has_key( options, 'T' ); // test, don't extract
+    bool l    = has_key( options, 'l' ); // list, don't extract
+    bool J    = has_key( options, 'J' ); // JSON output
+    bool D    = has_key( options, 'D' ); // deterministic order
+    bool R    = has_key( options, 'R' ); // resume from journal
+    bool P    = has_key( options, 'p' ); // use/update host profile
+    bool H    = has_key( options, 'H' ); // record in the history
 
     /************************************************************
     * Determine timestamp (TS) policy
@@ -58,13 +76,12 @@ int main_( options::positional positional,
 
     // By default we just use the "id" function that will use the
     // exact timestamp stored in the zip.
-    auto id_transform = []( time_t t ){ return t; };
-    TSXFormer ts_xform( id_transform );
+    TSXFormer ts_xform( id<time_t> );
     if( has_key( options, 't' ) ) {
         string t = options['t'].get();
         if( t == "current" )
             // Just let the timestamps fall where they may.
-            ts_xform = []( time_t ){ return 0; };
+            ts_xform = nullptr;
         else {
             // All extracted files  should  have  this timestamp.
             time_t fixedStamp = to_uint<time_t>( t );
@@ -87,10 +104,12 @@ int main_( options::positional positional,
     // First initialize the number of jobs to its  default  value.
     string jobs( option_get( options, 'j', "1" ) );
     size_t j;
-    // Next, let's get the  number  of  threads  that the machine
-    // naturally supports (this will include hyperthreads).  Even
-    // if  we don't need this, we might want to log it at the end.
-    auto num_threads = thread::hardware_concurrency();
+    // Next, let's get the number of threads that we can actually
+    // run at once (this will include hyperthreads). This is not
+    // just what the hardware supports: in a container  we  may  be
+    // limited by a cpuset or a CPU quota to far fewer than the host
+    // has, and going above that just makes the threads thrash.
+    auto num_threads = effective_cpus();
     // The user can override number  of  jobs  by  specifying  -j.
     if( jobs == "max" )
         // Assume that num_threads includes the hyperthreads,  so
@@ -114,9 +133,18 @@ int main_( options::positional positional,
     * is the number of bytes that are decompressed and written to
     * the output file at  a  time.  With  zip  files that contain
     * large files together with multithreaded execution it is  de-
-    * sireable to limit the chunk size to save memory. */
-    auto chunk( to_uint<size_t>(
-        option_get( options, 'c', DEFAULT_CHUNK_S ) ) );
+    * sireable to limit the chunk size to save memory. With "auto"
+    * the chunk size is derived from the memory that is available
+    * to us (which in a container is its memory limit) such that
+    * all the threads' chunks together use a small fraction of it. */
+    string chunk_s( option_get( options, 'c', DEFAULT_CHUNK_S ) );
+    size_t chunk;
+    if( chunk_s == "auto" ) {
+        uint64_t per_job = effective_memory() / 64 / j;
+        chunk = size_t( min<uint64_t>( max<uint64_t>( per_job,
+            DEFAULT_CHUNK ), 16 << 20 ) );
+    } else
+        chunk = to_uint<size_t>( chunk_s );
 
     /************************************************************
     * Distribution of files to the threads
@@ -124,6 +152,49 @@ int main_( options::positional positional,
     * See if the user has  specified  a distribution strategy. */
     string strat( option_get( options, 'd', DEFAULT_DIST ) );
 
+    /************************************************************
+    * Host profile
+    *************************************************************
+    * With -p, the settings that have done best when extracting to
+    * this file system before are used for any of jobs, chunk size
+    * and strategy that the user has not given explicitly, and the
+    * results of this run are recorded afterwards (see below). */
+    bool use_profile = P && !l && !T &&
+        !has_key( options, 'Z' ) && !has_key( options, 'B' ) &&
+        !has_key( options, 'S' ) && !has_key( options, 'C' ) &&
+        !has_key( options, 'r' ) && !has_key( options, 'I' );
+    string profile_id;
+    if( use_profile ) {
+        profile_id = profile_key( o );
+        HostProfile profile = load_profile( profile_id );
+        if( auto best = profile.best() ) {
+            // The profile may have been recorded on this host with
+            // more CPUs than we now have (e.g. in a container), so
+            // it is held to them as -j max is.
+            if( !has_key( options, 'j' ) )
+                j = max<size_t>( min( best->jobs, num_threads ), 1 );
+            if( !has_key( options, 'c' ) ) chunk = best->chunk;
+            if( !has_key( options, 'd' ) ) strat = best->strategy;
+        }
+    }
+
+    /************************************************************
+    * Password
+    *************************************************************
+    * Encrypted entries (traditional PKWARE or WinZip AES) need a
+    * password. It can be given directly with -P, but that leaves
+    * it visible in the process list, so it can also be read from
+    * the first line of a key file with -K. */
+    string password( option_get( options, 'P', "" ) );
+    if( has_key( options, 'K' ) ) {
+        string key_file = options['K'].get();
+        ifstream in( key_file );
+        FAIL( !in.good(), "failed to open key file " << key_file );
+        getline( in, password );
+        if( !password.empty() && password.back() == '\r' )
+            password.pop_back();
+    }
+
     /************************************************************
     * Get zip file name
     *************************************************************
@@ -132,13 +203,162 @@ int main_( options::positional positional,
     * validated that there is exactly one positional argument. */
     string f = positional[0];
 
+    /************************************************************
+    * List
+    *************************************************************
+    * When listing we only need the central directory, so this is
+    * handled separately and we are done afterwards. The sort key
+    * and filter are only meaningful here. */
+    if( l ) {
+        p_list( f, j, option_get( options, 's', "" ),
+                      option_get( options, 'f', "" ), J, cout );
+        return 0;
+    }
+
+    /************************************************************
+    * Analyze
+    *************************************************************
+    * Like listing, this needs only the central directory. */
+    if( has_key( options, 'A' ) ) {
+        p_analyze( f, J, cout );
+        return 0;
+    }
+
+    /************************************************************
+    * Scaling benchmark
+    *************************************************************
+    * Extract with 1, 2, 4 ... up to the given number of threads
+    * (or "max" for all of the CPUs) and fit Amdahl's law. With
+    * "-d all" every built-in strategy is swept. */
+    if( has_key( options, 'S' ) ) {
+        string s = options['S'].get();
+        size_t max_jobs = ( s == "max" ) ? num_threads
+                                         : to_uint<size_t>( s );
+        vector<string> strategies;
+        if( strat == "all" )
+            for( auto const& p : distribute )
+                strategies.push_back( p.first );
+        else
+            strategies.push_back( strat );
+        p_bench_scaling( f, max_jobs, strategies, chunk, o,
+                         has_key( options, 'E' ), J, cout );
+        return 0;
+    }
+
+    /************************************************************
+    * Comparison benchmark
+    *************************************************************
+    * Run p-unzip (with the jobs, strategy and chunk size given)
+    * and the other extractors that are installed over the archive,
+    * or over synthetic archives of several shapes if it is given
+    * as "synthetic", the given number of times each. */
+    if( has_key( options, 'C' ) ) {
+        size_t reps = to_uint<size_t>( options['C'].get() );
+        p_bench_compare( f, reps, j, strat, chunk, o, J, cout );
+        return 0;
+    }
+
+    /************************************************************
+    * Inflate benchmark
+    *************************************************************
+    * Decompress the deflated entries of the archive in memory with
+    * each of the inflate backends that are built in, the  given
+    * number of times each. */
+    if( has_key( options, 'I' ) ) {
+        size_t reps = to_uint<size_t>( options['I'].get() );
+        p_bench_inflate( f, reps, chunk, J, cout );
+        return 0;
+    }
+
+    /************************************************************
+    * Simulate
+    *************************************************************
+    * A dry run: predict the wall time of each strategy under the
+    * given cost model, without extracting anything. */
+    if( has_key( options, 'n' ) ) {
+        auto model = cost_model( options['n'].get(), o );
+        print_simulations( simulate( f, j, model, strat ), J, cout );
+        return 0;
+    }
+
+    /************************************************************
+    * Zip
+    *************************************************************
+    * If the user has given a folder with -Z then we are creating
+    * the archive rather than extracting it. This uses the same
+    * threads, strategy and chunk size settings as extraction. */
+    if( has_key( options, 'Z' ) ) {
+        string m( option_get( options, 'm', "deflate" ) );
+        FAIL( m != "deflate" && m != "store",
+            "invalid compression method: " << m );
+        auto info = p_zip( f, options['Z'].get(), j, q, strat, chunk,
+            m == "store" ? ZIP_METHOD_STORE : ZIP_METHOD_DEFLATE, D );
+        if( g && J ) print_json( cerr, info );
+        else if( g ) cerr << info;
+        return 0;
+    }
+
     /************************************************************
     * Unzip
     *************************************************************
     * Do the unzip, and, if the user has requested so,  print  di-
     * agnostic info to stderr. */
-    auto info = p_unzip( f, j, q, o, strat, chunk, ts_xform, exts );
-    if( g ) cerr << info;
+    auto mode = T ? UnzipMode::test : UnzipMode::extract;
+    // The benchmark modes isolate decompression (null) and writing
+    // (write) from each other.
+    if( has_key( options, 'B' ) ) {
+        string b = options['B'].get();
+        FAIL( b != "null" && b != "write",
+            "invalid benchmark mode: " << b );
+        mode = ( b == "null" ) ? UnzipMode::null_sink
+                               : UnzipMode::write_only;
+    }
+    string e = option_get( options, 'e', "libzip" );
+    FAIL( e != "libzip" && e != "native", "invalid engine: " << e );
+    // libzip does its own inflating, so a backend would be ignored.
+    FAIL( has_key( options, 'i' ) && e != "native",
+        "an inflate backend (-i) can only be chosen with -e native" );
+    auto engine = e == "native" ? ZipEngine::native : ZipEngine::libzip;
+    auto plan   = inflate_plan( option_get( options, 'i', "auto" ) );
+    // Runs in the history are only compared with others that have
+    // the same settings. With --compare nothing is extracted; the
+    // exit code is 2 if the latest runs are significantly slower.
+    string settings =
+        history_settings( j, strat, chunk, mode, engine, plan );
+    FAIL( has_key( options, 'b' ) && !has_key( options, 'r' ),
+        "a baseline (-b) can only be given with -r" );
+    if( has_key( options, 'r' ) )
+        return compare_history( f, settings,
+            option_get( options, 'b', "" ), J, cout ) ? 2 : 0;
+    auto info = p_unzip(
+        f, j, q, o, strat, chunk, ts_xform, exts, mode, password,
+        option_get( options, 'k', "" ), R, engine, plan );
+    if( g && J ) print_json( cerr, info );
+    else if( g ) cerr << info;
+    if( use_profile )
+        update_profile( profile_id, info, chunk, strat );
+    if( H )
+        append_history( f, settings, info );
+
+    /************************************************************
+    * Test report
+    *************************************************************
+    * In test mode nothing has been written, so  the  only  useful
+    * output is the list of corrupt entries and a one-line verdict
+    * which goes to stdout. The exit code  is  nonzero if anything
+    * failed verification so that this can be used in scripts. */
+    if( T ) {
+        for( auto const& c : info.corrupt )
+            cout << "corrupt: " << c << endl;
+        auto ms = info.watch.milliseconds( "unzip" );
+        cout << info.files << " files tested, " << info.corrupt.size()
+             << " corrupt, " << human_bytes( info.bytes ) << " in "
+             << info.watch.human( "unzip" );
+        if( ms > 0 )
+            cout << " (" << human_bytes( info.bytes*1000/ms ) << "/s)";
+        cout << endl;
+        return info.corrupt.empty() ? 0 : 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,75 @@
+/****************************************************************
+* Memory accounting.
+****************************************************************/
+#include "config.hpp"
+#include "memory.hpp"
+
+#include <fstream>
+
+#ifdef OS_LINUX
+#   include <sys/resource.h>
+#   include <unistd.h>
+#endif
+
+using namespace std;
+
+char const* mem_tag_name( MemTag tag ) {
+    switch( tag ) {
+        case MemTag::buffers:      return "buffers";
+        case MemTag::metadata:     return "metadata";
+        case MemTag::distribution: return "distribution";
+        case MemTag::count:        break;
+    }
+    return "?";
+}
+
+MemCounter& mem_counter( MemTag tag ) {
+    static MemCounter counters[size_t( MemTag::count )];
+    return counters[size_t( tag )];
+}
+
+uint64_t current_rss() {
+#ifdef OS_LINUX
+    // The second field is the resident set size in pages.
+    ifstream in( "/proc/self/statm" );
+    uint64_t size = 0, resident = 0;
+    if( in >> size >> resident )
+        return resident*uint64_t( sysconf( _SC_PAGE_SIZE ) );
+#endif
+    return 0;
+}
+
+uint64_t peak_rss() {
+#ifdef OS_LINUX
+    // On Linux ru_maxrss is in kilobytes.
+    struct rusage ru;
+    if( getrusage( RUSAGE_SELF, &ru ) == 0 )
+        return uint64_t( ru.ru_maxrss )*1024;
+#endif
+    return 0;
+}
+
+/****************************************************************
+* MemoryStats
+****************************************************************/
+MemoryStats::MemoryStats()
+    : peak_rss( 0 ), archive( 0 ), chunks( 0 ), tag_peak()
+    , rss_deltas(), m_last_rss( 0 ) {}
+
+void MemoryStats::start() {
+    for( size_t i = 0; i < size_t( MemTag::count ); ++i )
+        mem_counter( MemTag( i ) ).reset_peak();
+    m_last_rss = current_rss();
+}
+
+void MemoryStats::step( string const& name ) {
+    uint64_t rss = current_rss();
+    rss_deltas.emplace_back( name, int64_t( rss ) - int64_t( m_last_rss ) );
+    m_last_rss = rss;
+}
+
+void MemoryStats::finish() {
+    for( size_t i = 0; i < size_t( MemTag::count ); ++i )
+        tag_peak[i] = mem_counter( MemTag( i ) ).peak;
+    peak_rss = ::peak_rss();
+}
@@ -0,0 +1,127 @@
+/****************************************************************
+* Memory accounting
+*****************************************************************
+* Two views of where the memory goes. From the outside, the resi-
+* dent set size (RSS) of the process as the kernel sees it, which
+* includes everything (libzip's allocations, the C runtime, etc.)
+* but can't say what it is for. From the inside, byte counts for
+* our own large allocations, kept by tagging them: Buffers count
+* themselves, and containers opt in by  using  CountingAllocator
+* with the tag of what they hold. The counters are atomic since
+* the workers allocate concurrently.
+****************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class MemTag {
+    // Buffer objects: the archive itself and the chunk buffers.
+    buffers,
+    // Tables of entry metadata (e.g., each Zip's ZipStats).
+    metadata,
+    // The lists of entries assigned to each thread.
+    distribution,
+    // Not a tag; this is the number of them.
+    count
+};
+
+char const* mem_tag_name( MemTag tag );
+
+/****************************************************************
+* MemCounter: bytes currently allocated under a tag, and the most
+* that there have been since the last reset.
+****************************************************************/
+struct MemCounter {
+    MemCounter() : current( 0 ), peak( 0 ) {}
+
+    void add( size_t bytes ) {
+        int64_t now = current += int64_t( bytes );
+        int64_t old = peak.load();
+        while( now > old && !peak.compare_exchange_weak( old, now ) )
+            ;
+    }
+    void sub( size_t bytes ) { current -= int64_t( bytes ); }
+    // Start measuring a new peak from the current level.
+    void reset_peak() { peak = current.load(); }
+
+    std::atomic<int64_t> current;
+    std::atomic<int64_t> peak;
+};
+
+MemCounter& mem_counter( MemTag tag );
+
+/****************************************************************
+* CountingAllocator: a std::allocator which keeps the counter for
+* the given tag up to date. Containers using it are  otherwise
+* the same as their standard counterparts, though note that they
+* are different types.
+****************************************************************/
+template<typename T, MemTag Tag>
+struct CountingAllocator : std::allocator<T> {
+
+    template<typename U>
+    struct rebind { using other = CountingAllocator<U, Tag>; };
+
+    CountingAllocator() {}
+    template<typename U>
+    CountingAllocator( CountingAllocator<U, Tag> const& ) {}
+
+    T* allocate( size_t n ) {
+        T* p = std::allocator<T>::allocate( n );
+        mem_counter( Tag ).add( n*sizeof( T ) );
+        return p;
+    }
+    void deallocate( T* p, size_t n ) {
+        mem_counter( Tag ).sub( n*sizeof( T ) );
+        std::allocator<T>::deallocate( p, n );
+    }
+};
+
+template<typename T, typename U, MemTag Tag>
+bool operator==( CountingAllocator<T, Tag> const&,
+                 CountingAllocator<U, Tag> const& ) { return true; }
+template<typename T, typename U, MemTag Tag>
+bool operator!=( CountingAllocator<T, Tag> const&,
+                 CountingAllocator<U, Tag> const& ) { return false; }
+
+// The current and peak (high water mark) resident set size of the
+// process in bytes. Zero where this can't be determined.
+uint64_t current_rss();
+uint64_t peak_rss();
+
+/****************************************************************
+* MemoryStats: memory figures for one run, for the summary.
+****************************************************************/
+struct MemoryStats {
+
+    MemoryStats();
+
+    // Peak RSS of the process at the end of the run.
+    uint64_t peak_rss;
+    // Sizes of the archive buffer and of all the chunk  buffers
+    // together.
+    uint64_t archive;
+    uint64_t chunks;
+    // Peak bytes under each tag during the run.
+    int64_t  tag_peak[size_t( MemTag::count )];
+    // Change in RSS over each step of the run, in order.
+    std::vector<std::pair<std::string, int64_t>> rss_deltas;
+
+    // Call at the start of the run; resets the tag peaks.
+    void start();
+    // Record the RSS change since the last step (or the start) as
+    // that of the named step.
+    void step( std::string const& name );
+    // Call at the end of the run to fill in the peaks.
+    void finish();
+
+private:
+    uint64_t m_last_rss;
+
+};
@@ -156,15 +156,36 @@ bool parse_impl( set<char> const&            options,
 /****************************************************************
 * Driver for options parsing.  This  is  what  to  call from main.
 ****************************************************************/
-bool parse( int              argc,
-            char**           argv,
-            set<char> const& options_all,
-            set<char> const& options_with_val,
-            opt_result&      res ) {
+bool parse( int               argc,
+            char**            argv,
+            set<char> const&  options_all,
+            set<char> const&  options_with_val,
+            long_names const& long_options,
+            opt_result&       res ) {
 
     vector<Arg> args;
-    for( int i = 1; i < argc; ++i )
-        args.push_back( Arg( argv[i] ) );
+    for( int i = 1; i < argc; ++i ) {
+        string s( argv[i] );
+        if( s.size() > 2 && s.compare( 0, 2, "--" ) == 0 ) {
+            // A long option: rewrite --name[=value] as -c[value].
+            auto eq = s.find( '=' );
+            string name( s, 2, eq == string::npos ? string::npos
+                                                  : eq-2 );
+            if( !has_key( long_options, name ) ) {
+                cerr << "error: option '--" << name
+                     << "' is not recognized." << endl;
+                return false;
+            }
+            string value( eq == string::npos ? "" : s.substr( eq+1 ) );
+            if( eq != string::npos && value.empty() ) {
+                cerr << "error: option '--" << name
+                     << "' must take a value." << endl;
+                return false;
+            }
+            s = string( "-" ) + long_options.at( name ) + value;
+        }
+        args.push_back( Arg( s.c_str() ) );
+    }
     FAIL_( args.size() != size_t(argc-1) );
     return parse_impl( options_all,
                        options_with_val,
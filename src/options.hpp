@@ -17,6 +17,9 @@ namespace options {
 using positional = std::vector<std::string>;
 using options    = std::map<char, Optional<std::string>>;
 using opt_result = std::pair<positional, options>;
+// Maps the name of a long option (without the leading dashes) onto
+// the single-character option that it is an alias for.
+using long_names = std::map<std::string, char>;
 
 // For convenience: this function  is  used  ONLY on options that
 // can  take  values,  and furthermore, it is assumed that all op-
@@ -31,12 +34,15 @@ std::string option_get( options& op, char  k,
                         std::string const& def );
 
 /****************************************************************
-* This does the full parsing of the arguments
+* This does the full parsing of the arguments. Long options, given
+* as --name or --name=value, are translated through `long_options`
+* into their single-character equivalents first.
 ****************************************************************/
 bool parse( int                   argc,
             char**                argv,
             std::set<char> const& options_all,
             std::set<char> const& options_with_val,
+            long_names const&     long_options,
             opt_result&           result );
 
 } // namespace options
@@ -0,0 +1,23 @@
+/****************************************************************
+* Per-thread phase timers.
+****************************************************************/
+#include "phases.hpp"
+
+char const* phase_name( Phase phase ) {
+    switch( phase ) {
+        case Phase::open:      return "open";
+        case Phase::inflate:   return "inflate";
+        case Phase::write:     return "write";
+        case Phase::timestamp: return "timestamp";
+        case Phase::rename:    return "rename";
+        case Phase::other:     return "other";
+        case Phase::idle:      return "idle";
+        case Phase::count:     break;
+    }
+    return "?";
+}
+
+PhaseTimes*& thread_phases() {
+    static thread_local PhaseTimes* times = nullptr;
+    return times;
+}
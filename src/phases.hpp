@@ -0,0 +1,106 @@
+/****************************************************************
+* Per-thread phase timers
+*****************************************************************
+* These break down where a worker thread's time goes (creating
+* files, inflating, writing, etc.). The code to be timed is wrapped
+* in a PhaseScope, which adds the time spent in it to the counters
+* of whichever thread is running it. The counters are reached
+* through a thread-local pointer, so there is no locking or sharing
+* between threads, and the code that is timed (e.g., Zip) needs no
+* extra parameters. When a thread has not set the pointer then the
+* scopes do nothing, so this can be left in code that is also used
+* where nobody is collecting the times.
+*
+* The clock is std::chrono::steady_clock, which is monotonic and,
+* on Linux, is read from the vDSO without a system call, so that
+* even timing each write of each chunk costs little.
+****************************************************************/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+enum class Phase {
+    // Creating and closing output files.
+    open,
+    // Decompressing (zip_fread).
+    inflate,
+    // Writing decompressed data to output files.
+    write,
+    // Setting the timestamps on extracted files.
+    timestamp,
+    // Renaming files from their temporary names.
+    rename,
+    // Anything else done by a worker: opening its own copy of the
+    // archive, logging, journaling and bookkeeping. Not timed di-
+    // rectly; this is what is left of the thread's running  time
+    // after the phases above.
+    other,
+    // Waiting at the end for the other threads to finish.
+    idle,
+    // Not a phase; this is the number of them.
+    count
+};
+
+// Short name of the phase for reports.
+char const* phase_name( Phase phase );
+
+/****************************************************************
+* PhaseTimes: nanoseconds spent in each phase by one thread.
+****************************************************************/
+struct PhaseTimes {
+    PhaseTimes() : ns() {}
+
+    uint64_t& operator[]( Phase p )       { return ns[size_t( p )]; }
+    uint64_t  operator[]( Phase p ) const { return ns[size_t( p )]; }
+
+    void merge( PhaseTimes const& o ) {
+        for( size_t i = 0; i < size_t( Phase::count ); ++i )
+            ns[i] += o.ns[i];
+    }
+
+    uint64_t total() const {
+        uint64_t res = 0;
+        for( auto n : ns ) res += n;
+        return res;
+    }
+
+    uint64_t ns[size_t( Phase::count )];
+};
+
+// The counters of the calling thread, or null if it is not col-
+// lecting them. A thread sets this to its own counters to start
+// collecting and must reset it before they go away.
+PhaseTimes*& thread_phases();
+
+/****************************************************************
+* PhaseScope: adds the time from construction to destruction to
+* the given phase of the calling thread's counters.
+****************************************************************/
+class PhaseScope {
+
+    using clock = std::chrono::steady_clock;
+
+public:
+    explicit PhaseScope( Phase phase )
+        : m_times( thread_phases() ), m_phase( phase ), m_start() {
+        if( m_times )
+            m_start = clock::now();
+    }
+
+    ~PhaseScope() {
+        if( m_times )
+            (*m_times)[m_phase] += uint64_t( std::chrono::duration_cast<
+                std::chrono::nanoseconds>( clock::now() - m_start )
+                .count() );
+    }
+
+    PhaseScope( PhaseScope const& )            = delete;
+    PhaseScope& operator=( PhaseScope const& ) = delete;
+
+private:
+    PhaseTimes*       m_times;
+    Phase             m_phase;
+    clock::time_point m_start;
+
+};
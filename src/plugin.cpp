@@ -0,0 +1,110 @@
+/****************************************************************
+* Loading of distribution strategies from shared objects.
+****************************************************************/
+#include "config.hpp"
+#include "macros.hpp"
+#include "plugin.hpp"
+#include "strategy_abi.h"
+
+#include <vector>
+
+#ifdef POSIX
+#   include <dlfcn.h>
+#else
+#   include <windows.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// Open the shared object (or DLL) and look up a symbol in it. The
+// handle is deliberately leaked so that the library stays loaded
+// for the life of the process.
+void* load_symbol( string const& path, string const& symbol ) {
+#ifdef POSIX
+    void* lib = dlopen( path.c_str(), RTLD_NOW | RTLD_LOCAL );
+    // dlerror clears the error when called, so grab it just once.
+    string why( lib ? "" : dlerror() );
+    FAIL( !lib, "failed to load plugin " << path << ": " << why );
+    return dlsym( lib, symbol.c_str() );
+#else
+    HMODULE lib = LoadLibraryA( path.c_str() );
+    FAIL( !lib, "failed to load plugin " << path );
+    return reinterpret_cast<void*>( GetProcAddress( lib, symbol.c_str() ) );
+#endif
+}
+
+// Call the plugin function and unflatten its output.
+index_lists call_plugin( punzip_strategy_fn func,
+                         size_t             threads,
+                         files_range const& files ) {
+    // Build the table. The names are packed into one pool which is
+    // filled first so that pointers into it remain valid.
+    string pool;
+    for( auto const& zs : files )
+        pool += zs.name();
+    vector<punzip_entry> entries;
+    entries.reserve( files.size() );
+    size_t off = 0;
+    for( auto const& zs : files ) {
+        punzip_entry e;
+        e.index      = zs.index();
+        e.size       = zs.size();
+        e.comp_size  = zs.comp_size();
+        e.cost       = entry_cost( zs );
+        e.mtime      = int64_t( zs.mtime() );
+        e.name_len   = uint32_t( zs.name().size() );
+        e.name       = pool.data() + off;
+        e.method     = zs.method();
+        e.encryption = zs.encryption();
+        off += e.name_len;
+        entries.push_back( e );
+    }
+    vector<uint64_t> idxs( entries.size() );
+    vector<uint64_t> counts( threads );
+    int rc = func( entries.data(), entries.size(), threads,
+                   idxs.data(), counts.data() );
+    FAIL( rc != 0, "strategy plugin failed with code " << rc );
+    index_lists thread_idxs( threads );
+    auto it = idxs.begin();
+    for( size_t i = 0; i < threads; ++i ) {
+        FAIL( counts[i] > uint64_t( idxs.end() - it ),
+            "strategy plugin returned too many indices" );
+        thread_idxs[i].assign( it, it + counts[i] );
+        it += counts[i];
+    }
+    return thread_idxs;
+}
+
+} // anon namespace
+
+distributor_t load_plugin_strategy( string const& spec ) {
+    // The function name is whatever follows the last colon, unless
+    // that looks like part of a path (e.g. "C:\plugins\x.dll").
+    string path = spec, symbol = "distribute";
+    auto colon = spec.rfind( ':' );
+    if( colon != string::npos &&
+        spec.find_first_of( "/\\", colon ) == string::npos ) {
+        path   = spec.substr( 0, colon );
+        symbol = spec.substr( colon+1 );
+    }
+    FAIL( path.empty() || symbol.empty(),
+        "invalid plugin strategy: " << spec );
+
+    auto version = reinterpret_cast<punzip_abi_version_fn>(
+        load_symbol( path, "punzip_abi_version" ) );
+    FAIL( !version, "plugin " << path << " does not export "
+        "punzip_abi_version" );
+    FAIL( version() != PUNZIP_ABI_VERSION, "plugin " << path <<
+        " was built for ABI version " << version() << " but this "
+        "is version " << PUNZIP_ABI_VERSION );
+
+    auto func = reinterpret_cast<punzip_strategy_fn>(
+        load_symbol( path, symbol ) );
+    FAIL( !func, "plugin " << path << " does not export " << symbol );
+
+    return [func]( size_t threads, files_range const& files ) {
+        return call_plugin( func, threads, files );
+    };
+}
@@ -0,0 +1,23 @@
+/****************************************************************
+* Loading of distribution strategies from shared objects. See
+* strategy_abi.h for the interface that the plugins implement.
+****************************************************************/
+#pragma once
+
+#include "distribution.hpp"
+
+#include <string>
+
+// Prefix of a strategy name which refers to a plugin.
+#define PLUGIN_PREFIX "plugin:"
+
+// Load a strategy from a shared object given a spec of the  form
+// "path" or "path:function", not including PLUGIN_PREFIX. The
+// function name defaults to "distribute". The library is never
+// unloaded. Will throw if the library cannot be loaded, the func-
+// tion is not found, or the plugin was built against a different
+// version of the ABI. The returned distributor converts the zip
+// entries into the plugin's table and its flattened output back
+// into index lists; it does not validate them (see  find_strategy
+// which does).
+distributor_t load_plugin_strategy( std::string const& spec );
@@ -0,0 +1,239 @@
+/****************************************************************
+* Persistent per-host performance profile.
+****************************************************************/
+#include "config.hpp"
+#include "fs.hpp"
+#include "macros.hpp"
+#include "profile.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef OS_LINUX
+#   include <sys/vfs.h>
+#endif
+#ifdef OS_OSX
+#   include <sys/mount.h>
+#endif
+#ifdef POSIX
+#   include <fcntl.h>
+#   include <sys/file.h>
+#   include <unistd.h>
+#else
+#   include <process.h>
+#endif
+
+using namespace std;
+
+string profile_folder() {
+    char const* xdg = getenv( "XDG_CACHE_HOME" );
+    if( xdg && *xdg )
+        return string( xdg ) + "/p-unzip";
+    char const* home = getenv( OS_SWITCH( "HOME", "LOCALAPPDATA" ) );
+    if( home && *home )
+        return string( home ) + OS_SWITCH( "/.cache", "" ) + "/p-unzip";
+    return "";
+}
+
+namespace {
+
+// Blend a new measurement into a decayed average; the first one
+// is taken as is.
+double blend( double old, double now, bool first ) {
+    return first ? now : old + PROFILE_DECAY*(now - old);
+}
+
+/****************************************************************
+* ProfileLock: holds an exclusive lock on the profile folder  for
+* as long as it lives, so that runs which finish at the same time
+* do not each read the profile, update it and then write it  over
+* the other's update. This is advisory (flock) and only  on  POSIX;
+* elsewhere, and if the lock can't be had, we go without.
+****************************************************************/
+class ProfileLock {
+
+public:
+    explicit ProfileLock( string const& folder ) : m_fd( -1 ) {
+#ifdef POSIX
+        if( folder.empty() )
+            return;
+        make_folders( folder );
+        string path = folder + "/profile.lock";
+        m_fd = open( path.c_str(), O_RDWR | O_CREAT, 0644 );
+        if( m_fd >= 0 )
+            while( flock( m_fd, LOCK_EX ) != 0 && errno == EINTR ) {}
+#else
+        (void)folder;
+#endif
+    }
+
+    ~ProfileLock() {
+#ifdef POSIX
+        // Closing the file releases the lock.
+        if( m_fd >= 0 )
+            close( m_fd );
+#endif
+    }
+
+    ProfileLock( ProfileLock const& )            = delete;
+    ProfileLock& operator=( ProfileLock const& ) = delete;
+
+private:
+    int m_fd;
+
+};
+
+// All the profiles in the file, by key.
+using Profiles = map<string, HostProfile>;
+
+Profiles load_all() {
+    Profiles res;
+    string folder = profile_folder();
+    if( folder.empty() )
+        return res;
+    ifstream in( folder + "/profile" );
+    string line;
+    while( getline( in, line ) ) {
+        if( line.empty() || line[0] == '#' )
+            continue;
+        istringstream ls( line );
+        string key, kind;
+        ls >> key >> kind;
+        HostProfile& p = res[key];
+        if( kind == "run" )
+            ls >> p.runs >> p.per_file_ns >> p.per_byte_ns;
+        else if( kind == "method" ) {
+            uint16_t m; double ns;
+            if( ls >> m >> ns )
+                p.method_ns[m] = ns;
+        } else if( kind == "config" ) {
+            HostProfile::Config c;
+            if( ls >> c.jobs >> c.chunk >> c.strategy >> c.score )
+                p.configs.push_back( c );
+        }
+        // Anything else is from some other version; skip it.
+    }
+    return res;
+}
+
+void save_all( Profiles const& profiles ) {
+    string folder = profile_folder();
+    FAIL( folder.empty(), "nowhere to save the profile; please "
+        "set XDG_CACHE_HOME" );
+    make_folders( folder );
+    ostringstream out;
+    out << "# p-unzip host profile: key kind values..." << endl;
+    for( auto const& kp : profiles ) {
+        auto const& key = kp.first;
+        auto const& p   = kp.second;
+        out << key << " run " << p.runs << " " << p.per_file_ns
+            << " " << p.per_byte_ns << endl;
+        for( auto const& m : p.method_ns )
+            out << key << " method " << m.first << " " << m.second
+                << endl;
+        for( auto const& c : p.configs )
+            out << key << " config " << c.jobs << " " << c.chunk
+                << " " << c.strategy << " " << c.score << endl;
+    }
+    // Write to the side and rename so that a concurrent run never
+    // sees a half written file. The name of the temporary is  our
+    // own, in case some run is writing without the lock.
+    string text = out.str();
+    string tmp  = folder + "/profile." +
+        to_string( OS_SWITCH( getpid, _getpid )() ) + ".tmp";
+    {
+        File f( tmp, "wb" );
+        f.write( text.data(), text.size() );
+    }
+    rename_file( tmp, folder + "/profile" );
+}
+
+} // anon namespace
+
+HostProfile::Config const* HostProfile::best() const {
+    Config const* res = nullptr;
+    for( auto const& c : configs )
+        if( !res || c.score > res->score )
+            res = &c;
+    return res;
+}
+
+string profile_key( string const& folder ) {
+    // Find the nearest part of the path that exists.
+    string path = folder.empty() ? "." : folder;
+    struct OS_SWITCH( stat, _stat64 ) st;
+    while( ::OS_SWITCH( stat, _stat64 )( path.c_str(), &st ) != 0 ) {
+        auto slash = path.find_last_of( "/\\" );
+        if( slash == string::npos ) { path = "."; continue; }
+        path = slash == 0 ? "/" : path.substr( 0, slash );
+    }
+    ostringstream key;
+#ifdef OS_LINUX
+    struct statfs fs;
+    if( statfs( path.c_str(), &fs ) == 0 )
+        key << "fs-" << hex << fs.f_type << dec << "-";
+#endif
+#ifdef OS_OSX
+    struct statfs fs;
+    if( statfs( path.c_str(), &fs ) == 0 )
+        key << "fs-" << fs.f_fstypename << "-";
+#endif
+    key << "dev-" << st.st_dev;
+    return key.str();
+}
+
+HostProfile load_profile( string const& key ) {
+    Profiles all = load_all();
+    return has_key( all, key ) ? all[key] : HostProfile();
+}
+
+void update_profile( string const&       key,
+                     UnzipSummary const& us,
+                     size_t              chunk,
+                     string const&       strategy ) {
+    ProfileLock lock( profile_folder() );
+    Profiles all = load_all();
+    HostProfile& p = all[key];
+    bool first = ( p.runs == 0 );
+
+    // Fixed and per-byte costs, straight from the fit.
+    if( us.fit.n > 0 ) {
+        p.per_file_ns = blend( p.per_file_ns, us.fit.per_file(), first );
+        p.per_byte_ns = blend( p.per_byte_ns, us.fit.per_byte(), first );
+    }
+    // The cost of each method is what is left of its time after the
+    // fixed cost of its files is taken off, per byte.
+    for( auto const& mp : us.methods ) {
+        EntryStats const& m = mp.second;
+        if( m.bytes == 0 )
+            continue;
+        double rest = double( m.nanoseconds ) - m.files*p.per_file_ns;
+        double ns   = max( rest, 0.0 ) / double( m.bytes );
+        bool   none = !has_key( p.method_ns, mp.first );
+        p.method_ns[mp.first] = blend( p.method_ns[mp.first], ns, none );
+    }
+    // Score this combination of settings.
+    double wall = double( us.watch.milliseconds( "unzip" ) ) * 1e6;
+    // (The file is whitespace separated, so a plugin strategy with a
+    // space in its path can't be recorded.)
+    if( wall > 0 && strategy.find_first_of( " \t" ) == string::npos ) {
+        double work  = us.files*p.per_file_ns + us.bytes*p.per_byte_ns;
+        double score = work / wall;
+        HostProfile::Config* found = nullptr;
+        for( auto& c : p.configs )
+            if( c.jobs == us.jobs_used && c.chunk == chunk &&
+                c.strategy == strategy )
+                found = &c;
+        if( found )
+            found->score = blend( found->score, score, false );
+        else
+            p.configs.push_back( HostProfile::Config{
+                us.jobs_used, chunk, strategy, score } );
+    }
+    p.runs++;
+    save_all( all );
+}
@@ -0,0 +1,78 @@
+/****************************************************************
+* Persistent per-host performance profile
+*****************************************************************
+* How fast a machine can create files and write bytes depends mostly
+* on the file system being written to, which does not change from
+* run to run. So, optionally, what each run measures is recorded in
+* a small text file under $XDG_CACHE_HOME (or ~/.cache) keyed by
+* the type and device of the output file system, and later runs use
+* it to choose the number of jobs, the strategy and the chunk size
+* without having to be told. Each measurement is blended into what
+* is already there with an exponentially decayed average so  that
+* the profile follows changes to the machine  without  jumping
+* around on one noisy run.
+****************************************************************/
+#pragma once
+
+#include "unzip.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Weight given to each new measurement in the decayed averages.
+#define PROFILE_DECAY 0.25
+
+/****************************************************************
+* HostProfile
+****************************************************************/
+struct HostProfile {
+    HostProfile() : runs( 0 ), per_file_ns( 0 ), per_byte_ns( 0 ) {}
+
+    // One combination of settings that has been run, and how well
+    // it did. The score is the estimated single-thread time of the
+    // work done (from the costs below) divided by the wall time, so
+    // it is comparable across archives of different makeup.
+    struct Config {
+        size_t      jobs;
+        size_t      chunk;
+        std::string strategy;
+        double      score;
+    };
+
+    // Number of runs that have been recorded.
+    uint64_t                 runs;
+    // Fixed cost of creating a file and cost of writing a byte, as
+    // measured by one thread while the others are also running.
+    double                   per_file_ns;
+    double                   per_byte_ns;
+    // Cost per uncompressed byte of each compression method (not
+    // including the fixed per-file cost).
+    std::map<uint16_t, double> method_ns;
+    std::vector<Config>      configs;
+
+    // The config with the best score, or null if there are none.
+    Config const* best() const;
+};
+
+// Folder in which the profile (and the history, see history.hpp)
+// is kept, or empty if we have nowhere to keep it.
+std::string profile_folder();
+
+// The key for the file system holding `folder` (or, if it does
+// not exist yet, its nearest existing parent).
+std::string profile_key( std::string const& folder );
+
+// Load the profile for the given key; it is empty if there is none.
+HostProfile load_profile( std::string const& key );
+
+// Blend the results of a run with the given settings into the
+// profile for the given key and save it. Other keys in  the  file
+// are preserved, and the file is locked while it is updated, so
+// runs that finish together don't lose each other's updates. Will
+// throw if the profile cannot be written.
+void update_profile( std::string const&  key,
+                     UnzipSummary const& summary,
+                     size_t              chunk,
+                     std::string const&  strategy );
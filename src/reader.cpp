@@ -0,0 +1,204 @@
+/****************************************************************
+* Native zip reader.
+****************************************************************/
+#include "directory.hpp"
+#include "macros.hpp"
+#include "phases.hpp"
+#include "reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+uint32_t const SIG_LOCAL  = 0x04034b50;
+size_t   const LOCAL_SIZE = 30;
+
+// General purpose flags which mean that the entry needs libzip:
+// encryption (traditional or AES), patched data and strong encryp-
+// tion.
+uint16_t const FLAG_ENCRYPTED = 0x0001;
+uint16_t const FLAG_PATCHED   = 0x0020;
+uint16_t const FLAG_STRONG    = 0x0040;
+
+uint16_t u16( uint8_t const* p ) { return uint16_t( p[0] | (p[1] << 8) ); }
+uint32_t u32( uint8_t const* p ) {
+    return uint32_t( u16( p ) ) | (uint32_t( u16( p+2 ) ) << 16);
+}
+
+} // anon namespace
+
+/****************************************************************
+* NativeArchive
+****************************************************************/
+shared_ptr<NativeArchive const> NativeArchive::open(
+        Buffer::SP const& zip, string& why, InflatePlan const& plan ) {
+    // Anything that we can't parse might still be something  that
+    // libzip can make sense of (e.g., with data in front of it).
+    unique_ptr<Directory> dir;
+    try {
+        dir.reset( new Directory( *zip ) );
+    } catch( exception const& e ) {
+        why = e.what();
+        return nullptr;
+    }
+    shared_ptr<NativeArchive> res( new NativeArchive( zip, plan ) );
+    auto     base = static_cast<uint8_t const*>( zip->get() );
+    uint64_t size = zip->size();
+
+    // Check every entry, including its local header,  before  we
+    // commit to reading any of them ourselves.
+    res->m_data.reserve( dir->size() );
+    for( size_t i = 0; i < dir->size(); ++i ) {
+        DirEntry const& e = (*dir)[i];
+        // Only made when there is an error to report.
+        auto entry = [i]{ return "entry " + to_string( i ); };
+        if( e.flags & (FLAG_ENCRYPTED | FLAG_PATCHED | FLAG_STRONG) ) {
+            why = entry() + " is encrypted or patched";
+            return nullptr;
+        }
+        if( e.method != ZIP_METHOD_STORE &&
+            e.method != ZIP_METHOD_DEFLATE ) {
+            why = entry() + " uses " + method_name( e.method );
+            return nullptr;
+        }
+        if( e.offset > size || size - e.offset < LOCAL_SIZE ) {
+            why = entry() + " has no local header";
+            return nullptr;
+        }
+        // The sizes and CRC in the local header may be zero  (if
+        // they follow the data) so only the rest is compared.
+        uint8_t const* local = base + e.offset;
+        uint16_t name_len  = u16( local+26 );
+        uint16_t extra_len = u16( local+28 );
+        uint64_t data = e.offset + LOCAL_SIZE + name_len + extra_len;
+        if( u32( local ) != SIG_LOCAL || u16( local+8 ) != e.method ||
+            name_len != e.name_len || data > size ||
+            memcmp( local+LOCAL_SIZE, dir->name_data( i ),
+                    name_len ) != 0 ) {
+            why = entry() + " has a local header which does not match "
+                  "the central directory";
+            return nullptr;
+        }
+        if( e.comp_size > size - data ) {
+            why = entry() + " runs past the end of the archive";
+            return nullptr;
+        }
+        res->m_data.push_back( data );
+    }
+
+    res->m_stats = directory_stats( *dir, res->m_names );
+    return res;
+}
+
+Zip::stats_vector directory_stats( Directory const& dir,
+                                   string&          names ) {
+    // The stats point into the names, so these must all be in place
+    // before the first stat is made.
+    size_t total = 0;
+    for( size_t i = 0; i < dir.size(); ++i )
+        total += dir[i].name_len + 1;
+    names.clear();
+    names.reserve( total );
+    for( size_t i = 0; i < dir.size(); ++i ) {
+        names.append( dir.name_data( i ), dir[i].name_len );
+        names.push_back( 0 );
+    }
+    Zip::stats_vector res;
+    res.reserve( dir.size() );
+    char const* name = names.data();
+    for( size_t i = 0; i < dir.size(); ++i ) {
+        DirEntry const& e = dir[i];
+        zip_stat_t st;
+        zip_stat_init( &st );
+        st.valid = ZIP_STAT_NAME  | ZIP_STAT_INDEX | ZIP_STAT_SIZE  |
+                   ZIP_STAT_COMP_SIZE   | ZIP_STAT_MTIME |
+                   ZIP_STAT_CRC   | ZIP_STAT_COMP_METHOD |
+                   ZIP_STAT_ENCRYPTION_METHOD;
+        st.name              = name;
+        st.index             = i;
+        st.size              = e.size;
+        st.comp_size         = e.comp_size;
+        st.mtime             = dir.mtime( i );
+        st.crc               = e.crc;
+        st.comp_method       = e.method;
+        st.encryption_method = ZIP_EM_NONE;
+        res.emplace_back( st );
+        name += e.name_len + 1;
+    }
+    return res;
+}
+
+bool NativeArchive::read( uint64_t    idx,
+                          Inflater&   inflater,
+                          Buffer&     buf,
+                          Sink const& sink,
+                          string&     why ) const {
+    FAIL_( idx >= m_stats.size() || buf.size() == 0 );
+    ZipStat const& zs = m_stats[size_t( idx )];
+    auto     in   = static_cast<uint8_t const*>( m_zip->get() ) +
+                    m_data[size_t( idx )];
+    uint64_t size = zs.size();
+    uint32_t crc  = 0;
+
+    if( zs.method() == ZIP_METHOD_STORE ) {
+        if( zs.comp_size() != size ) {
+            why = "stored entry with compressed size " +
+                  to_string( zs.comp_size() ) + " but size " +
+                  to_string( size );
+            return false;
+        }
+        // No need to copy: the data is already in memory as it is.
+        for( uint64_t total = 0; total < size; ) {
+            size_t n = size_t( min<uint64_t>( size - total, buf.size() ) );
+            {
+                PhaseScope timer( Phase::inflate );
+                crc = inflate_crc32( crc, in+total, n );
+            }
+            sink( in+total, n );
+            total += n;
+        }
+    } else if( !inflater.inflate( in, zs.comp_size(), size, buf, sink,
+                                  crc, why ) )
+        return false;
+    if( crc != zs.crc() ) {
+        why = "CRC mismatch";
+        return false;
+    }
+    return true;
+}
+
+bool NativeArchive::read_into( uint64_t  idx,
+                               Inflater& inflater,
+                               void*     dest,
+                               string&   why ) const {
+    FAIL_( idx >= m_stats.size() );
+    ZipStat const& zs = m_stats[size_t( idx )];
+    auto     in   = static_cast<uint8_t const*>( m_zip->get() ) +
+                    m_data[size_t( idx )];
+    uint64_t size = zs.size();
+    uint32_t crc  = 0;
+
+    if( zs.method() == ZIP_METHOD_STORE ) {
+        if( zs.comp_size() != size ) {
+            why = "stored entry with compressed size " +
+                  to_string( zs.comp_size() ) + " but size " +
+                  to_string( size );
+            return false;
+        }
+        FAIL_( size > numeric_limits<size_t>::max() );
+        PhaseScope timer( Phase::inflate );
+        memcpy( dest, in, size_t( size ) );
+        crc = inflate_crc32( crc, in, size_t( size ) );
+    } else if( !inflater.inflate_into( in, zs.comp_size(), size, dest,
+                                       crc, why ) )
+        return false;
+    if( crc != zs.crc() ) {
+        why = "CRC mismatch";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+/****************************************************************
+* Native zip reader
+*****************************************************************
+* A reader for the common case which bypasses libzip on the  hot
+* path. The central directory is parsed once, straight out of the
+* archive buffer (see directory.hpp), and the result  is  shared
+* by all of the threads instead of each one opening the  archive
+* again. The local header of each entry is checked against the
+* central directory up front, and stored and deflated entries are
+* then read straight out of the buffer: stored data is handed over
+* without being copied, and each thread reuses one inflate state
+* for all of its entries instead of allocating one per entry. The
+* deflated data is decompressed with the fastest backend that  is
+* built in (see inflate.hpp).
+*
+* Anything less common (other compression methods, encryption,
+* patched data, or local headers which do not agree with the cen-
+* tral directory) is left to libzip: NativeArchive::open refuses
+* such archives and says why, and the caller falls back.
+****************************************************************/
+#pragma once
+
+#include "directory.hpp"
+#include "inflate.hpp"
+#include "zip.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/****************************************************************
+* NativeArchive
+****************************************************************/
+class NativeArchive {
+
+public:
+    // Parse the archive in the buffer. Returns null, with the reason
+    // in `why`, if it uses anything that needs libzip. Will throw if
+    // the archive is malformed. The Inflaters used to read it should
+    // follow `plan`.
+    static std::shared_ptr<NativeArchive const> open(
+        Buffer::SP const&  zip,
+        std::string&       why,
+        InflatePlan const& plan = best_inflate_plan() );
+
+    InflatePlan const& plan() const { return m_plan; }
+
+    // The entries, as libzip would describe them. The names live as
+    // long as this object.
+    Zip::stats_vector const& stats() const { return m_stats; }
+
+    // Called with each piece of the uncompressed data of an entry.
+    using Sink = Inflater::Sink;
+
+    // Decompress an entry in pieces of at most buf.size() bytes and
+    // pass each to `sink`. Stored data is passed straight from the
+    // archive in pieces of the same size, without using `buf`. The
+    // size and CRC are checked at the end. Returns false, with the
+    // reason in `why`, if the data is bad; the sink may already have
+    // been given some of it. Exceptions from the sink go through.
+    bool read( uint64_t     idx,
+               Inflater&    inflater,
+               Buffer&      buf,
+               Sink const&  sink,
+               std::string& why ) const;
+
+    // Decompress an entry straight into `dest`, which must have room
+    // for all of it, with the same checks. Stored data is copied.
+    bool read_into( uint64_t     idx,
+                    Inflater&    inflater,
+                    void*        dest,
+                    std::string& why ) const;
+
+private:
+    NativeArchive( Buffer::SP const& zip, InflatePlan const& plan )
+        : m_zip( zip ), m_plan( plan ) {}
+
+    Buffer::SP            m_zip;
+    InflatePlan           m_plan;
+    Zip::stats_vector     m_stats;
+    // Names of the entries, each followed by a null.
+    std::string           m_names;
+    // Offset in the archive of the data of each entry.
+    std::vector<uint64_t> m_data;
+
+};
+
+// The entries of a central directory, as libzip would describe them
+// (except that they are never marked as encrypted). Their names
+// point into `names`, which this fills in and which must outlive
+// them and not be modified.
+Zip::stats_vector directory_stats( Directory const& dir,
+                                   std::string&     names );
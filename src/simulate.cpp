@@ -0,0 +1,145 @@
+/****************************************************************
+* Scheduler simulator.
+****************************************************************/
+#include "directory.hpp"
+#include "distribution.hpp"
+#include "reader.hpp"
+#include "simulate.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+
+using namespace std;
+
+// Per entry cost: the fixed part plus the size at the method's rate.
+double CostModel::cost( ZipStat const& zs ) const {
+    auto m = method_ns.find( zs.method() );
+    double per_byte = ( m != method_ns.end() )
+                    ? m->second
+                    : per_byte_ns*method_cost( zs.method() );
+    return per_file_ns + per_byte*double( zs.size() );
+}
+
+CostModel cost_model( string const& spec, string const& output ) {
+    CostModel m;
+    if( spec == "default" ) {
+        // About 20us to create a file and 2ns per byte (500 MB/s)
+        // to inflate and write deflated data.
+        m.per_file_ns = 20000;
+        m.per_byte_ns = 2;
+    } else if( spec == "profile" ) {
+        HostProfile p = load_profile( profile_key( output ) );
+        FAIL( p.runs == 0, "there is no profile for the output file "
+            "system yet; run with -p first" );
+        m.per_file_ns = p.per_file_ns;
+        m.per_byte_ns = p.per_byte_ns;
+        m.method_ns   = p.method_ns;
+    } else {
+        char tail;
+        FAIL( sscanf( spec.c_str(), "%lf,%lf%c", &m.per_file_ns,
+                      &m.per_byte_ns, &tail ) != 2 ||
+              m.per_file_ns < 0 || m.per_byte_ns < 0,
+            "invalid cost model: " << spec );
+    }
+    return m;
+}
+
+vector<Simulation> simulate( string const&    filename,
+                             size_t           jobs,
+                             CostModel const& model,
+                             string const&    extra ) {
+    FAIL( jobs < 1, "invalid number of jobs: " << jobs );
+    // Only the central directory is needed, so read just that and
+    // not the whole archive. Then order the entries as p_unzip does,
+    // folders first.
+    Directory dir = Directory::load( filename );
+    string    pool;
+    auto      all = directory_stats( dir, pool );
+    vector<ZipStat> stats( all.begin(), all.end() );
+    auto folders_end = partition( stats.begin(), stats.end(),
+        []( ZipStat const& zs ){ return zs.is_folder(); });
+    auto files = make_range( folders_end, stats.end() );
+
+    // The cost of each entry, by index, computed once.
+    vector<double> cost( dir.size(), 0 );
+    for( auto const& zs : files )
+        cost[zs.index()] = model.cost( zs );
+    double total = accumulate( cost.begin(), cost.end(), 0.0 );
+
+    vector<string> names;
+    for( auto const& p : distribute )
+        names.push_back( p.first );
+    if( !extra.empty() && !has_key( distribute, extra ) )
+        names.push_back( extra );
+
+    vector<Simulation> res;
+    for( auto const& name : names ) {
+        Simulation sim;
+        sim.strategy = name;
+        auto start = chrono::steady_clock::now();
+        index_lists lists = find_strategy( name )( jobs, files );
+        sim.distribute_ns = uint64_t( chrono::duration_cast<
+            chrono::nanoseconds>( chrono::steady_clock::now()
+                                  - start ).count() );
+        for( auto const& l : lists ) {
+            double load = 0;
+            for( auto idx : l )
+                load += cost[idx];
+            sim.loads.push_back( load );
+        }
+        sim.makespan  = *max_element( sim.loads.begin(),
+                                      sim.loads.end() );
+        double ideal  = total / double( jobs );
+        sim.imbalance = ideal > 0 ? sim.makespan/ideal - 1 : 0;
+        res.push_back( sim );
+    }
+    stable_sort( res.begin(), res.end(),
+        []( Simulation const& l, Simulation const& r ) {
+            return l.makespan < r.makespan;
+        } );
+    return res;
+}
+
+void print_simulations( vector<Simulation> const& sims,
+                        bool json, ostream& out ) {
+    char buf[256];
+    if( !json ) {
+        snprintf( buf, sizeof( buf ), "%-16s %12s %12s %10s %12s\n",
+            "strategy", "makespan", "min thread", "imbalance",
+            "distribute" );
+        out << buf;
+    }
+    for( auto const& s : sims ) {
+        double lo = *min_element( s.loads.begin(), s.loads.end() );
+        if( json ) {
+            out << "{\"strategy\":\"" << s.strategy << "\",";
+            snprintf( buf, sizeof( buf ), "\"makespan_ms\":%.3f,"
+                "\"imbalance\":%.4f,\"distribute_ms\":%.3f,"
+                "\"loads_ms\":[", s.makespan/1e6, s.imbalance,
+                s.distribute_ns/1e6 );
+            out << buf;
+            for( size_t i = 0; i < s.loads.size(); ++i ) {
+                snprintf( buf, sizeof( buf ), "%s%.3f", i ? "," : "",
+                          s.loads[i]/1e6 );
+                out << buf;
+            }
+            out << "]}\n";
+        } else {
+            snprintf( buf, sizeof( buf ),
+                "%-16s %12s %12s %9.1f%% %12s\n", s.strategy.c_str(),
+                human_duration( uint64_t( s.makespan ) ).c_str(),
+                human_duration( uint64_t( lo ) ).c_str(),
+                100*s.imbalance,
+                human_duration( s.distribute_ns ).c_str() );
+            out << buf;
+        }
+    }
+    if( sims.empty() )
+        return;
+    if( json )
+        out << "{\"best\":\"" << sims[0].strategy << "\"}\n";
+    else
+        out << "best: " << sims[0].strategy << endl;
+}
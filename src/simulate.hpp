@@ -0,0 +1,74 @@
+/****************************************************************
+* Scheduler simulator
+*****************************************************************
+* This predicts how long an extraction would take with each of the
+* distribution strategies without extracting anything. Each stra-
+* tegy is run on the archive's entries exactly as p_unzip would run
+* it, and then the time that each thread would take is estimated
+* by adding up the cost of its entries under a cost model. Since
+* the threads run independently once the entries are  distributed,
+* the slowest thread's total is the predicted makespan.
+****************************************************************/
+#pragma once
+
+#include "profile.hpp"
+#include "zip.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/****************************************************************
+* CostModel: how long it takes one thread to extract an entry.
+****************************************************************/
+struct CostModel {
+    // Fixed cost per file and cost per uncompressed byte.
+    double per_file_ns;
+    double per_byte_ns;
+    // Cost per byte of specific methods; for any method  not  here
+    // per_byte_ns is scaled by method_cost.
+    std::map<uint16_t, double> method_ns;
+
+    // Estimated nanoseconds to extract the entry.
+    double cost( ZipStat const& zs ) const;
+};
+
+// Make a cost model from a spec which is one of:
+//   default      : rough figures for a local SSD.
+//   profile      : the host profile for the given output folder.
+//   <file>,<byte>: per file and per byte costs in nanoseconds.
+// Will throw if the spec is invalid or there is no profile.
+CostModel cost_model( std::string const& spec,
+                      std::string const& output );
+
+/****************************************************************
+* Result of simulating one strategy.
+****************************************************************/
+struct Simulation {
+    std::string         strategy;
+    // Predicted busy time of each thread, in nanoseconds.
+    std::vector<double> loads;
+    // Largest of the loads, i.e., the predicted wall time.
+    double              makespan;
+    // How much longer the makespan is than a perfect split, e.g.
+    // 0.1 means 10% over.
+    double              imbalance;
+    // Time taken to run the strategy itself.
+    uint64_t            distribute_ns;
+};
+
+// Simulate every registered strategy, plus `extra` if it is not
+// empty and not one of them (e.g., a plugin), for an extraction
+// of `filename` with `jobs` threads. The results are sorted from
+// best (smallest makespan) to worst.
+std::vector<Simulation> simulate( std::string const& filename,
+                                  size_t             jobs,
+                                  CostModel const&   model,
+                                  std::string const& extra );
+
+// Write out the results as a table, or as JSON lines (one object
+// per strategy and then one naming the best).
+void print_simulations( std::vector<Simulation> const& sims,
+                        bool json, std::ostream& out );
@@ -0,0 +1,97 @@
+/****************************************************************
+* Distribution strategy plugin ABI
+*****************************************************************
+* This header is meant to be included by  third-party  strategy
+* plugins, so it is plain C and depends on nothing else in p-unzip.
+* A plugin is a shared object exporting one or more functions of
+* type punzip_strategy_fn along with punzip_abi_version. It  is
+* selected on the command line with:
+*
+*     -d plugin:/path/to/lib.so:function_name
+*
+* where function_name defaults to "distribute" if  omitted.  A
+* minimal plugin which puts all *.pak files on thread zero and
+* spreads the rest cyclically over the others might look like:
+*
+*     #include "strategy_abi.h"
+*     #include <string.h>
+*
+*     PUNZIP_DEFINE_ABI_VERSION
+*
+*     PUNZIP_EXPORT int distribute(
+*             punzip_entry const* entries, uint64_t count,
+*             uint64_t threads, uint64_t* idxs, uint64_t* counts ) {
+*         uint64_t i, n = 0, next = 0;
+*         for( i = 0; i < count; ++i ) {
+*             punzip_entry const* e = &entries[i];
+*             int pak = e->name_len >= 4 && !memcmp(
+*                 e->name + e->name_len - 4, ".pak", 4 );
+*             ... // fill idxs thread by thread, and counts
+*         }
+*         return 0;
+*     }
+*
+* The output is  flattened  so  that  no  memory  crosses  the
+* boundary: the plugin writes the entry indices (the `index` field,
+* not the position in the table) assigned to thread zero, then
+* those for thread one, etc., into `idxs`, which has room for ex-
+* actly `count` of them, and the number given to  each  thread
+* into `counts`, which has `threads` elements. Every entry must be
+* assigned exactly once; p-unzip checks this and will refuse the
+* result otherwise. Return zero on success and nonzero on failure.
+*
+* The ABI version must be bumped whenever anything in this file
+* changes incompatibly.
+****************************************************************/
+#ifndef PUNZIP_STRATEGY_ABI_H
+#define PUNZIP_STRATEGY_ABI_H
+
+#include <stdint.h>
+
+#define PUNZIP_ABI_VERSION 1
+
+#ifdef _WIN32
+#   define PUNZIP_EXPORT __declspec( dllexport )
+#else
+#   define PUNZIP_EXPORT __attribute__(( visibility( "default" ) ))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One file entry in the archive (folders are never  passed  to
+ * strategies). The name is not null terminated, and it and  the
+ * table are only valid for the duration of the call. */
+typedef struct punzip_entry {
+    uint64_t    index;      /* Index of the entry in the archive. */
+    uint64_t    size;       /* Uncompressed size.                 */
+    uint64_t    comp_size;  /* Compressed size.                   */
+    uint64_t    cost;       /* Estimated cost as used by "cost".  */
+    int64_t     mtime;      /* Last mod time (as stored, local).  */
+    char const* name;       /* Full path in the archive.          */
+    uint32_t    name_len;
+    uint16_t    method;     /* Compression method number.         */
+    uint16_t    encryption; /* Encryption method; zero if none.   */
+} punzip_entry;
+
+typedef int (*punzip_strategy_fn)( punzip_entry const* entries,
+                                   uint64_t            count,
+                                   uint64_t            threads,
+                                   uint64_t*           idxs,
+                                   uint64_t*           counts );
+
+/* Every plugin must export this, returning PUNZIP_ABI_VERSION as
+ * it was when the plugin was compiled. */
+typedef uint32_t (*punzip_abi_version_fn)( void );
+
+#define PUNZIP_DEFINE_ABI_VERSION                              \
+    PUNZIP_EXPORT uint32_t punzip_abi_version( void ) {        \
+        return PUNZIP_ABI_VERSION;                             \
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,416 @@
+/****************************************************************
+* Information about the machine that we are running on.
+****************************************************************/
+#include "config.hpp"
+#include "macros.hpp"
+#include "sys.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef OS_LINUX
+#   include <sched.h>
+#endif
+
+#ifdef POSIX
+#   include <fcntl.h>
+#   include <sys/resource.h>
+#   include <sys/wait.h>
+#   include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+#ifdef OS_LINUX
+
+// Read the first line of a file; empty if it cannot be read.
+string first_line( string const& path ) {
+    ifstream in( path );
+    string line;
+    getline( in, line );
+    return line;
+}
+
+// The cgroup paths of this process, as (controllers, path) pairs
+// from /proc/self/cgroup. For cgroup v2 the controllers are empty.
+vector<pair<string, string>> own_cgroups() {
+    vector<pair<string, string>> res;
+    ifstream in( "/proc/self/cgroup" );
+    string line;
+    while( getline( in, line ) ) {
+        // Lines look like "hierarchy-id:controllers:path".
+        auto a = line.find( ':' );
+        auto b = line.find( ':', a == string::npos ? a : a+1 );
+        if( a == string::npos || b == string::npos )
+            continue;
+        res.emplace_back( line.substr( a+1, b-a-1 ),
+                          line.substr( b+1 ) );
+    }
+    return res;
+}
+
+// Candidate folders in which to look for the settings of our own
+// cgroup, most specific first. Inside a container the cgroup path
+// in /proc/self/cgroup is usually that of the container on the host
+// and the container's own cgroup is mounted at the root, so  both
+// that path and each of its parents are tried.
+vector<string> cgroup_dirs( string const& mount, string path ) {
+    vector<string> res;
+    while( true ) {
+        res.push_back( mount + path );
+        if( path.empty() || path == "/" )
+            break;
+        auto slash = path.rfind( '/' );
+        path = path.substr( 0, slash == string::npos ? 0 : slash );
+    }
+    return res;
+}
+
+// Does a comma separated list of cgroup v1 controllers contain c.
+bool has_controller( string const& list, string const& c ) {
+    istringstream in( list );
+    string item;
+    while( getline( in, item, ',' ) )
+        if( item == c )
+            return true;
+    return false;
+}
+
+// The CPU bandwidth limit of our cgroup, in CPUs, or zero if there
+// is none. cgroup v2 has "quota period" (or "max period") in
+// cpu.max while v1 has the two values in separate files; a quota
+// of -1 there means no limit. A limit on any ancestor applies to
+// us as well, so this is the tightest one of our cgroup and all of
+// its ancestors: the leaf itself often has no limit of its own.
+double cpu_quota() {
+    double res = 0;
+    auto tighten = [&res]( double q ) {
+        if( q > 0 && (res == 0 || q < res) )
+            res = q;
+    };
+    for( auto const& cg : own_cgroups() ) {
+        if( cg.first.empty() ) {
+            for( auto const& dir : cgroup_dirs( "/sys/fs/cgroup",
+                                                cg.second ) ) {
+                istringstream in( first_line( dir + "/cpu.max" ) );
+                string quota; double period = 0;
+                if( !(in >> quota >> period) )
+                    continue;
+                if( quota == "max" || period <= 0 )
+                    continue;
+                tighten( stod( quota ) / period );
+            }
+        } else if( has_controller( cg.first, "cpu" ) ) {
+            for( auto mount : { "/sys/fs/cgroup/cpu,cpuacct",
+                                "/sys/fs/cgroup/cpu" } ) {
+                for( auto const& dir : cgroup_dirs( mount,
+                                                    cg.second ) ) {
+                    string quota  = first_line( dir + "/cpu.cfs_quota_us"  );
+                    string period = first_line( dir + "/cpu.cfs_period_us" );
+                    if( quota.empty() || period.empty() )
+                        continue;
+                    double q = stod( quota ), p = stod( period );
+                    if( q > 0 && p > 0 )
+                        tighten( q / p );
+                }
+            }
+        }
+    }
+    return res;
+}
+
+// The memory limit of our cgroup in bytes, or zero if none. As with
+// the CPU quota this is the tightest limit of our cgroup and all of
+// its ancestors.
+uint64_t memory_limit() {
+    uint64_t res = 0;
+    for( auto const& cg : own_cgroups() ) {
+        vector<string> files;
+        if( cg.first.empty() )
+            for( auto const& dir : cgroup_dirs( "/sys/fs/cgroup",
+                                                cg.second ) )
+                files.push_back( dir + "/memory.max" );
+        else if( has_controller( cg.first, "memory" ) )
+            for( auto const& dir : cgroup_dirs( "/sys/fs/cgroup/memory",
+                                                cg.second ) )
+                files.push_back( dir + "/memory.limit_in_bytes" );
+        for( auto const& f : files ) {
+            string limit = first_line( f );
+            // v2 reports "no limit" as "max", v1 as a huge number,
+            // which is only the tightest if no level has a limit.
+            if( limit.empty() || limit == "max" )
+                continue;
+            uint64_t l = stoull( limit );
+            if( l > 0 && (res == 0 || l < res) )
+                res = l;
+        }
+    }
+    return res;
+}
+
+#endif
+
+size_t find_effective_cpus() {
+    size_t cpus = max( thread::hardware_concurrency(), 1u );
+#ifdef OS_LINUX
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    if( sched_getaffinity( 0, sizeof( set ), &set ) == 0 )
+        cpus = min( cpus, size_t( max( CPU_COUNT( &set ), 1 ) ) );
+    double quota = 0;
+    // The cgroup files are informational; if anything about them
+    // is not as expected then we just go without.
+    try { quota = cpu_quota(); } catch( ... ) {}
+    if( quota > 0 )
+        cpus = min( cpus, size_t( max( ceil( quota ), 1.0 ) ) );
+#endif
+    return cpus;
+}
+
+} // anon namespace
+
+size_t effective_cpus() {
+    // This reads a handful of files under /proc and /sys, so only
+    // do it once; the limits are not going to change under us.
+    static size_t const cpus = find_effective_cpus();
+    return cpus;
+}
+
+bool evict_from_cache( char const* path ) {
+#ifdef OS_LINUX
+    int fd = open( path, O_RDONLY );
+    if( fd < 0 )
+        return false;
+    bool ok = posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED ) == 0;
+    close( fd );
+    return ok;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+uint64_t effective_memory() {
+    uint64_t mem = 0;
+#ifdef OS_LINUX
+    long pages = sysconf( _SC_PHYS_PAGES );
+    long page  = sysconf( _SC_PAGE_SIZE );
+    if( pages > 0 && page > 0 )
+        mem = uint64_t( pages ) * uint64_t( page );
+    uint64_t limit = 0;
+    try { limit = memory_limit(); } catch( ... ) {}
+    if( limit > 0 && (mem == 0 || limit < mem) )
+        mem = limit;
+#endif
+    return mem;
+}
+
+ThreadUsage ThreadUsage::operator-( ThreadUsage const& o ) const {
+    // Counters only go up, but clamp anyway in case the  samples
+    // were given the wrong way around.
+    auto sub = []( uint64_t a, uint64_t b ){ return a > b ? a-b : 0; };
+    ThreadUsage res;
+    res.cpu_ns       = sub( cpu_ns,       o.cpu_ns       );
+    res.wait_ns      = sub( wait_ns,      o.wait_ns      );
+    res.voluntary    = sub( voluntary,    o.voluntary    );
+    res.involuntary  = sub( involuntary,  o.involuntary  );
+    res.major_faults = sub( major_faults, o.major_faults );
+    return res;
+}
+
+ThreadUsage thread_usage() {
+    ThreadUsage res;
+#ifdef OS_LINUX
+    struct rusage ru;
+    if( getrusage( RUSAGE_THREAD, &ru ) == 0 ) {
+        auto ns = []( timeval const& tv ){
+            return uint64_t( tv.tv_sec )*1000000000 +
+                   uint64_t( tv.tv_usec )*1000;
+        };
+        res.cpu_ns       = ns( ru.ru_utime ) + ns( ru.ru_stime );
+        res.voluntary    = uint64_t( ru.ru_nvcsw );
+        res.involuntary  = uint64_t( ru.ru_nivcsw );
+        res.major_faults = uint64_t( ru.ru_majflt );
+    }
+    // This holds "time on cpu, time waiting on a runqueue, number
+    // of timeslices", the first two in nanoseconds. It is  missing
+    // if the kernel was built without schedstats.
+    istringstream in( first_line( "/proc/thread-self/schedstat" ) );
+    uint64_t on_cpu = 0, wait = 0;
+    if( in >> on_cpu >> wait )
+        res.wait_ns = wait;
+#endif
+    return res;
+}
+
+ProcessIo ProcessIo::operator-( ProcessIo const& o ) const {
+    auto sub = []( uint64_t a, uint64_t b ){ return a > b ? a-b : 0; };
+    ProcessIo res;
+    res.rchar                 = sub( rchar,       o.rchar       );
+    res.wchar                 = sub( wchar,       o.wchar       );
+    res.read_bytes            = sub( read_bytes,  o.read_bytes  );
+    res.write_bytes           = sub( write_bytes, o.write_bytes );
+    res.cancelled_write_bytes = sub( cancelled_write_bytes,
+                                     o.cancelled_write_bytes );
+    return res;
+}
+
+ProcessIo process_io() {
+    ProcessIo res;
+#ifdef OS_LINUX
+    // Lines look like "read_bytes: 4096". The file is only readable
+    // by the process itself (or root), and is missing if the kernel
+    // was built without task I/O accounting.
+    ifstream in( "/proc/self/io" );
+    string key;
+    uint64_t value;
+    while( in >> key >> value ) {
+        if(      key == "rchar:"       ) res.rchar       = value;
+        else if( key == "wchar:"       ) res.wchar       = value;
+        else if( key == "read_bytes:"  ) res.read_bytes  = value;
+        else if( key == "write_bytes:" ) res.write_bytes = value;
+        else if( key == "cancelled_write_bytes:" )
+            res.cancelled_write_bytes = value;
+    }
+#endif
+    return res;
+}
+
+#ifdef POSIX
+namespace {
+
+// Wait for the child process to exit and collect what it used.
+ChildRun wait_child( pid_t pid, chrono::steady_clock::time_point start ) {
+    ChildRun res;
+    int status = 0;
+    struct rusage ru;
+    pid_t got;
+    while( (got = wait4( pid, &status, 0, &ru )) < 0 && errno == EINTR )
+        ;
+    FAIL( got != pid, "failed to wait for child process" );
+    res.nanoseconds = uint64_t( chrono::duration_cast<
+        chrono::nanoseconds>( chrono::steady_clock::now() -
+                              start ).count() );
+    auto ns = []( timeval const& tv ){
+        return uint64_t( tv.tv_sec )*1000000000 +
+               uint64_t( tv.tv_usec )*1000;
+    };
+    res.cpu_ns    = ns( ru.ru_utime ) + ns( ru.ru_stime );
+    // Linux gives this in kilobytes but OS X in bytes.
+    res.max_rss   = uint64_t( ru.ru_maxrss );
+#   ifdef OS_LINUX
+    res.max_rss  *= 1024;
+#   endif
+    res.exit_code = WIFEXITED( status ) ? WEXITSTATUS( status ) : -1;
+    return res;
+}
+
+} // anon namespace
+#endif
+
+ChildRun run_program( vector<string> const& argv ) {
+    FAIL( argv.empty(), "no program given" );
+#ifdef POSIX
+    // Build the argument list before forking, since only async-
+    // signal-safe calls are allowed in the child.
+    vector<char*> args;
+    for( auto const& a : argv )
+        args.push_back( const_cast<char*>( a.c_str() ) );
+    args.push_back( nullptr );
+    int null = open( "/dev/null", O_WRONLY );
+    FAIL( null < 0, "failed to open /dev/null" );
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if( pid == 0 ) {
+        dup2( null, 1 );
+        dup2( null, 2 );
+        execvp( args[0], args.data() );
+        _exit( 127 );
+    }
+    close( null );
+    FAIL( pid < 0, "failed to start " << argv[0] );
+    return wait_child( pid, start );
+#else
+    FAIL( true, "running other programs is not supported here" );
+    return ChildRun();
+#endif
+}
+
+ChildRun run_in_child( function<void()> const& fn ) {
+#ifdef POSIX
+    cout.flush();
+    cerr.flush();
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if( pid == 0 ) {
+        int code = 0;
+        try {
+            fn();
+        } catch( exception const& e ) {
+            cerr << e.what() << endl;
+            code = 1;
+        }
+        cout.flush();
+        _exit( code );
+    }
+    FAIL( pid < 0, "failed to create child process" );
+    return wait_child( pid, start );
+#else
+    fn();
+    return ChildRun();
+#endif
+}
+
+string find_program( string const& name ) {
+#ifdef POSIX
+    if( name.find( '/' ) != string::npos )
+        return access( name.c_str(), X_OK ) == 0 ? name : "";
+    char const* path = getenv( "PATH" );
+    istringstream in( path ? path : "" );
+    string dir;
+    while( getline( in, dir, ':' ) ) {
+        string p = ( dir.empty() ? "." : dir ) + "/" + name;
+        if( access( p.c_str(), X_OK ) == 0 )
+            return p;
+    }
+#else
+    (void)name;
+#endif
+    return "";
+}
+
+string self_path() {
+#ifdef OS_LINUX
+    char buf[4096];
+    ssize_t n = readlink( "/proc/self/exe", buf, sizeof( buf ) );
+    if( n > 0 && size_t( n ) < sizeof( buf ) )
+        return string( buf, size_t( n ) );
+#endif
+    return "";
+}
+
+string host_name() {
+#ifdef POSIX
+    char buf[256];
+    if( gethostname( buf, sizeof( buf ) ) == 0 ) {
+        buf[sizeof( buf )-1] = 0;
+        return buf;
+    }
+#else
+    char const* name = getenv( "COMPUTERNAME" );
+    if( name )
+        return name;
+#endif
+    return "";
+}
@@ -0,0 +1,135 @@
+/****************************************************************
+* Information about the machine that we are running on, taking
+* into account any limits imposed by the container (if any) that
+* we are running in.
+****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The number of CPUs that this process can actually make use  of.
+// This starts with the number of hardware threads and, on Linux,
+// lowers it to the number in our CPU affinity mask  (which  re-
+// flects any cpuset we are confined to) and to the CFS bandwidth
+// quota of our cgroup (v1 or v2) rounded up. Inside a  container
+// this can be far fewer than std::thread::hardware_concurrency,
+// which reports the CPUs of the whole host. Always at least one.
+// This is worked out on the first call and then remembered.
+size_t effective_cpus();
+
+// Ask the OS to drop the cached pages of a file so that the next
+// read of it comes from the device. Only pages that are clean can
+// be dropped, and this is only advice. Returns false if it is not
+// supported here or fails.
+bool evict_from_cache( char const* path );
+
+// The amount of memory that this process can use: the physical
+// memory of the machine, lowered to the memory limit of our cgroup
+// if there is one. Zero if it cannot be determined.
+uint64_t effective_memory();
+
+/****************************************************************
+* ThreadUsage: what the kernel says about the calling thread, for
+* finding out how much of a thread's time was spent off the CPU.
+* Differences between two samples  give  the  figures  for  the
+* time in between. On platforms other than Linux this is all zero.
+****************************************************************/
+struct ThreadUsage {
+    ThreadUsage()
+        : cpu_ns( 0 ), wait_ns( 0 ), voluntary( 0 ), involuntary( 0 )
+        , major_faults( 0 ) {}
+    // User plus system CPU time (getrusage).
+    uint64_t cpu_ns;
+    // Time spent runnable but waiting for a CPU (schedstat).
+    uint64_t wait_ns;
+    // Context switches: voluntary ones are where the thread blocked
+    // (on I/O, a lock, etc.) and involuntary ones are where it was
+    // preempted.
+    uint64_t voluntary;
+    uint64_t involuntary;
+    // Page faults which needed I/O.
+    uint64_t major_faults;
+
+    ThreadUsage operator-( ThreadUsage const& o ) const;
+};
+
+// Sample the usage of the calling thread. Reads /proc, so is not
+// meant to be called in inner loops.
+ThreadUsage thread_usage();
+
+/****************************************************************
+* ProcessIo: the I/O counters of the process from /proc/self/io.
+* The "char" counters are what went through read/write and similar
+* calls, whether or not it was served from the page cache,  while
+* the "bytes" ones are what was actually fetched from or sent to
+* the storage layer. Differences between two samples give the I/O
+* in between. On platforms other than Linux this is all zero.
+*
+* write_bytes is counted when dirty pages are sent to the device,
+* which is often well after the write, so data still sitting in the
+* page cache when the last sample is taken is not in it.
+****************************************************************/
+struct ProcessIo {
+    ProcessIo()
+        : rchar( 0 ), wchar( 0 ), read_bytes( 0 ), write_bytes( 0 )
+        , cancelled_write_bytes( 0 ) {}
+    uint64_t rchar;
+    uint64_t wchar;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    // Dirty page cache that was dropped before  being  written,
+    // e.g. because the file was truncated or deleted.
+    uint64_t cancelled_write_bytes;
+
+    ProcessIo operator-( ProcessIo const& o ) const;
+};
+
+ProcessIo process_io();
+
+/****************************************************************
+* ChildRun: what it cost to run another program to completion, as
+* measured from outside of it. Only supported on POSIX systems.
+****************************************************************/
+struct ChildRun {
+    ChildRun()
+        : exit_code( 0 ), nanoseconds( 0 ), cpu_ns( 0 ), max_rss( 0 )
+    {}
+    // The exit status, or -1 if the program was killed by a signal
+    // and 127 if it could not be started.
+    int      exit_code;
+    // Wall time from starting the program until it had exited.
+    uint64_t nanoseconds;
+    // User plus system CPU time of the program and its threads.
+    uint64_t cpu_ns;
+    // Peak resident set size of the program in bytes. On Linux this
+    // is at least the RSS that the parent had when it forked.
+    uint64_t max_rss;
+};
+
+// Run the program argv[0] (searched for on the PATH if it has no
+// slash) with the given arguments and wait for it to finish. Its
+// standard output and error are thrown away. Will throw if the
+// process cannot be created.
+ChildRun run_program( std::vector<std::string> const& argv );
+
+// Run the function in a child process (a fork of  this  one)  and
+// wait for it to finish, so that whatever memory it uses is given
+// back to the OS afterwards. The exit code is 1 if  the  function
+// threw, in which case the error has been printed. Where there is
+// no fork the function is just called here.
+ChildRun run_in_child( std::function<void()> const& fn );
+
+// Full path of the named program on the PATH, or empty if there is
+// no such executable.
+std::string find_program( std::string const& name );
+
+// Name of this machine, or empty if it cannot be determined.
+std::string host_name();
+
+// Full path of the executable of this process, or empty if  it
+// cannot be determined.
+std::string self_path();
@@ -1,19 +1,45 @@
 /****************************************************************
 * Implementation of the API for the parallel unzip  functionality.
 ****************************************************************/
+#include "directory.hpp"
 #include "distribution.hpp"
+#include "journal.hpp"
+#include "phases.hpp"
+#include "reader.hpp"
+#include "sys.hpp"
 #include "unzip.hpp"
 #include "zip.hpp"
 
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
 #include <iomanip>
 #include <mutex>
 #include <thread>
 
 using namespace std;
 
+// Defined below.
+string ext3( string const& s );
+
 namespace {
 
+// The number of entries at the end of each thread's run which are
+// kept for the critical path report.
+size_t const TAIL_ENTRIES = 10;
+
+// Compression methods below this are counted in an array  (the
+// common ones, including zstd at 93 and xz at 95, all are).
+uint16_t const METHOD_SLOTS = 100;
+
+// An entry as it was timed by a worker.
+struct TimedEntry {
+    uint64_t index;
+    uint64_t size;
+    uint64_t nanoseconds;
+};
+
 // This is the structure that is used to return various pieces of
 // data to the caller from  a  single  thread. Among this data is
 // the return value indicating success/failure.
@@ -22,7 +48,7 @@ struct thread_output {
     // sumes failure unless explicitely changed to true.
     thread_output()
         : watch(), files( 0 ), bytes( 0 ), tmp_files( 0 )
-        , ret( false ) {}
+        , phases(), finished(), usage(), tail(), ret( false ) {}
     // The thread will record timing info here  so  that  we  can
     // e.g. understand the runtime actually  spent in each thread.
     StopWatch            watch;
@@ -35,15 +61,192 @@ struct thread_output {
     // Total number of files that were written to temporary files
     // during extraction;
     size_t               tmp_files;
+    // In test mode, descriptions of the entries that  failed  veri-
+    // fication.
+    vector<string>       corrupt;
+    // Per compression method totals for this thread, indexed  by
+    // method so that there is no lookup for each entry. The methods
+    // in use are all below METHOD_SLOTS; any others go in the map.
+    EntryStats           methods[METHOD_SLOTS];
+    map<uint16_t, EntryStats> other_methods;
+    EntryStats           sizes[size_t( SizeClass::count )];
+    // Per entry time against size for this thread.
+    CostFit              fit;
+    // Where this thread's time went (see phases.hpp), and when it
+    // finished so that the time it then spent idle can be found.
+    PhaseTimes           phases;
+    chrono::steady_clock::time_point finished;
+    // Kernel accounting for this thread over its run.
+    ThreadUsage          usage;
+    // The last TAIL_ENTRIES entries done by this thread.
+    deque<TimedEntry>    tail;
     // The return value of the thread (success/failure)  is  here.
     // This is used because we don't allow  exceptions  to  leave
     // the threads.
     bool                 ret;
 };
 
-// Function signature to use to map an archived file name onto  a
-// temporary file name used when extracting the data.
-using NameMap = function<string( string const& )>;
+/****************************************************************
+* Temp names
+*****************************************************************
+* This takes an archived file name and maps it to another name.
+* This new name is used as the temporary location to  use  when
+* extracting/writing the file. After extraction is complete it
+* will be renamed to the proper name.
+*
+* We're going to map files to temp names, but only ones whose
+* names meet certain criteria. Various empirical observations
+* were made on Windows machines running  Symantec  Anti-Virus
+* software. It appears that this  AV  software has a negative
+* affect on file creation time in general,  but  particularly
+* so for files whose names  contain  extensions  longer  than
+* three characters.
+*
+* So,  when  an  archived  file  has an extension longer than
+* three chars we will, instead of extracting it  directly  as
+* for most other files,  we  will  extract  it to a temporary
+* file with an extention == three chars. Then, after  we  are
+* finished  extracting,  we  will  rename  it to the original
+* name. For some mysterious reason,  this  can  significantly
+* boost  performance on the Windows desktop machines on which
+* measurements  were  taken  (at  the  time  of this writing).
+*
+* And it gets even stranger... if the filename begins with  a
+* dot we will keep it as  is...  this comes from empirical ob-
+* servations that suggest that mapping files that start  with
+* a dot (even when they have an extension > 3 chars) actually
+* slows it down again.
+*
+* This function must be thread safe!
+****************************************************************/
+string short_ext_name( string const& input ) {
+    // Must use FilePath variant of split_ext here because the
+    // string variant could potential split on a dot in a parent
+    // folder. NOTE: first component (if there is one) contains
+    // the dot at the end!
+    auto opt_p = split_ext( FilePath( input ) );
+    if( !opt_p ) return input;
+    auto const& fst = opt_p.get().first;
+    string snd( opt_p.get().second.str() );
+    return ( fst.basename() != "." && snd.size() > 3 )
+           ? fst.add_ext( ext3( snd ) ).str()
+           : input;
+}
+
+/****************************************************************
+* Worker policies
+*****************************************************************
+* The options below are fixed for the whole run, so rather than
+* testing them for every entry (and going through std::function
+* to do so) the worker is a template over these  policy  types
+* and p_unzip selects the instantiation once, up front. In  the
+* common quiet/no rename/current timestamps case this  leaves  a
+* loop with no indirect calls in it.
+****************************************************************/
+// This mutex protects logging of file names during unzip. With-
+// out this lock the various threads' printing would conflict and
+// lead to messy output.
+mutex log_name_mtx;
+
+// Logging policy: whether the name of each file is echoed.
+struct LogNames {
+    void operator()( size_t thread_idx, string const& name ) const {
+        lock_guard<mutex> lock( log_name_mtx );
+        cerr << left << setw( 4 ) <<
+            to_string( thread_idx ) + "> " << name << endl;
+    }
+};
+struct LogNothing {
+    void operator()( size_t, string const& ) const {}
+};
+
+// Timestamp policy: what is done with the time stored in the  zip
+// after the file has been written.
+struct StampNothing {
+    void operator()( string const&, time_t ) const {}
+};
+struct StampStored {
+    void operator()( string const& name, time_t stored ) const {
+        if( stored )
+            set_timestamp( name, stored );
+    }
+};
+struct StampXForm {
+    TSXFormer ts_xform;
+    void operator()( string const& name, time_t stored ) const {
+        time_t time = ts_xform( stored );
+        if( time )
+            set_timestamp( name, time );
+    }
+};
+
+// Temp name policy: whether files are written under a  temporary
+// name and then renamed.
+struct KeepNames {
+    static bool const renames = false;
+    string operator()( string const& name ) const { return name; }
+};
+struct ShortExtNames {
+    static bool const renames = true;
+    string operator()( string const& name ) const {
+        return short_ext_name( name );
+    }
+};
+
+// Write a file of the given size through the same path that Zip::
+// extract_to uses, but with the contents taken from the  pattern
+// in `buf` instead of from the archive.
+void write_synthetic( string const& file, uint64_t size,
+                      Buffer const& buf ) {
+    File out = [&]{
+        PhaseScope timer( Phase::open );
+        return File( file, "wb" );
+    }();
+    for( uint64_t left = size; left > 0; ) {
+        uint64_t count = min<uint64_t>( left, buf.size() );
+        PhaseScope timer( Phase::write );
+        out.write( buf, count );
+        left -= count;
+    }
+    PhaseScope timer( Phase::open );
+    out.destroy();
+}
+
+// Entry policy: what is done with each entry. Either  decompress
+// it and write it to disk, only decompress it (and verify its size
+// and CRC), or only write it, with made-up contents of the  right
+// size. `prepare` is called once on each thread's chunk buffer.
+struct ExtractEntries {
+    static bool const verify = false;
+    static void prepare( Buffer& ) {}
+    static void write( Zip const& zip, uint64_t idx,
+                       string const& file, Buffer& buf ) {
+        zip.extract_to( idx, file, buf );
+    }
+};
+struct TestEntries {
+    static bool const verify = true;
+    static void prepare( Buffer& ) {}
+    static void write( Zip const&, uint64_t, string const&, Buffer& ) {}
+};
+struct SyntheticEntries {
+    static bool const verify = false;
+    // A pseudo-random pattern rather than zeros, so that file sys-
+    // tems which compress or skip zeroed blocks do not get an easy
+    // ride.
+    static void prepare( Buffer& buf ) {
+        auto     p = static_cast<uint8_t*>( buf.get() );
+        uint32_t x = 2463534242u;
+        for( size_t i = 0; i < buf.size(); ++i ) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            p[i] = uint8_t( x );
+        }
+    }
+    static void write( Zip const& zip, uint64_t idx,
+                       string const& file, Buffer& buf ) {
+        write_synthetic( file, zip[idx].size(), buf );
+    }
+};
 
 /****************************************************************
 * This is the function that will  be  given to each of the thread
@@ -54,33 +257,43 @@ using NameMap = function<string( string const& )>;
 * sented by the  vector  of  indices  into  the  list of archived
 * files.
 ****************************************************************/
+template<typename Log, typename Stamp, typename Names, typename Check>
 void unzip_worker( size_t                  thread_idx,
                    Buffer::SP&             zip_buffer,
-                   vector<uint64_t> const& idxs,
+                   shared_ptr<NativeArchive const> native,
+                   index_list const&       idxs,
                    size_t                  chunk_size,
-                   bool                    quiet,
-                   TSXFormer               ts_xform,
-                   NameMap const&          get_tmp_name,
+                   Log                     log,
+                   Stamp                   stamp,
+                   Names                   get_tmp_name,
                    string const&           output,
+                   string const&           password,
+                   JournalLog*             journal,
                    thread_output&          data )
 {
-    // This mutex protects logging of  file  names  during  unzip.
-    // Without this lock the various  threads' printing would con-
-    // flict and lead to messy output.
-    static mutex log_name_mtx;
-
+    // Collect the phase times of everything this thread does into
+    // its output. Whatever is not in any phase is put down to "other"
+    // at the end.
+    thread_phases() = &data.phases;
+    auto started = chrono::steady_clock::now();
+    ThreadUsage usage = thread_usage();
     TRY
     // Start the clock. Each thread  reports  its  total  runtime.
     data.watch.start( "unzip" );
     // Create  the  zip  here  because we don't know if libzip or
     // zlib are thread safe. All that the Zip  creation  will  do
     // here  is  to  change  the ref count on the buffer which is
-    // thread safe since it's a shared_ptr.
-    Zip zip( zip_buffer );
+    // thread safe since it's a shared_ptr. With the native reader
+    // nothing is parsed again; only the inflate state is new.
+    Zip zip = native ? Zip( zip_buffer, native ) : Zip( zip_buffer );
+    if( !password.empty() )
+        zip.set_password( password );
     // Allocate a new buffer for use only within this thread that
     // is  large  enough  to hold any single uncompressed file in
     // the archive.
     Buffer uncompressed( chunk_size );
+    Check::prepare( uncompressed );
+    auto last = chrono::steady_clock::now();
     // Now just loop over each entry
     for( auto idx : idxs ) {
         // This will be the file name. It should never be a
@@ -88,63 +301,278 @@ void unzip_worker( size_t                  thread_idx,
         // those should have already been filtered out and
         // pre-created. We also prepend  an  output folder to the
         // path if specified by the user (otherwise  will  be  an
-        // empty string).
-        string name(
-            FilePath( output ).join( zip[idx].name() ).str()
+        // empty string). When testing, nothing  is  written so we
+        // just use the name as it is in the archive.
+        string name( Check::verify
+            ? zip[idx].name()
+            : FilePath( output ).join( zip[idx].name() ).str()
         );
         // Get size of the uncompressed data of entry.
         uint64_t size = zip[idx].size();
         // If the caller chooses, we log the  name  of  the  file
-        // being unzipped by protect the  logging  with  a  mutex
-        // otherwise different threads  will  step  on each other
-        // causing jumbled output.
-        if( !quiet ) {
-            lock_guard<mutex> lock( log_name_mtx );
-            cerr << left << setw( 4 ) <<
-                to_string( thread_idx ) + "> " << name << endl;
+        // being unzipped.
+        log( thread_idx, name );
+        // Time each entry so that we can  break  down  where  the
+        // time went by compression method. The clock is only read
+        // once per entry: each one is timed from the end  of  the
+        // one before, so this is the whole of the time spent on it.
+        uint16_t method = zip[idx].method();
+        EntryStats& ms = method < METHOD_SLOTS
+                       ? data.methods[method]
+                       : data.other_methods[method];
+        EntryStats& ss = data.sizes[size_t( size_class( size ) )];
+        auto account = [&]{
+            auto now = chrono::steady_clock::now();
+            auto ns  = chrono::duration_cast<chrono::nanoseconds>(
+                now - last ).count();
+            last = now;
+            for( EntryStats* s : { &ms, &ss } ) {
+                s->files++;
+                s->bytes       += size;
+                s->comp_bytes  += zip[idx].comp_size();
+                s->nanoseconds += ns;
+            }
+            data.fit.add( double( size ), double( ns ) );
+            if( data.tail.size() == TAIL_ENTRIES )
+                data.tail.pop_front();
+            data.tail.push_back( { idx, size, uint64_t( ns ) } );
+        };
+        // In test mode we decompress into  the  scratch  buffer and
+        // check the result, but touch nothing on disk. A corrupt
+        // entry is recorded and we move on to the next one so that
+        // all problems in the archive get reported in one go.
+        if( Check::verify ) {
+            string why;
+            if( !zip.test( idx, uncompressed, why ) )
+                data.corrupt.push_back( name + ": " + why );
+            account();
+            data.files++; data.bytes += size;
+            continue;
         }
-        // Allow the caller to specify  a  temporary name for the
-        // file  while  it  is  being  extracted. If the callback
-        // function returns a name different  from the input name
-        // then  the  file  will be written to the temporary name
-        // while being extracted, then will be renamed  afterward.
-        // It could be used to support atomicity of extraction as
-        // well as the "small extension optimization."
-        auto tmp_name( get_tmp_name( name ) );
-        // Keep track of how many we're actually renaming.
-        data.tmp_files += ( tmp_name == name ) ? 0 : 1;
         // Decompress the data and write it to the file in chunks
-        // of size equal to uncompressed.size().
-        zip.extract_to( idx, tmp_name, uncompressed );
-        // This  function  guarantees  that it will do nothing if
-        // the two file names are equal.
-        rename_file( tmp_name, name );
-        // Now  take  the time stored in the zip archive, pass it
-        // through the user supplied transformation function, and
-        // store the result if there is one.
-        time_t time = ts_xform( zip[idx].mtime() );
-        if( time )
-            set_timestamp( name, time );
+        // of size equal to uncompressed.size(). The caller may
+        // have asked for the file to be written under a temporary
+        // name while being extracted and renamed afterward. This
+        // could be used to support atomicity of  extraction  as
+        // well as the "small extension optimization."
+        if( Names::renames ) {
+            auto tmp_name( get_tmp_name( name ) );
+            // Keep track of how many we're actually renaming.
+            data.tmp_files += ( tmp_name == name ) ? 0 : 1;
+            Check::write( zip, idx, tmp_name, uncompressed );
+            // This  function  guarantees that it will do nothing
+            // if the two file names are equal.
+            PhaseScope timer( Phase::rename );
+            rename_file( tmp_name, name );
+        } else {
+            Check::write( zip, idx, name, uncompressed );
+        }
+        // Now take the time stored in the zip archive and, depend-
+        // ing on the policy, store it (possibly transformed).
+        {
+            PhaseScope timer( Phase::timestamp );
+            stamp( name, zip[idx].mtime() );
+        }
+        // The file is now complete so it can be checkpointed.
+        if( journal )
+            journal->done( idx );
+        account();
         // For auditing / sanity checking purposes.
         data.files++; data.bytes += size;
     }
+    if( journal )
+        journal->flush();
 
     data.ret = true; // return success
     CATCH_ALL
     // Stop  the clock; we will always get here even on exception.
     data.watch.stop("unzip");
+    data.usage    = thread_usage() - usage;
+    data.finished = chrono::steady_clock::now();
+    thread_phases() = nullptr;
+    uint64_t busy = uint64_t( chrono::duration_cast<chrono::nanoseconds>(
+        data.finished - started ).count() );
+    data.phases[Phase::other] = busy - min( busy, data.phases.total() );
+}
+
+// The arguments to unzip_worker which do not depend on the poli-
+// cies; bundled so that they can be passed through the dispatch.
+struct WorkerArgs {
+    Buffer::SP&               zip_buffer;
+    shared_ptr<NativeArchive const> native;
+    index_lists const&        thread_idxs;
+    size_t                    chunk_size;
+    string const&             output;
+    string const&             password;
+    Journal const*            journal;
+    vector<thread_output>&    outputs;
+};
+
+// Spawn one thread per list of indices running the given instan-
+// tiation of the worker, then wait for them all to finish.
+template<typename Log, typename Stamp, typename Names, typename Check>
+void run_workers( WorkerArgs const& args, Log log, Stamp stamp,
+                  Names names, Check ) {
+    vector<thread> threads( args.thread_idxs.size() );
+    vector<unique_ptr<JournalLog>> logs( threads.size() );
+    if( args.journal )
+        for( size_t i = 0; i < logs.size(); ++i )
+            logs[i] = args.journal->log( i );
+    for( size_t i = 0; i < threads.size(); ++i )
+        threads[i] = thread( unzip_worker<Log, Stamp, Names, Check>,
+                             i,
+                             ref( args.zip_buffer ),
+                             args.native,
+                             cref( args.thread_idxs[i] ),
+                             args.chunk_size,
+                             log,
+                             stamp,
+                             names,
+                             cref( args.output ),
+                             cref( args.password ),
+                             logs[i].get(),
+                             ref( args.outputs[i] ) );
+    for( auto& t : threads )
+        t.join();
+    // Each thread was idle from when it finished until the  last
+    // one did.
+    auto last = chrono::steady_clock::time_point::min();
+    for( auto const& o : args.outputs )
+        last = max( last, o.finished );
+    for( auto& o : args.outputs )
+        o.phases[Phase::idle] = uint64_t( chrono::duration_cast<
+            chrono::nanoseconds>( last - o.finished ).count() );
+}
+
+// These peel off one runtime option at a time, turning each into
+// a policy type, until run_workers can be called. The modes which
+// never write anything ignore the naming and timestamp  options,
+// which keeps the number of instantiations down.
+template<typename Log>
+void dispatch_mode( WorkerArgs const& args, Log log, TSXFormer const&
+                    ts_xform, bool short_exts, UnzipMode mode );
+
+template<typename Log, typename Stamp, typename Check>
+void dispatch_names( WorkerArgs const& args, Log log, Stamp stamp,
+                     bool short_exts, Check check ) {
+    if( short_exts )
+        run_workers( args, log, stamp, ShortExtNames(), check );
+    else
+        run_workers( args, log, stamp, KeepNames(), check );
+}
+
+template<typename Log, typename Check>
+void dispatch_stamp( WorkerArgs const& args, Log log, TSXFormer const&
+                     ts_xform, bool short_exts, Check check ) {
+    // The identity function (the default) means use the  stored
+    // timestamps, and an empty function means don't set any; both
+    // are recognized so that the call can be compiled away.
+    auto fp = ts_xform.target<time_t(*)( time_t )>();
+    if( !ts_xform )
+        dispatch_names( args, log, StampNothing(), short_exts, check );
+    else if( fp && *fp == &id<time_t> )
+        dispatch_names( args, log, StampStored(), short_exts, check );
+    else
+        dispatch_names( args, log, StampXForm{ ts_xform }, short_exts,
+                        check );
+}
+
+template<typename Log>
+void dispatch_mode( WorkerArgs const& args, Log log, TSXFormer const&
+                    ts_xform, bool short_exts, UnzipMode mode ) {
+    if( !writes_files( mode ) )
+        run_workers( args, log, StampNothing(), KeepNames(),
+                     TestEntries() );
+    else if( mode == UnzipMode::write_only )
+        dispatch_stamp( args, log, ts_xform, short_exts,
+                        SyntheticEntries() );
+    else
+        dispatch_stamp( args, log, ts_xform, short_exts,
+                        ExtractEntries() );
+}
+
+/****************************************************************
+* Load balance across the threads. A thread's time here  is  its
+* running time, not counting the time that it spent idle at  the
+* end, and the idle time of all of the threads together  is  the
+* CPU time that was lost waiting for the slowest one.
+****************************************************************/
+struct Balance {
+    // Slowest thread over the average; 1.0 is perfect balance.
+    double   max_over_mean;
+    // Coefficient of variation (standard deviation over mean).
+    double   cv;
+    // Idle core time in nanoseconds.
+    uint64_t idle;
+};
+
+Balance balance( vector<PhaseTimes> const& phases_ts ) {
+    double sum = 0, sq = 0, hi = 0;
+    Balance res{ 0, 0, 0 };
+    for( auto const& pt : phases_ts ) {
+        double busy = double( pt.total() - pt[Phase::idle] );
+        sum += busy; sq += busy*busy; hi = max( hi, busy );
+        res.idle += pt[Phase::idle];
+    }
+    double n    = double( phases_ts.size() );
+    double mean = n > 0 ? sum/n : 0;
+    if( mean > 0 ) {
+        res.max_over_mean = hi/mean;
+        res.cv = sqrt( max( sq/n - mean*mean, 0.0 ) )/mean;
+    }
+    return res;
 }
 
 } // anon namespace
 
+char const* mode_name( UnzipMode mode ) {
+    switch( mode ) {
+        case UnzipMode::extract:    return "extract";
+        case UnzipMode::test:       return "test";
+        case UnzipMode::create:     return "create";
+        case UnzipMode::null_sink:  return "null";
+        case UnzipMode::write_only: return "write";
+    }
+    return "?";
+}
+
+SizeClass size_class( uint64_t size ) {
+    if( size == 0 )         return SizeClass::empty;
+    if( size < (4 << 10) )  return SizeClass::under_4k;
+    if( size < (64 << 10) ) return SizeClass::under_64k;
+    if( size < (1 << 20) )  return SizeClass::under_1m;
+    if( size < (64 << 20) ) return SizeClass::under_64m;
+    return SizeClass::larger;
+}
+
+char const* size_class_name( SizeClass c ) {
+    switch( c ) {
+        case SizeClass::empty:     return "empty";
+        case SizeClass::under_4k:  return "<4K";
+        case SizeClass::under_64k: return "<64K";
+        case SizeClass::under_1m:  return "<1M";
+        case SizeClass::under_64m: return "<64M";
+        case SizeClass::larger:    return ">=64M";
+        case SizeClass::count:     break;
+    }
+    return "?";
+}
+
+bool writes_files( UnzipMode mode ) {
+    return mode == UnzipMode::extract || mode == UnzipMode::write_only;
+}
+
 /****************************************************************
 * UnzipSummary: structure used for  communicating diagnostic info
 * collected during the unzip process back to the caller.
 ****************************************************************/
-UnzipSummary::UnzipSummary( size_t jobs )
+UnzipSummary::UnzipSummary( size_t jobs, size_t cpus )
     : filename()
     , jobs_used( jobs )
     , strategy_used()
+    , engine_used()
+    , cpus( cpus )
+    , mode( UnzipMode::extract )
     , chunk_size_used( 0 )
     , files( 0 )
     , files_ts( jobs )
@@ -152,6 +580,15 @@ UnzipSummary::UnzipSummary( size_t jobs )
     , bytes_ts( jobs )
     , folders( 0 )
     , num_temp_names( 0 )
+    , resumed( 0 )
+    , methods()
+    , fit()
+    , phases_ts()
+    , memory()
+    , io_samples()
+    , slowest_thread( 0 )
+    , critical_path()
+    , corrupt()
     , watch()
     , watches( jobs )
 {}
@@ -171,23 +608,31 @@ ostream& operator<<( ostream& out, UnzipSummary const& us ) {
 
     key( "file" )       << us.filename << endl;
     key( "jobs" )       << us.jobs_used << endl;
+    key( "cpus" )       << us.cpus << endl;
     key( "strategy" )   << us.strategy_used << endl;
+    key( "engine" )     << us.engine_used << endl;
+    key( "mode" )       << mode_name( us.mode ) << endl;
     key( "files" )      << us.files << endl;
     key( "folders" )    << us.folders << endl;
     if( us.folders > 0 )
         key( "ratio " ) << double( us.files ) / us.folders << endl;
     key( "tmp names" )  << us.num_temp_names << endl;
+    if( us.resumed > 0 )
+        key( "resumed" ) << us.resumed << endl;
     key( "chunk" )      << us.chunk_size_used << endl;
     key( "chunks_mem" ) << BYTES( us.chunk_size_used*us.jobs_used )
                         << endl;
 
     size_t jobs = us.watches.size();
+    // This is the name of the event during  which  the  worker
+    // threads are running.
+    string work = ( us.mode == UnzipMode::create ) ? "zip" : "unzip";
 
     out << endl;
     for( size_t i = 0; i < jobs; ++i ) {
         key( "files: thread " + to_string( i+1 ) ) <<
             left << setw(22) << us.files_ts[i] << " [" <<
-            us.watches[i].human( "unzip" ) << "]" << endl;
+            us.watches[i].human( work ) << "]" << endl;
     }
 
     key( "files: total") << us.files << endl;
@@ -196,11 +641,196 @@ ostream& operator<<( ostream& out, UnzipSummary const& us ) {
     for( size_t i = 0; i < jobs; ++i ) {
         key( "bytes: thread " + to_string( i+1 ) ) <<
             BYTES( us.bytes_ts[i] ) << " [" <<
-            us.watches[i].human( "unzip" ) << "]" << endl;
+            us.watches[i].human( work ) << "]" << endl;
     }
 
     key( "bytes: total" ) << BYTES( us.bytes ) << endl;
 
+    // Throughput is measured in  terms  of uncompressed bytes over
+    // the time that the threads were running.
+    auto ms = us.watch.milliseconds( work );
+    if( ms > 0 )
+        key( "throughput" ) << human_bytes( us.bytes*1000/ms )
+                            << "/s" << endl;
+    if( us.mode == UnzipMode::test || us.mode == UnzipMode::null_sink )
+        key( "corrupt" ) << us.corrupt.size() << endl;
+    // The fixed and per-byte costs of an entry, from the fit.
+    if( us.fit.n > 0 )
+        key( "cost per file" ) << uint64_t( us.fit.per_file()/1000 )
+                               << "us" << endl;
+    if( us.fit.per_byte() > 0 )
+        key( "cost per byte" ) << human_bytes( uint64_t(
+            1e9/us.fit.per_byte() ) ) << "/s/thread" << endl;
+
+    // Breakdown by compression method and by size class. The times
+    // are summed over the threads, so the rate is per thread,  and
+    // the share is of the time spent on all of the entries.
+    uint64_t entry_ns = 0;
+    for( auto const& p : us.methods )
+        entry_ns += p.second.nanoseconds;
+    auto breakdown = [&]( string const& name, EntryStats const& m ) {
+        key( name ) << left << setw(10) << m.files << BYTES( m.bytes )
+            << " [" << human_duration( m.nanoseconds );
+        if( entry_ns > 0 )
+            out << ", " << fixed << setprecision(1) <<
+                100.0*m.nanoseconds/entry_ns << "%";
+        if( m.nanoseconds > 0 )
+            out << ", " << human_bytes( uint64_t( double( m.bytes )*
+                1e9/m.nanoseconds ) ) << "/s/thread";
+        out << "]" << endl;
+    };
+    if( !us.methods.empty() )
+        out << endl;
+    for( auto const& p : us.methods )
+        breakdown( "method: " + method_name( p.first ), p.second );
+    if( !us.methods.empty() )
+        out << endl;
+    for( size_t k = 0; k < size_t( SizeClass::count ); ++k )
+        if( us.sizes[k].files > 0 )
+            breakdown( string( "size: " ) +
+                size_class_name( SizeClass( k ) ), us.sizes[k] );
+
+    // Breakdown of each thread's time by phase, as a percentage of
+    // its time (including idle), then the totals over the threads.
+    if( !us.phases_ts.empty() ) {
+        out << endl;
+        size_t const phases = size_t( Phase::count );
+        key( "phases" );
+        for( size_t p = 0; p < phases; ++p )
+            out << right << setw(10) << phase_name( Phase( p ) );
+        out << endl;
+        PhaseTimes sum;
+        for( size_t i = 0; i < us.phases_ts.size(); ++i ) {
+            PhaseTimes const& pt = us.phases_ts[i];
+            sum.merge( pt );
+            key( "phases: thread " + to_string( i+1 ) );
+            for( size_t p = 0; p < phases; ++p )
+                out << right << setw(9) << fixed << setprecision(1) <<
+                    ( pt.total() ? 100.0*pt.ns[p]/pt.total() : 0.0 )
+                    << "%";
+            out << endl;
+        }
+        key( "phases: total" );
+        for( size_t p = 0; p < phases; ++p )
+            out << right << setw(10) << human_duration( sum.ns[p] );
+        out << endl;
+        key( "phases: total %" );
+        for( size_t p = 0; p < phases; ++p )
+            out << right << setw(9) << fixed << setprecision(1) <<
+                ( sum.total() ? 100.0*sum.ns[p]/sum.total() : 0.0 )
+                << "%";
+        out << endl;
+        out.unsetf( ios::floatfield );
+        out << setprecision( 6 );
+    }
+
+    // Off-CPU time is the time that a thread was running (i.e., not
+    // counting idle) minus its CPU time. Some of that was spent
+    // waiting for a CPU; the rest it was blocked in the  kernel:
+    // on I/O, locks, writeback throttling or page faults.
+    if( us.usage_ts.size() == us.phases_ts.size() &&
+        !us.usage_ts.empty() ) {
+        out << endl;
+        for( size_t i = 0; i < us.usage_ts.size(); ++i ) {
+            ThreadUsage const& tu = us.usage_ts[i];
+            PhaseTimes  const& pt = us.phases_ts[i];
+            uint64_t busy = pt.total() - pt[Phase::idle];
+            uint64_t off  = busy - min( busy, tu.cpu_ns );
+            key( "off-cpu: thread " + to_string( i+1 ) ) <<
+                left << setw(9) << human_duration( off ) <<
+                " [cpu " << human_duration( tu.cpu_ns ) <<
+                ", runq " << human_duration( tu.wait_ns ) <<
+                ", blocked " << human_duration(
+                    off - min( off, tu.wait_ns ) ) <<
+                ", csw " << tu.voluntary << "/" << tu.involuntary <<
+                ", majflt " << tu.major_faults << "]" << endl;
+        }
+    }
+
+    if( us.phases_ts.size() > 1 ) {
+        Balance b = balance( us.phases_ts );
+        out << endl;
+        key( "max/mean" ) << b.max_over_mean << endl;
+        key( "cv" )       << b.cv << endl;
+        key( "idle" )     << human_duration( b.idle ) <<
+            " (core time)" << endl;
+    }
+    // The entries that finished last on the thread which finished
+    // last.
+    if( !us.critical_path.empty() ) {
+        out << endl;
+        key( "critical path" ) << "thread " << us.slowest_thread+1
+                               << endl;
+        for( auto const& e : us.critical_path )
+            key( "  " + to_string( e.nanoseconds/1000 ) + "us" ) <<
+                BYTES( e.size ) << " " << e.name << endl;
+    }
+
+    // Memory: the peak RSS of the process, the sizes of the big
+    // buffers, the peaks of our own tagged allocations, and  how
+    // the RSS changed over each step.
+    MemoryStats const& mem = us.memory;
+    if( mem.peak_rss > 0 || mem.archive > 0 ) {
+        out << endl;
+        key( "mem: peak rss" ) << BYTES( mem.peak_rss ) << endl;
+        key( "mem: archive" )  << BYTES( mem.archive )  << endl;
+        key( "mem: chunks" )   << BYTES( mem.chunks )   << endl;
+        // These are peaks.
+        for( size_t i = 0; i < size_t( MemTag::count ); ++i )
+            key( string( "mem: " ) + mem_tag_name( MemTag( i ) ) ) <<
+                BYTES( uint64_t( max<int64_t>( mem.tag_peak[i], 0 ) ) )
+                << endl;
+        for( auto const& d : mem.rss_deltas )
+            key( "rss: " + d.first ) << ( d.second < 0 ? "-" : "+" ) <<
+                human_bytes( uint64_t( d.second < 0 ? -d.second
+                                                    : d.second ) )
+                << endl;
+    }
+
+    // I/O of each step: through the system calls, and (in paren-
+    // theses) to or from the device. Reads of the input that stay
+    // well under 1x on the device were served from the page cache.
+    if( us.io_samples.size() > 1 ) {
+        out << endl;
+        auto io = [&]( string const& name, ProcessIo const& d ) {
+            key( "io: " + name ) << "read " << human_bytes( d.rchar ) <<
+                " (" << human_bytes( d.read_bytes ) << "), write " <<
+                human_bytes( d.wchar ) << " (" <<
+                human_bytes( d.write_bytes ) << ", cancelled " <<
+                human_bytes( d.cancelled_write_bytes ) << ")" << endl;
+        };
+        for( size_t i = 1; i < us.io_samples.size(); ++i )
+            io( us.io_samples[i].first, us.io_samples[i].second -
+                                        us.io_samples[i-1].second );
+        ProcessIo total = us.io_samples.back().second -
+                          us.io_samples.front().second;
+        io( "total", total );
+        auto amp = [&]( string const& name, uint64_t chars,
+                        uint64_t bytes, uint64_t base,
+                        char const* note ) {
+            key( name ) << fixed << setprecision(2) <<
+                double( chars )/base << "x (" << double( bytes )/base
+                << "x" << note << ")" << endl;
+            out.unsetf( ios::floatfield );
+            out << setprecision( 6 );
+        };
+        // Reads are relative to what was read in (the archive, or
+        // the files when creating one) and writes to what was writ-
+        // ten out (the extracted files). The device writes only
+        // count pages that the kernel has written back so far, and
+        // we don't sync to force the rest out as that would  change
+        // what is being measured, so say so.
+        uint64_t in = ( us.mode == UnzipMode::create ) ? us.bytes
+                                                       : us.memory.archive;
+        if( in > 0 )
+            amp( "read amp", total.rchar, total.read_bytes, in, "" );
+        if( writes_files( us.mode ) && us.bytes > 0 )
+            amp( "write amp", total.wchar, total.write_bytes -
+                 min( total.write_bytes, total.cancelled_write_bytes ),
+                 us.bytes, " written back so far, excluding "
+                 "dirty pages" );
+    }
+
     out << endl;
     // Output all the times  that  were  measured but put "total"
     // last.
@@ -212,6 +842,158 @@ ostream& operator<<( ostream& out, UnzipSummary const& us ) {
     return out;
 }
 
+void print_json( ostream& out, UnzipSummary const& us ) {
+    string s = "{\"file\":";
+    append_json_string( s, us.filename.data(), us.filename.size() );
+    s += ",\"strategy\":";
+    append_json_string( s, us.strategy_used.data(),
+                           us.strategy_used.size() );
+    s += ",\"engine\":";
+    append_json_string( s, us.engine_used.data(),
+                           us.engine_used.size() );
+    s += ",\"mode\":\"";
+    s += mode_name( us.mode );
+    s += "\"";
+    // These add a named number to the current object, with a comma
+    // unless it is the first member.
+    auto num = [&]( char const* name, double value ) {
+        char buf[64];
+        snprintf( buf, sizeof( buf ), "%s\"%s\":%.17g",
+                  s.back() == '{' ? "" : ",", name, value );
+        s += buf;
+    };
+    auto ms = [&]( char const* name, uint64_t nanoseconds ) {
+        char buf[64];
+        snprintf( buf, sizeof( buf ), "%s\"%s\":%.3f",
+                  s.back() == '{' ? "" : ",", name, nanoseconds/1e6 );
+        s += buf;
+    };
+    num( "jobs",    double( us.jobs_used ) );
+    num( "cpus",    double( us.cpus ) );
+    num( "chunk",   double( us.chunk_size_used ) );
+    num( "files",   double( us.files ) );
+    num( "folders", double( us.folders ) );
+    num( "bytes",   double( us.bytes ) );
+    num( "resumed", double( us.resumed ) );
+    num( "corrupt", double( us.corrupt.size() ) );
+    num( "cost_per_file_ns", us.fit.per_file() );
+    num( "cost_per_byte_ns", us.fit.per_byte() );
+
+    string work = ( us.mode == UnzipMode::create ) ? "zip" : "unzip";
+    s += ",\"threads\":[";
+    for( size_t i = 0; i < us.watches.size(); ++i ) {
+        s += i ? ",{" : "{";
+        num( "thread", double( i+1 ) );
+        num( "files", double( us.files_ts[i] ) );
+        num( "bytes", double( us.bytes_ts[i] ) );
+        num( "ms",    double( us.watches[i].milliseconds( work ) ) );
+        if( i < us.phases_ts.size() ) {
+            s += ",\"phases_ms\":{";
+            for( size_t p = 0; p < size_t( Phase::count ); ++p )
+                ms( phase_name( Phase( p ) ), us.phases_ts[i].ns[p] );
+            s += "}";
+        }
+        if( i < us.usage_ts.size() ) {
+            ThreadUsage const& tu = us.usage_ts[i];
+            ms(  "cpu_ms",       tu.cpu_ns );
+            ms(  "runq_ms",      tu.wait_ns );
+            // The rest of the time that the thread was busy (i.e.,
+            // not idle) it was blocked in the kernel; this is what
+            // the text summary shows as "blocked".
+            if( i < us.phases_ts.size() ) {
+                PhaseTimes const& pt = us.phases_ts[i];
+                uint64_t busy = pt.total() - pt[Phase::idle];
+                uint64_t off  = busy - min( busy, tu.cpu_ns );
+                ms( "off_cpu_ms", off - min( off, tu.wait_ns ) );
+            }
+            num( "voluntary",    double( tu.voluntary ) );
+            num( "involuntary",  double( tu.involuntary ) );
+            num( "major_faults", double( tu.major_faults ) );
+        }
+        s += "}";
+    }
+    s += "]";
+
+    s += ",\"methods\":{";
+    for( auto const& p : us.methods ) {
+        s += s.back() == '{' ? "\"" : ",\"";
+        s += method_name( p.first ) + "\":{";
+        num( "files",      double( p.second.files ) );
+        num( "bytes",      double( p.second.bytes ) );
+        num( "comp_bytes", double( p.second.comp_bytes ) );
+        ms(  "ms",         p.second.nanoseconds );
+        s += "}";
+    }
+    s += "}";
+
+    s += ",\"sizes\":{";
+    for( size_t k = 0; k < size_t( SizeClass::count ); ++k ) {
+        EntryStats const& c = us.sizes[k];
+        if( c.files == 0 )
+            continue;
+        s += s.back() == '{' ? "\"" : ",\"";
+        s += string( size_class_name( SizeClass( k ) ) ) + "\":{";
+        num( "files",      double( c.files ) );
+        num( "bytes",      double( c.bytes ) );
+        num( "comp_bytes", double( c.comp_bytes ) );
+        ms(  "ms",         c.nanoseconds );
+        s += "}";
+    }
+    s += "}";
+
+    MemoryStats const& mem = us.memory;
+    s += ",\"memory\":{";
+    num( "peak_rss", double( mem.peak_rss ) );
+    num( "archive",  double( mem.archive ) );
+    num( "chunks",   double( mem.chunks ) );
+    for( size_t i = 0; i < size_t( MemTag::count ); ++i )
+        num( mem_tag_name( MemTag( i ) ), double( mem.tag_peak[i] ) );
+    s += ",\"rss_deltas\":{";
+    for( auto const& d : mem.rss_deltas )
+        num( d.first.c_str(), double( d.second ) );
+    s += "}}";
+
+    if( !us.phases_ts.empty() ) {
+        Balance b = balance( us.phases_ts );
+        s += ",\"balance\":{";
+        num( "max_over_mean", b.max_over_mean );
+        num( "cv",            b.cv );
+        ms(  "idle_ms",       b.idle );
+        s += "}";
+    }
+    s += ",\"critical_path\":{";
+    num( "thread", double( us.slowest_thread+1 ) );
+    s += ",\"entries\":[";
+    for( size_t i = 0; i < us.critical_path.size(); ++i ) {
+        EntryTiming const& e = us.critical_path[i];
+        s += i ? ",{\"name\":" : "{\"name\":";
+        append_json_string( s, e.name.data(), e.name.size() );
+        num( "size", double( e.size ) );
+        ms(  "ms",   e.nanoseconds );
+        s += "}";
+    }
+    s += "]}";
+
+    s += ",\"io\":{";
+    for( size_t i = 1; i < us.io_samples.size(); ++i ) {
+        ProcessIo d = us.io_samples[i].second - us.io_samples[i-1].second;
+        s += ( i > 1 ? ",\"" : "\"" ) + us.io_samples[i].first + "\":{";
+        num( "rchar",                 double( d.rchar ) );
+        num( "wchar",                 double( d.wchar ) );
+        num( "read_bytes",            double( d.read_bytes ) );
+        num( "write_bytes",           double( d.write_bytes ) );
+        num( "cancelled_write_bytes", double( d.cancelled_write_bytes ) );
+        s += "}";
+    }
+    s += "}";
+
+    s += ",\"times_ms\":{";
+    for( auto const& r : us.watch.results() )
+        num( r.first.c_str(), double( us.watch.milliseconds( r.first ) ) );
+    s += "}}";
+    out << s << endl;
+}
+
 // The idea of this function is to take an arbitrary input string
 // and  then  hash it, where the hash is a three-character string
 // made  up  only of characters suitable for a file extension. Ba-
@@ -235,21 +1017,34 @@ string ext3( string const& s ) {
 /****************************************************************
 * Main interface for parallel unzip.
 ****************************************************************/
-UnzipSummary p_unzip( string    filename,
-                      size_t    jobs,
-                      bool      quiet,
-                      string    output,
-                      string    strategy,
-                      size_t    chunk_size,
-                      TSXFormer ts_xform,
-                      bool      short_exts )
+UnzipSummary p_unzip( string      filename,
+                      size_t      jobs,
+                      bool        quiet,
+                      string      output,
+                      string      strategy,
+                      size_t      chunk_size,
+                      TSXFormer   ts_xform,
+                      bool        short_exts,
+                      UnzipMode   mode,
+                      string      password,
+                      string      journal,
+                      bool        resume,
+                      ZipEngine   engine,
+                      InflatePlan inflate )
 {
     // This  will  collect  info  and will be returned at the end.
-    UnzipSummary res( jobs );
+    UnzipSummary res( jobs, effective_cpus() );
 
     // Start  the clock to measure total unzip time including the
     // preparation work.
     res.watch.start( "total" ); // End program runtime.
+    // Memory and I/O are accounted over the same steps as the timing.
+    res.memory.start();
+    res.io_samples.emplace_back( "start", process_io() );
+    auto step = [&]( char const* name ) {
+        res.memory.step( name );
+        res.io_samples.emplace_back( name, process_io() );
+    };
 
     res.watch.start( "load_zip" );
     // Open the zip file, read it  completely into a buffer, then
@@ -265,7 +1060,22 @@ UnzipSummary p_unzip( string    filename,
     // zip to gather information about the  stats of the files in
     // the archive. However, it will not do any decompression  or
     // extraction.
-    Zip z( zip_buffer );
+    //
+    // The native reader parses the directory here once for all  of
+    // the threads, unless the archive needs libzip.
+    shared_ptr<NativeArchive const> native;
+    res.engine_used = "libzip";
+    if( engine == ZipEngine::native ) {
+        string why;
+        native = NativeArchive::open( zip_buffer, why, inflate );
+        res.engine_used = native ? "native (" + inflate.describe() + ")"
+                                 : "libzip (" + why + ")";
+    }
+    Zip z = native ? Zip( zip_buffer, native ) : Zip( zip_buffer );
+    // Fail early if there are entries which libzip can't handle.
+    z.check_methods();
+    FAIL( password.empty() && z.has_encrypted(),
+        "archive has encrypted entries; please supply a password" );
 
     // Create a copy of z's underlying vector of ZipStats so that
     // we  can  reorder them. Note that the resultant vector will
@@ -276,71 +1086,58 @@ UnzipSummary p_unzip( string    filename,
     auto folders = make_range( stats.begin(), folders_end );
     auto files   = make_range( folders_end,   stats.end() );
 
+    /************************************************************
+    * Journal
+    *************************************************************
+    * When resuming, the files that the journal says are done are
+    * checked, in parallel since there may be many, and those that
+    * are really there with the right size are  moved  out  of  the
+    * `files` range so that only the rest get distributed. */
+    FAIL( resume && journal.empty(), "cannot resume without a journal" );
+    FAIL( !journal.empty() && mode != UnzipMode::extract,
+        "a journal can only be used when extracting" );
+    unique_ptr<Journal> jnl;
+    if( !journal.empty() ) res.watch.run( "journal", [&]{
+        jnl.reset( new Journal( journal, archive_id( *zip_buffer ),
+                                resume, jobs ) );
+        vector<bool> claimed( z.size() ), done( z.size() );
+        for( auto idx : jnl->completed() )
+            if( idx < claimed.size() )
+                claimed[idx] = true;
+        // vector<bool> packs bits so threads must not write to it.
+        vector<uint8_t> ok( files.size() );
+        auto first = files.begin();
+        parallel_chunks( files.size(), jobs,
+            [&]( size_t, size_t begin, size_t end ){
+                for( size_t i = begin; i < end; ++i ) {
+                    ZipStat const& zs = first[i];
+                    if( !claimed[zs.index()] )
+                        continue;
+                    auto size = file_size( FilePath( output ).join(
+                        zs.name() ).str() );
+                    ok[i] = size && size.get() == zs.size();
+                }
+            } );
+        for( size_t i = 0; i < ok.size(); ++i )
+            if( ok[i] )
+                done[first[i].index()] = true;
+        auto todo_end = stable_partition( folders_end, stats.end(),
+            [&]( ZipStat const& zs ){ return !done[zs.index()]; } );
+        res.resumed = size_t( stats.end() - todo_end );
+        files = make_range( folders_end, todo_end );
+    });
+
     // Time how long it takes to load the zip and handle the  Zip-
     // Stat data structures.
     res.watch.stop( "load_zip" );
+    step( "load_zip" );
+    res.memory.archive = zip_buffer->size();
 
     // If this is zero then we'll go into an endless loop writing
     // chunks of size zero to disk.
     FAIL( chunk_size < 1, "Invalid chunk size: " << chunk_size );
     res.chunk_size_used = chunk_size;
 
-    /************************************************************
-    * Create the `temp name map` function
-    *************************************************************
-    * Establish  a  function  that takes a archived file name and
-    * maps  it  to another name. This new name is used as the tem-
-    * porary location to use  when  extracting/writing  the  file.
-    * After extraction is complete it  will  be  renamed  to  the
-    * proper name.
-    *
-    * There could potentially be  multiple  uses for this mapping
-    * function, but here we're using it accomplish something kind
-    * of odd.
-    *
-    * We're going to map files to temp names, but only ones whose
-    * names meet certain criteria. Various empirical observations
-    * were made on Windows machines running  Symantec  Anti-Virus
-    * software. It appears that this  AV  software has a negative
-    * affect on file creation time in general,  but  particularly
-    * so for files whose names  contain  extensions  longer  than
-    * three characters.
-    *
-    * So,  when  an  archived  file  has an extension longer than
-    * three chars we will, instead of extracting it  directly  as
-    * for most other files,  we  will  extract  it to a temporary
-    * file with an extention == three chars. Then, after  we  are
-    * finished  extracting,  we  will  rename  it to the original
-    * name. For some mysterious reason,  this  can  significantly
-    * boost  performance on the Windows desktop machines on which
-    * measurements  were  taken  (at  the  time  of this writing).
-    *
-    * And it gets even stranger... if the filename begins with  a
-    * dot we will keep it as  is...  this comes from empirical ob-
-    * servations that suggest that mapping files that start  with
-    * a dot (even when they have an extension > 3 chars) actually
-    * slows it down again. */
-
-    // The default mapping does nothing.
-    NameMap get_tmp_name = id<string>;
-
-    if( short_exts ) {
-        // This function must be thread safe!
-        get_tmp_name = []( string const& input ) {
-            // Must  use  FilePath  variant  of split_ext here be-
-            // cause the string variant could potential split  on
-            // a dot in a parent folder.  NOTE:  first  component
-            // (if there is one)  contains  the  dot  at the end!
-            auto opt_p = split_ext( FilePath( input ) );
-            if( !opt_p ) return input;
-            auto const& fst = opt_p.get().first;
-            string snd( opt_p.get().second.str() );
-            return ( fst.basename() != "." && snd.size() > 3 )
-                   ? fst.add_ext( ext3( snd ) ).str()
-                   : input;
-        };
-    }
-
     /************************************************************
     * Pre-create folder structure
     *************************************************************
@@ -355,26 +1152,29 @@ UnzipSummary p_unzip( string    filename,
     * the paths to files. We  also  prepend  `output` to each one,
     * which is an optional  folder  prefix  into  which the files
     * should be extracted. */
-    vector<FilePath> fps;
-    for( auto const& zs : stats )
-        fps.push_back( FilePath( output ).join( zs.folder() ) );
-    // Now we ensure that each one exists.
-    res.watch.run( "folders", [&]{ mkdirs_p( fps ); } );
+    if( writes_files( mode ) ) {
+        vector<FilePath> fps;
+        for( auto const& zs : stats )
+            fps.push_back( FilePath( output ).join( zs.folder() ) );
+        // Now we ensure that each one exists.
+        res.watch.run( "folders", [&]{ mkdirs_p( fps ); } );
+        step( "folders" );
+    }
 
     /************************************************************
     * Distribution of files to the threads
     ************************************************************/
-    FAIL( !has_key( distribute, strategy ),
-        "strategy " << strategy << " is invalid." );
+    distributor_t distributor = find_strategy( strategy );
     // Do  the  distribution.  The  result  should be a vector of
     // length equal to the number of jobs.  Each  element  should
     // itself  be  a vector if indexs representing files assigned
     // to that thread for extraction.
     index_lists thread_idxs;
     res.watch.run( "distribute", [&]{
-        thread_idxs = distribute[strategy]( jobs, files );
+        thread_idxs = distributor( jobs, files );
     });
     FAIL_( thread_idxs.size() != jobs );
+    step( "distribute" );
     res.strategy_used = strategy;
 
     /************************************************************
@@ -383,28 +1183,22 @@ UnzipSummary p_unzip( string    filename,
     * These will be populated by the  threads as the work and and
     * then checked at the end as a sanity check. */
     vector<thread_output> outputs( jobs );
-    vector<thread>        threads( jobs );
 
     res.watch.start( "unzip" );
 
-    // Spawn each thread
-    for( size_t i = 0; i < jobs; ++i )
-        threads[i] = thread( unzip_worker,
-                             i,
-                             ref( zip_buffer ),
-                             ref( thread_idxs[i] ),
-                             chunk_size,
-                             quiet,
-                             ts_xform,
-                             ref( get_tmp_name ),
-                             output,
-                             ref( outputs[i] ) );
-
-    // Wait for everything to finish.
-    for( auto& t : threads )
-        t.join();
+    // Choose the worker instantiation for these options and spawn
+    // the threads; this returns when they have all finished.
+    WorkerArgs args{ zip_buffer, native, thread_idxs, chunk_size,
+                     output, password, jnl.get(), outputs };
+    if( quiet )
+        dispatch_mode( args, LogNothing(), ts_xform, short_exts, mode );
+    else
+        dispatch_mode( args, LogNames(),   ts_xform, short_exts, mode );
 
     res.watch.stop( "unzip" );
+    step( "unzip" );
+    res.memory.chunks = uint64_t( chunk_size )*jobs;
+    res.memory.finish();
 
     for( size_t i = 0; i < jobs; ++i )
         FAIL_( !outputs[i].ret );
@@ -422,6 +1216,18 @@ UnzipSummary p_unzip( string    filename,
         res.files          += o.files;
         res.bytes          += o.bytes;
         res.num_temp_names += o.tmp_files;
+        res.corrupt.insert( res.corrupt.end(), o.corrupt.begin(),
+                                               o.corrupt.end() );
+        for( uint16_t m = 0; m < METHOD_SLOTS; ++m )
+            if( o.methods[m].files > 0 )
+                res.methods[m].merge( o.methods[m] );
+        for( auto const& p : o.other_methods )
+            res.methods[p.first].merge( p.second );
+        for( size_t k = 0; k < size_t( SizeClass::count ); ++k )
+            res.sizes[k].merge( o.sizes[k] );
+        res.fit.merge( o.fit );
+        res.phases_ts.push_back( o.phases );
+        res.usage_ts.push_back( o.usage );
         // Per-thread stuff
         res.files_ts[job]   = o.files;
         res.bytes_ts[job]   = o.bytes;
@@ -435,9 +1241,20 @@ UnzipSummary p_unzip( string    filename,
     // res.files.
     FAIL_( res.files != files.size() );
 
+    // The critical path is the tail of the thread that finished
+    // last, i.e., the one that was idle for the least time.
+    for( size_t i = 0; i < jobs; ++i )
+        if( outputs[i].phases[Phase::idle] <
+            outputs[res.slowest_thread].phases[Phase::idle] )
+            res.slowest_thread = i;
+    for( auto const& te : outputs[res.slowest_thread].tail )
+        res.critical_path.push_back(
+            { z[te.index].name(), te.size, te.nanoseconds } );
+
     res.folders   = folders.size();
     res.filename  = filename;
     res.jobs_used = jobs;
+    res.mode      = mode;
 
     uint64_t total_bytes_in_zip = 0;
     for( auto const& zs : files )
@@ -3,9 +3,17 @@
 * contains  the API function as well as definitions of data struc-
 * tures for communication information to and from  that  function.
 ****************************************************************/
+#pragma once
+
+#include "inflate.hpp"
+#include "memory.hpp"
+#include "phases.hpp"
+#include "sys.hpp"
 #include "utils.hpp"
+#include "zip.hpp"
 
 #include <functional>
+#include <map>
 #include <vector>
 
 // This is the default distribution  strategy  to use if the user
@@ -21,6 +29,116 @@
 // timestamps when extracting zip files.
 using TSXFormer = std::function<time_t( time_t )>;
 
+// This enum selects what is done with each archived file once  it
+// has been assigned to a thread.
+enum class UnzipMode {
+    // Decompress each file and write it to disk (the normal case).
+    extract,
+    // Decompress each file into a scratch buffer and verify  its
+    // size and CRC, but do not create any files or folders.
+    test,
+    // Not an unzip at all: the summary describes the creation  of
+    // an archive by p_zip (see create.hpp).
+    create,
+    // Benchmark: decompress and check each entry exactly  as  in
+    // `test`, discarding the output. This gives the speed of de-
+    // compression alone.
+    null_sink,
+    // Benchmark: skip decompression entirely, and instead create
+    // each file (and the folders) as in `extract` but fill it with
+    // a fixed pattern of the right size. This gives the speed  of
+    // the file system alone.
+    write_only
+};
+
+// Short name of the mode for reports, e.g. "test".
+char const* mode_name( UnzipMode mode );
+
+// True for the modes which create folders and files.
+bool writes_files( UnzipMode mode );
+
+/****************************************************************
+* CostFit: least squares fit of the time taken to extract each en-
+* try against its size, t = per_file + per_byte*size, accumulated
+* one entry at a time. The intercept is the fixed cost of creating
+* a file and the slope is the cost of decompressing and  writing
+* each byte.
+****************************************************************/
+struct CostFit {
+    CostFit() : n( 0 ), sx( 0 ), sxx( 0 ), sy( 0 ), sxy( 0 ) {}
+    void add( double size, double nanoseconds ) {
+        n   += 1;
+        sx  += size;        sxx += size*size;
+        sy  += nanoseconds; sxy += size*nanoseconds;
+    }
+    void merge( CostFit const& o ) {
+        n += o.n; sx += o.sx; sxx += o.sxx; sy += o.sy; sxy += o.sxy;
+    }
+    // Both in nanoseconds, and zero if there is no data. If all the
+    // entries are the same size then all the time  is  put  down
+    // to the fixed cost.
+    double per_byte() const {
+        double d = n*sxx - sx*sx;
+        if( n < 2 || d <= 0 )
+            return 0;
+        return std::max( (n*sxy - sx*sy)/d, 0.0 );
+    }
+    double per_file() const {
+        return n > 0 ? std::max( (sy - per_byte()*sx)/n, 0.0 ) : 0;
+    }
+    double n, sx, sxx, sy, sxy;
+};
+
+// Classes of entries by uncompressed size, for the breakdown in the
+// summary: empty, under 4K, under 64K, under 1M, under 64M and the
+// rest. These separate the runs dominated by the fixed cost of each
+// file from those dominated by decompressing or writing.
+enum class SizeClass {
+    empty,
+    under_4k,
+    under_64k,
+    under_1m,
+    under_64m,
+    larger,
+    count
+};
+
+SizeClass size_class( uint64_t size );
+
+// Label for reports, e.g. "<64K".
+char const* size_class_name( SizeClass c );
+
+/****************************************************************
+* The time taken to extract one entry.
+****************************************************************/
+struct EntryTiming {
+    std::string name;
+    uint64_t    size;
+    uint64_t    nanoseconds;
+};
+
+/****************************************************************
+* Totals over a group of entries: those that share a compression
+* method, or those that fall in one size class.
+****************************************************************/
+struct EntryStats {
+    EntryStats()
+        : files( 0 ), bytes( 0 ), comp_bytes( 0 ), nanoseconds( 0 )
+    {}
+    void merge( EntryStats const& o ) {
+        files += o.files; bytes += o.bytes; comp_bytes += o.comp_bytes;
+        nanoseconds += o.nanoseconds;
+    }
+    size_t   files;
+    // Uncompressed and compressed bytes.
+    uint64_t bytes;
+    uint64_t comp_bytes;
+    // Time spent on these entries (decompressing and writing them
+    // and everything else done for each one), summed over all of
+    // the threads (so this is thread time and not wall time).
+    uint64_t nanoseconds;
+};
+
 /****************************************************************
 * This structure is used to return statistics and diagnostic info
 * collected  during  the  parallel unzip process which can aid in
@@ -28,7 +146,9 @@ using TSXFormer = std::function<time_t( time_t )>;
 ****************************************************************/
 struct UnzipSummary {
 
-    UnzipSummary( size_t jobs );
+    // `cpus` is normally effective_cpus(), which the caller passes
+    // in so that this does not go looking for it on every run.
+    UnzipSummary( size_t jobs, size_t cpus );
 
     std::string            filename;
     // These next two should just echo the values that are passed
@@ -38,6 +158,16 @@ struct UnzipSummary {
     // used.
     size_t                 jobs_used;
     std::string            strategy_used;
+    // "libzip" or "native" (see ZipEngine), the latter with the
+    // inflate backends, e.g. "native (libdeflate <= 8.0MB, isal)".
+    // If the native reader was asked for but the archive  needed
+    // libzip then this says why, e.g. "libzip (entry 3 uses bzip2)".
+    std::string            engine_used;
+    // Number of CPUs that we could actually use (see effective_cpus)
+    // for comparison with the number of jobs.
+    size_t                 cpus;
+    // What was done with the entries (extraction or testing).
+    UnzipMode              mode;
     // Size in bytes  of  chunk_size  actually  used.  This would
     // differ from the one passed  into  the  function if zero is
     // passed in which case chunk_size is the size of the largest
@@ -55,6 +185,42 @@ struct UnzipSummary {
     size_t                 folders;
     // Number of files for which temp names were assigned
     size_t                 num_temp_names;
+    // When resuming, the number of files skipped because the jour-
+    // nal showed that they had already been extracted. These are
+    // not included in `files` or `bytes`.
+    size_t                 resumed;
+    // Breakdown of files, bytes and time by compression  method
+    // (ZIP_CM_*) across all threads.
+    std::map<uint16_t, EntryStats> methods;
+    // The same broken down by size class (see SizeClass).
+    EntryStats             sizes[size_t( SizeClass::count )];
+    // Fit of the time taken by each entry against its size, across
+    // all threads.
+    CostFit                fit;
+    // Breakdown of each thread's time by phase (see phases.hpp).
+    // Empty when creating an archive.
+    std::vector<PhaseTimes> phases_ts;
+    // What the kernel reports for each thread over its run, which
+    // together with the phase times shows how long it spent  off
+    // the CPU. Empty when creating an archive.
+    std::vector<ThreadUsage> usage_ts;
+    // Memory usage over the run (see memory.hpp).
+    MemoryStats            memory;
+    // Samples of the I/O counters of the process (see ProcessIo),
+    // the first taken at the start and then one after each  step,
+    // named after the step. The I/O of a step is the  difference
+    // between its sample and the one before. Device writes leave
+    // out whatever is still dirty in the page cache at the end.
+    std::vector<std::pair<std::string, ProcessIo>> io_samples;
+    // The thread that took the longest (zero based), and the last
+    // few entries that it extracted, in order. These are the ones
+    // that held up the finish, so they are the ones to look at  when
+    // the threads are out of balance. Empty when creating.
+    size_t                 slowest_thread;
+    std::vector<EntryTiming> critical_path;
+    // In test mode, this holds one line for each entry that failed
+    // verification, giving its name and the reason.
+    std::vector<std::string> corrupt;
     // This holds timing info for the top-level process.
     StopWatch              watch;
     // These hold timeing info for the individual threads.
@@ -67,6 +233,10 @@ struct UnzipSummary {
 std::ostream& operator<<( std::ostream& out,
                           UnzipSummary const& us );
 
+// The same information as a single JSON object on one line, for
+// scripts. Times are in milliseconds and sizes in bytes.
+void print_json( std::ostream& out, UnzipSummary const& us );
+
 /****************************************************************
 * Main interface to invoke a parallel unzip.
 *****************************************************************
@@ -98,7 +268,10 @@ std::ostream& operator<<( std::ostream& out,
 * tity" function, effectively causing  the timestamps archived in
 * the zip to be used (erasing time zone, as usual). If this  func-
 * tion returns zero then no  timestamp  will  be  set on the file,
-* effectively just defaulting to the file extraction time.
+* effectively just defaulting to the file extraction time. An empty
+* function is taken to mean the same thing. Both the empty func-
+* tion and id<time_t> are recognized and handled without  calling
+* through the std::function for each file.
 *
 * short_exts: Turn on a behavior (intended to be an optimization)
 * where  all  filenames  with extensions longer than three charac-
@@ -109,6 +282,36 @@ std::ostream& operator<<( std::ostream& out,
 * sibly  strange  performance issues with file creation times for
 * file names meeting certain criteria.
 *
+* mode: when UnzipMode::test then  each  file  is decompressed into
+* a scratch buffer and checked against its stored size  and  CRC,
+* but nothing is written to disk (and `output`, `ts_xform` and
+* `short_exts` are ignored). Corrupt entries  do  not cause this
+* function to throw; they are instead listed in the summary. The
+* benchmark modes null_sink and write_only run the same threads
+* and strategy as a real extraction (see UnzipMode), so that their
+* summaries can be compared with one.
+*
+* password: used to decrypt any encrypted entries (traditional or
+* WinZip AES). Ignored if empty.
+*
+* journal: if not empty then this is a folder in which to keep  a
+* checkpoint journal of the entries that have been extracted (see
+* journal.hpp). Only allowed when extracting.
+*
+* resume: when true the journal left by  an  earlier  run  on  the
+* same archive is replayed and the entries that it  records  are
+* skipped, unless their files are missing or have the wrong size
+* (e.g., because they were being written when that run died). The
+* remaining entries are then distributed among the threads as usual.
+*
+* engine: which code reads the archive (see ZipEngine). With  the
+* native reader, archives which it cannot handle are read by libzip
+* instead, and the summary says so.
+*
+* inflate: with the native reader, how the deflated  entries  are
+* decompressed (see inflate.hpp). The default is the best that  is
+* built in.
+*
 * This function will throw on any  error.  So if it returns, then
 * hopefully  that  means  that  everything went according to plan.
 * The object returned  will  contain  diagnostic  info  collected
@@ -120,4 +323,10 @@ UnzipSummary p_unzip( std::string filename,
                       std::string strategy   = DEFAULT_DIST,
                       size_t      chunk_size = DEFAULT_CHUNK,
                       TSXFormer   ts_xform   = id<time_t>,
-                      bool        short_exts = false );
+                      bool        short_exts = false,
+                      UnzipMode   mode       = UnzipMode::extract,
+                      std::string password   = "",
+                      std::string journal    = "",
+                      bool        resume     = false,
+                      ZipEngine   engine     = ZipEngine::libzip,
+                      InflatePlan inflate    = best_inflate_plan() );
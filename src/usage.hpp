@@ -5,16 +5,42 @@
 ****************************************************************/
 #pragma once
 
+#include <map>
+#include <string>
+
 namespace usage {
 
 static char const* info =
     "p-unzip: multithreaded unzipper."                       "\n"
     "Usage: p-unzip [options] file.zip"                      "\n"
+    "       p-unzip [options] -Z folder file.zip"            "\n"
     ""                                                       "\n"
     "   -h          : Show usage and exit"                   "\n"
     ""                                                       "\n"
     "   -q          : Quiet -- do not print files names"     "\n"
     ""                                                       "\n"
+    "   -T          : Test archive: decompress every entry"  "\n"
+    "                 in parallel and verify sizes and"      "\n"
+    "                 CRCs, but do not create any files or"  "\n"
+    "                 folders.  Corrupt entries are listed"  "\n"
+    "                 on stdout and the exit code is 1 if"   "\n"
+    "                 there are any."                        "\n"
+    ""                                                       "\n"
+    "   -l          : List the archive instead of"         "\n"
+    "                 extracting it.  Entries are formatted" "\n"
+    "                 in parallel using -j threads."         "\n"
+    ""                                                       "\n"
+    "   -s key      : Sort the listing by key, which can be" "\n"
+    "                 one of: name, size, comp_size, ratio," "\n"
+    "                 offset.  Append :desc to reverse."     "\n"
+    "                 Default is archive order."             "\n"
+    ""                                                       "\n"
+    "   -f pattern  : Only list entries whose names match"   "\n"
+    "                 pattern, where * and ? are wildcards." "\n"
+    ""                                                       "\n"
+    "   -J          : Output JSON.  For listings this is"    "\n"
+    "                 one object per line (JSON lines)."     "\n"
+    ""                                                       "\n"
     "   -t          : Timestamps policy. Can be one of:"     "\n"
     "                 current - use timestamp at time of"    "\n"
     "                           writing."                    "\n"
@@ -27,17 +53,28 @@ static char const* info =
     "                 erical value, N can be one of:"        "\n"
     "                 { max, auto }.  max is max threads"    "\n"
     "                 available, auto is optimal number for" "\n"
-    "                 this system."                          "\n"
+    "                 this system.  Both respect the CPU"    "\n"
+    "                 affinity, cpuset and CPU quota of the" "\n"
+    "                 container, if any."                    "\n"
     ""                                                       "\n"
     "   -d strategy : Specify distribution strategy"         "\n"
-    "                 Can be: cyclic, sliced, bytes,"        "\n"
-    "                 folder_bytes, or folder_files."        "\n"
+    "                 Can be: cyclic, sliced, bytes, cost,"  "\n"
+    "                 folder_bytes, folder_files, or"        "\n"
+    "                 folder_cost.  The cost strategies"     "\n"
+    "                 weight bytes by how slow each"         "\n"
+    "                 compression method is to decompress."  "\n"
+    "                 Can also be plugin:lib.so[:function]"  "\n"
+    "                 to load a strategy from a shared"      "\n"
+    "                 object (see strategy_abi.h)."          "\n"
     "                 Default is cyclic."                    "\n"
     ""                                                       "\n"
     "   -c size     : Specify chunk size in bytes.  These"   "\n"
     "                 are the blocks in which data is"       "\n"
     "                 decompressed and written to disk."     "\n"
-    "                 Default is some sensible value."       "\n"
+    "                 auto picks a size based on the memory" "\n"
+    "                 available (respecting container"       "\n"
+    "                 limits).  Default is some sensible"    "\n"
+    "                 value."                                "\n"
     ""                                                       "\n"
     "   -o          : Specify output folder.  This folder"   "\n"
     "                 will be prepended to all files in the" "\n"
@@ -53,12 +90,158 @@ static char const* info =
     "                 extraction times.  All other users"    "\n"
     "                 or platforms should ignore it."        "\n"
     ""                                                       "\n"
-    "   -g          : Output diagnostic info to stderr."     "\n";
+    "   -P password : Password for encrypted entries.  Both" "\n"
+    "                 traditional and AES encryption are"    "\n"
+    "                 supported."                            "\n"
+    ""                                                       "\n"
+    "   -K file     : Read the password from the first line" "\n"
+    "                 of file, so that it does not appear"   "\n"
+    "                 in the process list."                  "\n"
+    ""                                                       "\n"
+    "   -k folder   : Keep a checkpoint journal of the"      "\n"
+    "   --journal     extracted entries in folder so that"   "\n"
+    "                 the extraction can be resumed if it"   "\n"
+    "                 is killed or crashes (but not after"   "\n"
+    "                 a power loss)."                        "\n"
+    ""                                                       "\n"
+    "   -R          : Resume using the journal given by -k," "\n"
+    "   --resume      skipping entries already extracted."   "\n"
+    "                 Files that are missing or have the"    "\n"
+    "                 wrong size are extracted again."       "\n"
+    ""                                                       "\n"
+    "   -p          : Use and update the host profile. The"  "\n"
+    "                 jobs, chunk size and strategy that"    "\n"
+    "                 have worked best for the output file"  "\n"
+    "                 system before are used unless given,"  "\n"
+    "                 and what this run measures is saved"   "\n"
+    "                 under $XDG_CACHE_HOME/p-unzip."        "\n"
+    ""                                                       "\n"
+    "   -e engine   : What reads the archive:"               "\n"
+    "                 libzip - libzip (the default)."        "\n"
+    "                 native - the built-in reader, for"     "\n"
+    "                          stored and deflated entries"  "\n"
+    "                          without encryption; other"    "\n"
+    "                          archives fall back to libzip" "\n"
+    "                          (-g says which was used)."    "\n"
+    ""                                                       "\n"
+    "   -i backend  : With -e native, what decompresses the"  "\n"
+    "   --inflate     deflated entries: zlib, or zlib-ng,"   "\n"
+    "                 isal or libdeflate if they were built" "\n"
+    "                 in.  Default is auto: libdeflate for"  "\n"
+    "                 entries of up to 8MB and the fastest"  "\n"
+    "                 streaming backend for this CPU for"    "\n"
+    "                 the rest.  libdeflate alone streams"   "\n"
+    "                 entries over 8MB with zlib."           "\n"
+    ""                                                       "\n"
+    "   -B bench    : Benchmark one half of extraction:"     "\n"
+    "                 null  - decompress and check each"     "\n"
+    "                         entry but discard it."         "\n"
+    "                 write - write each file with made-"    "\n"
+    "                         up contents of the right"      "\n"
+    "                         size, without decompressing."  "\n"
+    "                 Use with -g to compare with a real"    "\n"
+    "                 extraction."                           "\n"
+    ""                                                       "\n"
+    "   -S max_jobs : Thread scaling benchmark: extract"     "\n"
+    "   --bench-scaling with 1, 2, 4 ... max_jobs threads"   "\n"
+    "                 (or \"max\" for all CPUs) into a"      "\n"
+    "                 scratch folder under -o, deleting it"  "\n"
+    "                 after each run, and report speedup"    "\n"
+    "                 and the fitted serial fraction.  With" "\n"
+    "                 -d all, sweeps every strategy."        "\n"
+    ""                                                       "\n"
+    "   -C reps     : Comparison benchmark: extract with"    "\n"
+    "   --bench-compare p-unzip and with each of unzip,"     "\n"
+    "                 bsdtar and 7z that is installed, reps" "\n"
+    "                 times each with a cold and with a"     "\n"
+    "                 warm cache, check that the files are"  "\n"
+    "                 right, and report wall and CPU time,"  "\n"
+    "                 peak RSS and system calls (if strace"  "\n"
+    "                 is installed).  If the zip file is"    "\n"
+    "                 given as \"synthetic\" then archives"  "\n"
+    "                 of several shapes are made and used."  "\n"
+    ""                                                       "\n"
+    "   -I reps     : Inflate benchmark: decompress the"     "\n"
+    "   --bench-inflate deflated entries of the archive in"  "\n"
+    "                 memory on one thread, reps times with" "\n"
+    "                 each inflate backend that is built in" "\n"
+    "                 (see -i), and report the throughput"   "\n"
+    "                 on small and on large entries."        "\n"
+    ""                                                       "\n"
+    "   -E          : With -S, drop the archive from the"    "\n"
+    "   --evict       page cache before each run."           "\n"
+    ""                                                       "\n"
+    "   -H          : Append the summary of this run, with a"  "\n"
+    "   --history     fingerprint of the archive, the host,"   "\n"
+    "                 the versions of p-unzip and libzip"    "\n"
+    "                 and the settings, to history.csv in"   "\n"
+    "                 the same folder as the profile (-p)."  "\n"
+    ""                                                       "\n"
+    "   -r          : Don't extract; compare the runs in the" "\n"
+    "   --compare     history of this archive with these"    "\n"
+    "                 settings, and exit with code 2 if the" "\n"
+    "                 latest are significantly slower than"  "\n"
+    "                 those of the previous version."        "\n"
+    ""                                                       "\n"
+    "   -b version  : With -r, compare against the runs of"  "\n"
+    "   --baseline    this version (its revision will do)"   "\n"
+    "                 instead of the previous one."          "\n"
+    ""                                                       "\n"
+    "   -A          : Analyze the archive from its central"  "\n"
+    "                 directory alone and recommend the"     "\n"
+    "                 strategy, jobs and chunk size to use"  "\n"
+    "                 for extracting it.  Use -J for JSON."  "\n"
+    ""                                                       "\n"
+    "   -g          : Output diagnostic info to stderr."     "\n"
+    "                 With -J this is one JSON object."      "\n"
+    ""                                                       "\n"
+    "   -n model    : Dry run: predict the extraction time"  "\n"
+    "   --simulate    of every strategy with -j threads"     "\n"
+    "                 and report the best, without"          "\n"
+    "                 extracting.  model is the cost of"     "\n"
+    "                 each entry: one of default, profile"   "\n"
+    "                 (see -p), or <file_ns>,<byte_ns>."     "\n"
+    "                 Use -J for JSON."                      "\n"
+    ""                                                       "\n"
+    "   -Z folder   : Create file.zip from the contents of"  "\n"
+    "                 folder instead of extracting.  The"    "\n"
+    "                 -j, -d, -c, -q and -g options apply"   "\n"
+    "                 in the same way."                      "\n"
+    ""                                                       "\n"
+    "   -m method   : Compression method when creating."     "\n"
+    "                 Can be: deflate, store."               "\n"
+    "                 Default is deflate."                   "\n"
+    ""                                                       "\n"
+    "   -D          : When creating, sort the entries by"    "\n"
+    "                 name so that the archive does not"     "\n"
+    "                 depend on the order of the parallel"   "\n"
+    "                 folder walk."                          "\n";
 
 // Options that do not take a value
-static auto options_no_val   = { 'h', 'q', 'a', 'g' };
+static auto options_no_val   = { 'h', 'q', 'a', 'g', 'T', 'l', 'J',
+                                 'D', 'R', 'p', 'A', 'E', 'H', 'r' };
 // Options that must take a value
-static auto options_val      = { 'j', 'd', 'c', 't', 'o' };
+static auto options_val      = { 'j', 'd', 'c', 't', 'o', 's', 'f',
+                                 'Z', 'm', 'P', 'K', 'k', 'n', 'B',
+                                 'S', 'C', 'e', 'i', 'I', 'b' };
+
+// Long options (without the leading dashes) and the options  that
+// they stand for.
+static std::map<std::string, char> long_options = {
+    { "journal",  'k' },
+    { "resume",   'R' },
+    { "simulate", 'n' },
+    { "analyze",  'A' },
+    { "bench-scaling", 'S' },
+    { "bench-compare", 'C' },
+    { "bench-inflate", 'I' },
+    { "inflate",  'i' },
+    { "history",  'H' },
+    { "compare",  'r' },
+    { "baseline", 'b' },
+    { "evict",    'E' },
+    { "help",     'h' }
+};
 
 // Minimum number of positional arguments  that any valid command-
 // line must have.
@@ -2,6 +2,7 @@
 * General utilities
 ****************************************************************/
 #include "macros.hpp"
+#include "memory.hpp"
 #include "utils.hpp"
 
 #include <cstdint>
@@ -25,6 +26,27 @@ uint32_t string_hash( string const& s ) {
     return hash;
 }
 
+// Shell-style wildcard match. This is the usual greedy algorithm
+// with  backtracking  to  the  most  recent star, which runs in
+// linear time for typical patterns.
+bool glob_match( char const* pat, char const* s, size_t len ) {
+    char const* end   = s + len;
+    char const* star  = NULL; // position in pat after last '*'
+    char const* retry = NULL; // where to resume in s on mismatch
+    while( s != end ) {
+        if( *pat == '*' ) {
+            star = ++pat; retry = s;
+        } else if( *pat && ( *pat == '?' || *pat == *s ) ) {
+            ++pat; ++s;
+        } else if( star ) {
+            pat = star; s = ++retry;
+        } else
+            return false;
+    }
+    while( *pat == '*' ) ++pat;
+    return *pat == 0;
+}
+
 /****************************************************************
 * Convenience methods
 ****************************************************************/
@@ -45,6 +67,40 @@ std::string human_bytes( uint64_t bytes ) {
     return out.str();
 }
 
+// Append a string to `s` as a quoted JSON string.
+void append_json_string( string& s, char const* p, size_t len ) {
+    s += '"';
+    for( size_t i = 0; i < len; ++i ) {
+        unsigned char c = p[i];
+        if( c == '"' || c == '\\' ) {
+            s += '\\'; s += char( c );
+        } else if( c < 0x20 ) {
+            char buf[8];
+            snprintf( buf, sizeof( buf ), "\\u%04x", c );
+            s += buf;
+        } else
+            s += char( c );
+    }
+    s += '"';
+}
+
+// Format a duration in human readable form.
+string human_duration( uint64_t ns ) {
+    ostringstream out;
+    uint64_t ms = ns/1000000, s = ms/1000, m = s/60;
+    if( m > 0 )
+        out << m << "m" << s % 60 << "s";
+    else if( s > 0 ) {
+        out << s;
+        if( s < 10 )
+            out << "." << setw( 3 ) << setfill( '0' ) << ms % 1000;
+        out << "s";
+    }
+    else
+        out << ms << "ms";
+    return out.str();
+}
+
 /****************************************************************
 * StopWatch
 ****************************************************************/
@@ -67,6 +123,11 @@ void StopWatch::stop( string const& name ) {
 // Get results for an even in the given units. If either a  start
 // or  end  time for the event has not been registered then these
 // will throw.
+int64_t StopWatch::microseconds( string const& name ) const {
+    FAIL_( !event_complete( name ) );
+    return chrono::duration_cast<chrono::microseconds>(
+        end_times.at( name ) - start_times.at( name ) ).count();
+}
 int64_t StopWatch::milliseconds( string const& name ) const {
     FAIL_( !event_complete( name ) );
     return chrono::duration_cast<chrono::milliseconds>(
@@ -131,8 +192,10 @@ bool StopWatch::event_complete( string const& name ) const {
 Buffer::Buffer( size_t length ) : length( length ) {
     FAIL_( !(p = (void*)( new uint8_t[length] )) );
     own = true;
+    mem_counter( MemTag::buffers ).add( length );
 }
 
 void Buffer::destroyer() {
     delete[] (uint8_t*)( p );
+    mem_counter( MemTag::buffers ).sub( length );
 }
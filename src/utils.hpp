@@ -8,9 +8,11 @@
 
 #include <algorithm>
 #include <chrono>
+#include <exception>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -20,6 +22,15 @@
 // Format a quantity of bytes in human readable form.
 std::string human_bytes( uint64_t bytes );
 
+// Format a duration given in nanoseconds in human readable form,
+// in the same style as StopWatch::human.
+std::string human_duration( uint64_t nanoseconds );
+
+// Append a string to `s` as a quoted JSON string. Bytes  outside
+// of ASCII are passed through untouched, which is fine for names
+// in UTF-8 (the common case).
+void append_json_string( std::string& s, char const* p, size_t len );
+
 // Does the set contain the given key.
 template<typename ContainerT, typename KeyT>
 bool has_key( ContainerT const& s, KeyT const& k ) {
@@ -74,6 +85,11 @@ T to_uint( std::string const& s ) {
     return static_cast<T>( res );
 }
 
+// Match a string against a  shell-style  wildcard  pattern where
+// `*` matches any run of characters (including slashes) and `?`
+// matches any single character. Everything else is literal.
+bool glob_match( char const* pat, char const* s, size_t len );
+
 // "Identity" function (returns argument by value)
 template<typename T>
 auto id( T t ) -> T { return t; }
@@ -101,6 +117,75 @@ auto maximum( It start, It end, KeyF f ) -> decltype( *start ) {
     return *max_iter;
 }
 
+// Split the range [0,n) into at most `jobs` contiguous chunks of
+// roughly  equal size and call func( chunk, begin, end ) for each
+// chunk on its own thread, then wait for all of them. The  chunks
+// are numbered in order so that the caller can keep per-chunk re-
+// sults  and  stitch them together afterwards. If any invocation
+// throws then the first such exception is rethrown here after all
+// threads have been joined.
+template<typename FuncT>
+void parallel_chunks( size_t n, size_t jobs, FuncT func ) {
+    jobs = std::max( std::min( jobs, n ), size_t( 1 ) );
+    std::vector<std::thread>        threads;
+    std::vector<std::exception_ptr> errors( jobs );
+    for( size_t c = 0; c < jobs; ++c ) {
+        size_t begin = n*c/jobs, end = n*(c+1)/jobs;
+        threads.emplace_back( [&func, &errors, c, begin, end]{
+            try { func( c, begin, end ); }
+            catch( ... ) { errors[c] = std::current_exception(); }
+        } );
+    }
+    for( auto& t : threads )
+        t.join();
+    for( auto const& e : errors )
+        if( e ) std::rethrow_exception( e );
+}
+
+// Sort v using up to `jobs` threads. Contiguous chunks are sorted
+// concurrently and then merged pairwise, with the merges of  each
+// round also running concurrently, so this takes log2(jobs) merge
+// rounds. Small inputs are just sorted in place. Like  std::sort,
+// this is not stable.
+template<typename T, typename CompareT>
+void parallel_sort( std::vector<T>& v, size_t jobs, CompareT cmp ) {
+    size_t n = v.size();
+    if( jobs < 2 || n < (size_t( 1 ) << 16) ) {
+        std::sort( v.begin(), v.end(), cmp );
+        return;
+    }
+    jobs = std::min( jobs, n );
+    // These must match the chunk boundaries of parallel_chunks.
+    std::vector<size_t> bounds;
+    for( size_t c = 0; c <= jobs; ++c )
+        bounds.push_back( n*c/jobs );
+    parallel_chunks( n, jobs, [&]( size_t, size_t begin, size_t end ){
+        std::sort( v.begin()+begin, v.begin()+end, cmp );
+    } );
+    std::vector<T>  tmp( n );
+    std::vector<T>* src = &v;
+    std::vector<T>* dst = &tmp;
+    while( bounds.size() > 2 ) {
+        size_t runs  = bounds.size()-1;
+        size_t pairs = (runs+1)/2;
+        parallel_chunks( pairs, pairs, [&]( size_t p, size_t, size_t ){
+            auto at = [&]( size_t i ){
+                return src->begin()+bounds[std::min( i, runs )];
+            };
+            std::merge( at( 2*p ), at( 2*p+1 ), at( 2*p+1 ), at( 2*p+2 ),
+                        dst->begin()+bounds[2*p], cmp );
+        } );
+        std::vector<size_t> next;
+        for( size_t r = 0; r < runs; r += 2 )
+            next.push_back( bounds[r] );
+        next.push_back( n );
+        bounds.swap( next );
+        std::swap( src, dst );
+    }
+    if( src != &v )
+        v.swap( tmp );
+}
+
 /****************************************************************
 * StopWatch
 ****************************************************************/
@@ -126,6 +211,7 @@ public:
     // Get results for an even in the given units.  If  either  a
     // start or end time for the event has  not  been  registered
     // then these will throw.
+    int64_t microseconds( std::string const& name ) const;
     int64_t milliseconds( std::string const& name )const ;
     int64_t seconds( std::string const& name ) const;
     int64_t minutes( std::string const& name ) const;
@@ -1,6 +1,13 @@
+#include "directory.hpp"
+#include "phases.hpp"
+#include "reader.hpp"
 #include "zip.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <set>
 #include <stdexcept>
+#include <zlib.h>
 
 using namespace std;
 
@@ -24,14 +31,24 @@ Zip::Zip( Buffer::SP& b_ ) : b( b_ ) {
     // Lastly, count number of files in  the archive and get each
     // of their stats and cache them.
     int64_t size = zip_get_num_entries( p, ZIP_FL_UNCHANGED );
+    stats_vector v;
     for( int64_t i = 0; i < size; ++i ) {
         zip_stat_t stat;
         FAIL( zip_stat_index( p, i, ZIP_FL_UNCHANGED, &stat ),
            "failed to stat item" << i );
-        stats.emplace_back( stat );
+        v.emplace_back( stat );
     }
+    stats = make_shared<stats_vector const>( move( v ) );
 }
 
+// The stats belong to the native archive, so share its ownership.
+Zip::Zip( Buffer::SP& b_, shared_ptr<NativeArchive const> native_ )
+    : b( b_ )
+    , stats( native_, &native_->stats() )
+    , native( native_ )
+    , inflater( make_shared<Inflater>( native_->plan() ) )
+{}
+
 // Create  a  new  buffer of the size necessary to hold the uncom-
 // pressed contents, then  do  the  uncompression  and return the
 // buffer.
@@ -48,21 +65,51 @@ void Zip::extract_to( uint64_t idx,
                       Buffer&  buf ) const {
     FAIL_( buf.size() == 0 );
     // First open the file to which  we  will  write  the  result.
-    File out( file, "wb" );
+    File out = [&]{
+        PhaseScope timer( Phase::open );
+        return File( file, "wb" );
+    }();
+    if( native ) {
+        string why;
+        bool ok = native->read( idx, *inflater, buf,
+            [&]( void const* data, size_t size ){
+                PhaseScope timer( Phase::write );
+                out.write( data, size );
+            }, why );
+        {
+            PhaseScope timer( Phase::open );
+            out.destroy();
+        }
+        FAIL( !ok, "failed to extract " << at( idx ).name() << ": "
+            << why );
+        return;
+    }
     // Get uncompressed file size
     zip_int64_t fsize = at( idx ).size();
     zip_file_t* zf;
     // "open" the zip file; this is not  really  opening  a  file.
-    FAIL_( !(zf = zip_fopen_index( p, idx, 0 )) );
+    // It does however seek and, for some methods, set up the  de-
+    // compressor, so it counts as inflating.
+    {
+        PhaseScope timer( Phase::inflate );
+        zf = zip_fopen_index( p, idx, 0 );
+    }
+    FAIL( !zf, "failed to open " << at( idx ).name() << ": " <<
+        zip_strerror( p ) );
     // !! Should not throw until zip_fclose is called
     zip_int64_t total = 0;
     while( true ) {
-        auto read = zip_fread( zf, buf.get(), buf.size() );
+        zip_int64_t read;
+        {
+            PhaseScope timer( Phase::inflate );
+            read = zip_fread( zf, buf.get(), buf.size() );
+        }
         // May  return  -1 on error; not clear whether it will re-
         // turn  zero  if  no  error but no bytes read. In either
         // case, it's probably correct to  just  break out of the
         // loop instead of throwing if read <= 0.
         if( read <= 0 ) break;
+        PhaseScope timer( Phase::write );
         out.write( buf, read );
         // We need to keep a  running  total  of bytes written so
         // that we can check at the  end if they were all written.
@@ -72,6 +119,13 @@ void Zip::extract_to( uint64_t idx,
     }
     // !! Close immediately to avoid resource leak.
     zip_fclose( zf );
+    // Closing flushes whatever the C runtime still has  buffered,
+    // which is usually the tail of the file, and on some systems
+    // is where most of the cost of creating a file lands.
+    {
+        PhaseScope timer( Phase::open );
+        out.destroy();
+    }
     // If we haven't read a number of bytes equal to the reported
     // size of the uncompressed file then  throw.  Otherwise  suc-
     // ceed. This should be adequate no matter how  we  got  here
@@ -79,11 +133,66 @@ void Zip::extract_to( uint64_t idx,
     FAIL_( total != fsize );
 }
 
+// Uncompress a file in chunks into a scratch buffer and  compare
+// the size and CRC-32 of the  result  against  the values stored
+// in the archive. Nothing is written to disk. Note that  libzip
+// will itself flag a CRC  mismatch  as  a  read error at the end
+// of the stream, but we don't want to depend on that,  so  we do
+// our own check as well.
+bool Zip::test( uint64_t idx, Buffer& buf, string& why ) const {
+    FAIL_( buf.size() == 0 );
+    // This times the inflating (and the CRC) itself.
+    if( native )
+        return native->read( idx, *inflater, buf,
+            []( void const*, size_t ){}, why );
+    // All of this, including the checksum, counts as inflating.
+    PhaseScope timer( Phase::inflate );
+    ZipStat const& zs = at( idx );
+    zip_file_t* zf;
+    if( !(zf = zip_fopen_index( p, idx, 0 )) ) {
+        why = string( "failed to open entry: " ) + zip_strerror( p );
+        return false;
+    }
+    // !! Should not throw until zip_fclose is called
+    zip_uint64_t total = 0;
+    uLong        crc   = crc32( 0L, Z_NULL, 0 );
+    bool         error = false;
+    // zlib's crc32 takes a  32  bit  length,  so  don't  read more
+    // than that in one go even if the buffer is larger.
+    size_t chunk = min( buf.size(), size_t( 1 ) << 30 );
+    while( true ) {
+        auto read = zip_fread( zf, buf.get(), chunk );
+        if( read < 0 ) { error = true; break; }
+        if( read == 0 ) break;
+        crc = crc32( crc, (Bytef const*)buf.get(), uInt( read ) );
+        total += read;
+    }
+    // !! Close immediately to avoid resource leak.
+    zip_fclose( zf );
+    if( error )
+        why = "read error (bad data or CRC)";
+    else if( total != zs.size() )
+        why = "size mismatch: expected " + to_string( zs.size() ) +
+              ", got " + to_string( total );
+    else if( crc != zs.crc() )
+        why = "CRC mismatch";
+    else
+        return true;
+    return false;
+}
+
 // Uncompress file into existing buffer.  Throws if the buffer is
 // not big enough.
 void Zip::extract_in( uint64_t idx, Buffer& buffer ) const {
     uint64_t fsize( at( idx ).size() );
     FAIL_( fsize > buffer.size() );
+    if( native ) {
+        // The data is decompressed straight into the buffer.
+        string why;
+        FAIL( !native->read_into( idx, *inflater, buffer.get(), why ),
+            "failed to extract " << at( idx ).name() << ": " << why );
+        return;
+    }
     zip_file_t* zf;
     FAIL_( !(zf = zip_fopen_index( p, idx, 0 )) );
     // !! Should not throw until zip_fclose is called
@@ -106,10 +215,52 @@ void Zip::destroyer() {
     zip_close( p );
 }
 
+// Check that libzip supports all the compression methods  used
+// in the archive, such as zstd, xz, lzma or bzip2, which are op-
+// tional when libzip is built.
+void Zip::check_methods() const {
+    set<zip_uint16_t> methods;
+    for( auto const& zs : *stats )
+        methods.insert( zs.method() );
+    for( auto m : methods )
+        FAIL( !zip_compression_method_supported( m, 0 ),
+            "archive contains entries compressed with " <<
+            method_name( m ) << " (method " << m << ") but libzip "
+            "was built without support for it" );
+    set<zip_uint16_t> ciphers;
+    for( auto const& zs : *stats )
+        ciphers.insert( zs.encryption() );
+    for( auto c : ciphers )
+        FAIL( c != ZIP_EM_NONE && !zip_encryption_method_supported( c, 0 ),
+            "archive contains entries encrypted with method " << c <<
+            " but libzip was built without support for it" );
+}
+
+// Set the password for encrypted entries. For WinZip AES entries
+// libzip does the PBKDF2 key derivation,  the  AES-CTR  decryption
+// and the HMAC-SHA1 check using its crypto backend (OpenSSL, GnuTLS,
+// etc.), which uses the AES-NI and SHA instructions when the  CPU
+// has them.
+void Zip::set_password( string const& password ) {
+    // The native reader only takes archives with no encryption.
+    if( native )
+        return;
+    FAIL( zip_set_default_password( p, password.c_str() ) != 0,
+        "failed to set password" );
+}
+
+// True if any entry in the archive is encrypted.
+bool Zip::has_encrypted() const {
+    for( auto const& zs : *stats )
+        if( zs.encryption() != ZIP_EM_NONE )
+            return true;
+    return false;
+}
+
 // Access a given element of the archive.
 ZipStat const& Zip::at( uint64_t idx ) const {
-    FAIL_( idx >= stats.size() );
-    return stats[size_t( idx )];
+    FAIL_( idx >= stats->size() );
+    return (*stats)[size_t( idx )];
 }
 
 /****************************************************************
@@ -124,8 +275,12 @@ zip_uint64_t ZipStat::index() const {
 
 // File/folder name of entry. Folder names end with /
 string ZipStat::name() const {
+    return string( name_data() );
+}
+
+char const* ZipStat::name_data() const {
     FAIL_( !(stat.valid & ZIP_STAT_NAME) );
-    return string( stat.name );
+    return stat.name;
 }
 
 // Uncompressed size of entry.
@@ -140,6 +295,24 @@ zip_uint64_t ZipStat::comp_size() const {
     return stat.comp_size;
 }
 
+// CRC-32 of the uncompressed data as recorded in the archive.
+zip_uint32_t ZipStat::crc() const {
+    FAIL_( !(stat.valid & ZIP_STAT_CRC) );
+    return stat.crc;
+}
+
+// Compression method of the entry.
+zip_uint16_t ZipStat::method() const {
+    FAIL_( !(stat.valid & ZIP_STAT_COMP_METHOD) );
+    return stat.comp_method;
+}
+
+// Encryption method of the entry.
+zip_uint16_t ZipStat::encryption() const {
+    FAIL_( !(stat.valid & ZIP_STAT_ENCRYPTION_METHOD) );
+    return stat.encryption_method;
+}
+
 // Last mod time. This will be  rounded to the nearest two-second
 // boundary and contains no timezone since zip files do not store
 // timezone. So the time returned by  this function must be inter-
@@ -5,12 +5,24 @@
 
 #include "fs.hpp"
 #include "handle.hpp"
+#include "memory.hpp"
 #include "utils.hpp"
 
+#include <memory>
 #include <time.h>
 #include <vector>
 #include <zip.h>
 
+class Inflater;
+class NativeArchive;
+
+// Which code reads the archive: libzip, or the native reader  (see
+// reader.hpp) where the archive allows it.
+enum class ZipEngine {
+    libzip,
+    native
+};
+
 /****************************************************************
 * ZipStat
 ****************************************************************/
@@ -20,12 +32,22 @@ public:
     // This  is the zero-based index within the archive of the el-
     // ement represented by this ZipStat.
     zip_uint64_t index()     const;
-    // File/folder name of entry. Folder names end with /
+    // File/folder name of entry. Folder names end with /. The
+    // second version avoids an allocation; the name  it  points
+    // to lives as long as the Zip.
     std::string  name()      const;
+    char const*  name_data() const;
     // Uncompressed size of entry.
     zip_uint64_t size()      const;
     // Compressed size of entry.
     zip_uint64_t comp_size() const;
+    // CRC-32 of the uncompressed data as recorded in the archive.
+    zip_uint32_t crc()       const;
+    // Compression method (ZIP_CM_*) of the entry.
+    zip_uint16_t method()    const;
+    // Encryption method (ZIP_EM_*) of the entry; ZIP_EM_NONE if
+    // it is not encrypted.
+    zip_uint16_t encryption() const;
     // Last mode time. This will be rounded to the nearest
     // two-second  boundary  and  contains no timezone. Also, zip
     // files do not store timezone. So the time returned by  this
@@ -55,8 +77,15 @@ class Zip : public Handle<zip_t, Zip> {
 public:
     Zip( Buffer::SP& zs );
 
+    // Open the archive through the native reader, which has already
+    // parsed it. This is cheap, so each thread can have its own.
+    Zip( Buffer::SP& zs, std::shared_ptr<NativeArchive const> native );
+
+    // True if this Zip uses the native reader.
+    bool is_native() const { return bool( native ); }
+
     // This returns the size  of  the  vector of cached ZipStats.
-    size_t size() const { return stats.size(); }
+    size_t size() const { return stats->size(); }
 
     // Access the given element of  the archive with a zero-based
     // index  and  return  the  ZipStat describing it at the time
@@ -95,19 +124,52 @@ public:
                      std::string const& file,
                      Buffer&     buf ) const;
 
-    typedef std::vector<ZipStat>::const_iterator
+    // Uncompress file in chunks  into  the supplied scratch buffer
+    // (whose size sets the chunk size) without writing it  any-
+    // where, and verify that both the  number  of  bytes  and the
+    // CRC-32 of the data match what  the archive claims. This will
+    // not throw on a corrupt entry; instead it returns false  and
+    // puts a description of the problem into `why`.
+    bool test( uint64_t     idx,
+               Buffer&      buf,
+               std::string& why ) const;
+
+    // The cached stats are counted as metadata since  there  is  a
+    // copy of them for each thread.
+    using stats_vector = std::vector<ZipStat, CountingAllocator<
+                                     ZipStat, MemTag::metadata>>;
+    typedef stats_vector::const_iterator
             const_iterator;
 
     // These are to support range-based for, and  basically  just
     // exposed the iteration properties of the vector.
-    const_iterator begin() { return stats.begin(); }
-    const_iterator end()   { return stats.end();   }
+    const_iterator begin() { return stats->begin(); }
+    const_iterator end()   { return stats->end();   }
 
     void destroyer();
 
+    // Will throw with a helpful message if any  entry  in  the  ar-
+    // chive uses a compression or encryption method which the lib-
+    // zip that we are linked against cannot decode. This is better
+    // than failing part way through the extraction.
+    void check_methods() const;
+
+    // Set the password used to decrypt encrypted entries. Each Zip
+    // object holds its own copy, so each thread must set it.
+    void set_password( std::string const& password );
+
+    // True if any entry in the archive is encrypted.
+    bool has_encrypted() const;
+
 private:
     Buffer::SP b;
 
-    std::vector<ZipStat> stats;
+    // With the native reader these are shared by all the Zips open
+    // on the archive.
+    std::shared_ptr<stats_vector const> stats;
+    std::shared_ptr<NativeArchive const> native;
+    // The decompressor that this Zip reuses for each entry  when
+    // using the native reader.
+    std::shared_ptr<Inflater> inflater;
 
 };
@@ -0,0 +1,87 @@
+#!/bin/sh
+# Build and run the unit tests (tests.cpp) against the sources  in
+# src, then, if a p-unzip binary is given, the end-to-end  checks
+# with it. Everything happens in a scratch folder which is removed
+# at the end.
+#
+#   test/run.sh [path/to/p-unzip]
+#
+# CXX, CPPFLAGS, CXXFLAGS, LDFLAGS are honoured, and LIBS is added to
+# the link, e.g. LIBS="-ldeflate" with CXXFLAGS=-DP_UNZIP_LIBDEFLATE.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+src=$here/../src
+p_unzip=${1:-$P_UNZIP}
+if [ -n "$p_unzip" ]; then
+    p_unzip=$(cd "$(dirname "$p_unzip")" && pwd)/$(basename "$p_unzip")
+fi
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/p-unzip-test.XXXXXX")
+trap 'rm -rf "$work"' EXIT
+
+case $(uname) in
+    Linux)  os=-DOS_LINUX ;;
+    Darwin) os=-DOS_OSX   ;;
+    *)      os=-DOS_WIN   ;;
+esac
+
+# The build generates version.hpp; stand in for it if it has not.
+printf '#pragma once\n#define P_UNZIP_REVISION "test"\n' \
+    > "$work/version.hpp"
+
+sources=
+for f in "$src"/*.cpp; do
+    case $(basename "$f") in
+        main.cpp|entry.cpp) ;;
+        *) sources="$sources $f" ;;
+    esac
+done
+
+echo "building the unit tests"
+${CXX:-c++} -std=c++11 -O1 -pthread $os $CPPFLAGS $CXXFLAGS \
+    -I"$src" -I"$work" "$here/tests.cpp" $sources \
+    -o "$work/tests" $LDFLAGS -lzip -lz -ldl $LIBS
+
+failed=0
+mkdir "$work/unit"
+( cd "$work/unit" && "$work/tests" ) || failed=1
+
+check() {
+    if "$@"; then echo "ok      $name"
+    else          echo "FAILED  $name"; failed=1
+    fi
+}
+
+if [ -n "$p_unzip" ]; then
+    # The unit tests leave their corpus and its archive behind.
+    cd "$work"
+    corpus=unit/native/corpus
+    zip=unit/native/deflated.zip
+
+    # Both engines must extract exactly the files that went in.
+    for engine in libzip native; do
+        name="extract with -e $engine"
+        check sh -c "'$p_unzip' -q -j 4 -e $engine -o out-$engine $zip &&
+                     diff -r out-$engine $corpus"
+    done
+
+    # Resume after the journal was torn and a file went missing: the
+    # missing file and the entries of the torn records are done over.
+    name="resume with a torn journal"
+    resume() {
+        "$p_unzip" -q -j 2 -k journal -o out-resume $zip || return 1
+        for t in journal/thread-*; do
+            size=$(wc -c < "$t")
+            [ "$size" -gt 2 ] || continue
+            head -c $((size - 2)) "$t" > "$t.torn" && mv "$t.torn" "$t"
+        done
+        rm out-resume/sub/medium.txt
+        "$p_unzip" -q -j 3 -k journal -R -o out-resume $zip || return 1
+        diff -r out-resume $corpus
+    }
+    check resume
+fi
+
+[ $failed -eq 0 ] && echo "all passed"
+exit $failed
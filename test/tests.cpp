@@ -0,0 +1,448 @@
+/****************************************************************
+* Unit tests
+*****************************************************************
+* These are built against the sources in src (all but main.cpp and
+* entry.cpp) and run by run.sh, which also runs the  end-to-end
+* checks with the p-unzip binary. Each test works in a folder  of
+* its own under the current folder, which should be empty.
+*
+* A failed CHECK is reported and the test goes on, so  that  one
+* run shows everything that is wrong; the exit code is the number
+* of tests that failed.
+****************************************************************/
+#include "create.hpp"
+#include "fs.hpp"
+#include "history.hpp"
+#include "inflate.hpp"
+#include "journal.hpp"
+#include "reader.hpp"
+#include "zip.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+size_t checks_failed = 0;
+
+#define CHECK( a ) {                                            \
+    if( !(a) ) {                                                \
+        cerr << "  " << __FILE__ << ":" << __LINE__ << ": "     \
+             << #a << endl;                                     \
+        ++checks_failed;                                        \
+    }                                                           \
+}
+
+#define CHECK_NEAR( a, b, tol ) {                               \
+    double a_ = (a), b_ = (b);                                  \
+    if( !(fabs( a_ - b_ ) <= (tol)) ) {                         \
+        cerr << "  " << __FILE__ << ":" << __LINE__ << ": "     \
+             << #a << " is " << a_ << ", expected " << b_       \
+             << endl;                                           \
+        ++checks_failed;                                        \
+    }                                                           \
+}
+
+string contents( Buffer const& b ) {
+    return string( static_cast<char const*>( b.get() ), b.size() );
+}
+
+void write_file( string const& path, string const& data ) {
+    File( path, "wb" ).write( data.data(), data.size() );
+}
+
+/****************************************************************
+* Native reader against libzip
+****************************************************************/
+// Text that compresses about as well as source code does, with no
+// two stretches of it alike.
+string text( size_t size, uint64_t seed ) {
+    static char const* const words[] = {
+        "the ", "zip ", "entry ", "of ", "and ", "thread ", "{\n",
+        "}\n", "return ", "size ", "= ", "0, ", "const ", "int ",
+    };
+    string res;
+    res.reserve( size );
+    uint64_t x = seed*0x9E3779B97F4A7C15ULL + 1;
+    while( res.size() < size ) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        res += words[x % (sizeof( words )/sizeof( words[0] ))];
+    }
+    res.resize( size );
+    return res;
+}
+
+// Every entry of the archive, as libzip extracts it, against what
+// the native reader makes of it with each of the inflate backends
+// that are built in: whole, through a small buffer, and with the
+// original file.
+void compare_engines( string const& zip, string const& folder ) {
+    auto buf = make_shared<Buffer>( File( zip, "rb" ).read() );
+    Zip  lz( buf );
+    for( auto const& name : inflate_plan_names() ) {
+        string why;
+        auto native = NativeArchive::open( buf, why,
+                                           inflate_plan( name ) );
+        CHECK( native );
+        if( !native ) {
+            cerr << "  " << zip << ": " << why << endl;
+            continue;
+        }
+        Zip      nz( buf, native );
+        Inflater inflater( native->plan() );
+        Buffer   small( 4096 );
+        size_t files = 0;
+        for( size_t i = 0; i < lz.size(); ++i ) {
+            ZipStat const& zs = lz.at( i );
+            if( zs.is_folder() )
+                continue;
+            string expected = contents( lz.extract( i ) );
+            CHECK( contents( nz.extract( i ) ) == expected );
+            string pieces;
+            CHECK( native->read( i, inflater, small,
+                [&]( void const* data, size_t size ){
+                    pieces.append( static_cast<char const*>( data ),
+                                   size );
+                }, why ) );
+            CHECK( pieces == expected );
+            CHECK( contents( File( folder + "/" + zs.name(),
+                                   "rb" ).read() ) == expected );
+            ++files;
+        }
+        CHECK( files == 6 );
+    }
+}
+
+void test_native_reader() {
+    string folder = "native/corpus";
+    make_folders( folder + "/sub/deeper" );
+    write_file( folder + "/empty", "" );
+    write_file( folder + "/one", "x" );
+    write_file( folder + "/small.txt", text( 5000, 1 ) );
+    write_file( folder + "/sub/medium.txt", text( 300000, 2 ) );
+    // Larger than INFLATE_WHOLE_MAX, so that it is streamed.
+    write_file( folder + "/sub/deeper/large.txt",
+                text( size_t( INFLATE_WHOLE_MAX ) + 12345, 3 ) );
+    string noise;
+    uint64_t x = 88172645463325252ULL;
+    for( size_t i = 0; i < 100000; ++i ) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        noise += char( x );
+    }
+    write_file( folder + "/sub/noise.bin", noise );
+
+    p_zip( "native/deflated.zip", folder, 2, true, DEFAULT_DIST,
+           DEFAULT_CHUNK, ZIP_METHOD_DEFLATE );
+    p_zip( "native/stored.zip", folder, 2, true, DEFAULT_DIST,
+           DEFAULT_CHUNK, ZIP_METHOD_STORE );
+    compare_engines( "native/deflated.zip", folder );
+    compare_engines( "native/stored.zip",   folder );
+
+    // A flipped byte in the compressed data must be caught.
+    Buffer bad = File( "native/deflated.zip", "rb" ).read();
+    auto buf  = make_shared<Buffer>( move( bad ) );
+    string why;
+    auto native = NativeArchive::open( buf, why );
+    CHECK( native );
+    if( !native )
+        return;
+    size_t corrupt = 0;
+    for( size_t i = 0; i < native->stats().size(); ++i ) {
+        ZipStat const& zs = native->stats()[i];
+        if( zs.comp_size() < 1000 )
+            continue;
+        auto     p   = static_cast<uint8_t*>( buf->get() );
+        uint64_t off = 0;
+        // Find the data from the local header.
+        for( uint64_t o = 0; o + 30 < buf->size(); ++o )
+            if( memcmp( p+o, "PK\3\4", 4 ) == 0 &&
+                memcmp( p+o+30, zs.name_data(),
+                        strlen( zs.name_data() ) ) == 0 ) {
+                off = o + 30 + p[o+26] + 256*p[o+27] + p[o+28] +
+                      256*p[o+29];
+                break;
+            }
+        CHECK( off > 0 );
+        p[off + zs.comp_size()/2] ^= 0x55;
+        Inflater inflater( native->plan() );
+        Buffer   out( zs.size() );
+        CHECK( !native->read_into( i, inflater, out.get(), why ) );
+        ++corrupt;
+    }
+    CHECK( corrupt >= 3 );
+}
+
+// Raw deflate data, as stored in zips, for `data`.
+string raw_deflate( string const& data ) {
+    z_stream z;
+    memset( &z, 0, sizeof( z ) );
+    CHECK( deflateInit2( &z, 6, Z_DEFLATED, -15, 8,
+                         Z_DEFAULT_STRATEGY ) == Z_OK );
+    string res( deflateBound( &z, uLong( data.size() ) ), '\0' );
+    z.next_in   = (Bytef*)data.data();
+    z.avail_in  = uInt( data.size() );
+    z.next_out  = (Bytef*)&res[0];
+    z.avail_out = uInt( res.size() );
+    CHECK( deflate( &z, Z_FINISH ) == Z_STREAM_END );
+    res.resize( z.total_out );
+    deflateEnd( &z );
+    return res;
+}
+
+// A zip with the given entries (name, method, contents), laid  out
+// by hand, as p_zip stores empty files instead of deflating them.
+string make_zip( vector<pair<string, pair<uint16_t, string>>> const&
+                 entries ) {
+    auto put = []( string& s, uint32_t v, int bytes ) {
+        for( int i = 0; i < bytes; ++i )
+            s += char( (v >> (8*i)) & 0xff );
+    };
+    string zip, cd;
+    for( auto const& e : entries ) {
+        string const& name = e.first;
+        uint16_t      m    = e.second.first;
+        string const& data = e.second.second;
+        string   comp = m == ZIP_METHOD_DEFLATE ? raw_deflate( data ) : data;
+        uint32_t crc  = uint32_t( crc32( 0, (Bytef const*)data.data(),
+                                         uInt( data.size() ) ) );
+        uint32_t off  = uint32_t( zip.size() );
+        // Version 2.0, no flags, 1980-01-01 00:00.
+        put( zip, 0x04034b50, 4 ); put( zip, 20, 2 ); put( zip, 0, 2 );
+        put( zip, m, 2 ); put( zip, 0, 2 ); put( zip, 0x21, 2 );
+        put( zip, crc, 4 ); put( zip, uint32_t( comp.size() ), 4 );
+        put( zip, uint32_t( data.size() ), 4 );
+        put( zip, uint32_t( name.size() ), 2 ); put( zip, 0, 2 );
+        zip += name + comp;
+        put( cd, 0x02014b50, 4 ); put( cd, 20, 2 ); put( cd, 20, 2 );
+        put( cd, 0, 2 ); put( cd, m, 2 ); put( cd, 0, 2 );
+        put( cd, 0x21, 2 ); put( cd, crc, 4 );
+        put( cd, uint32_t( comp.size() ), 4 );
+        put( cd, uint32_t( data.size() ), 4 );
+        put( cd, uint32_t( name.size() ), 2 );
+        put( cd, 0, 2 ); put( cd, 0, 2 ); put( cd, 0, 2 );
+        put( cd, 0, 2 ); put( cd, 0, 4 ); put( cd, off, 4 );
+        cd += name;
+    }
+    uint32_t cd_off = uint32_t( zip.size() );
+    zip += cd;
+    put( zip, 0x06054b50, 4 ); put( zip, 0, 2 ); put( zip, 0, 2 );
+    put( zip, uint32_t( entries.size() ), 2 );
+    put( zip, uint32_t( entries.size() ), 2 );
+    put( zip, uint32_t( cd.size() ), 4 ); put( zip, cd_off, 4 );
+    put( zip, 0, 2 );
+    return zip;
+}
+
+// Empty entries that are deflated anyway (as Python's zipfile and
+// jar tools write them) hold a two byte deflate stream, which every
+// backend must take, with or without libdeflate.
+void test_empty_deflated() {
+    string data = make_zip( {
+        { "empty.dfl", { ZIP_METHOD_DEFLATE, "" } },
+        { "hello.dfl", { ZIP_METHOD_DEFLATE, "hello, hello" } },
+        { "empty.sto", { ZIP_METHOD_STORE,   "" } },
+    } );
+    auto buf = make_shared<Buffer>( data.size() );
+    memcpy( buf->get(), data.data(), data.size() );
+    CHECK( raw_deflate( "" ).size() == 2 );
+    for( auto const& name : inflate_plan_names() ) {
+        string why;
+        auto native = NativeArchive::open( buf, why,
+                                           inflate_plan( name ) );
+        CHECK( native );
+        if( !native ) {
+            cerr << "  " << why << endl;
+            continue;
+        }
+        Inflater inflater( native->plan() );
+        Buffer   small( 16 ), whole( 16 );
+        for( size_t i = 0; i < 3; ++i ) {
+            string pieces;
+            CHECK( native->read( i, inflater, small,
+                [&]( void const* p, size_t size ){
+                    pieces.append( static_cast<char const*>( p ), size );
+                }, why ) );
+            CHECK( pieces == ( i == 1 ? "hello, hello" : "" ) );
+            CHECK( native->read_into( i, inflater, whole.get(), why ) );
+        }
+    }
+}
+
+/****************************************************************
+* Checkpoint journal
+****************************************************************/
+void test_journal_resume() {
+    string folder = "journal";
+    {
+        Journal journal( folder, "archive 1", false, 2 );
+        auto a = journal.log( 0 );
+        auto b = journal.log( 1 );
+        for( uint64_t i = 0; i < 1000; ++i )
+            ( i % 2 ? b : a )->done( i );
+        a->flush();
+        b->flush();
+    }
+    // Tear the last record of one thread, as a crash in the middle
+    // of a write would.
+    string t1 = contents( File( folder + "/thread-1", "rb" ).read() );
+    CHECK( t1.size() > 4 && t1.substr( t1.size()-4 ) == "999\n" );
+    write_file( folder + "/thread-1", t1.substr( 0, t1.size()-2 ) );
+    {
+        Journal journal( folder, "archive 1", true, 3 );
+        auto const& done = journal.completed();
+        CHECK( done.size() == 999 );
+        bool in_order = true;
+        for( size_t i = 0; i < done.size(); ++i )
+            in_order = in_order && done[i] == i;
+        CHECK( in_order );
+        // Record one more with the new number of threads.
+        auto c = journal.log( 2 );
+        c->done( 999 );
+        c->flush();
+    }
+    {
+        // The consolidated records survive another resume.
+        Journal journal( folder, "archive 1", true, 1 );
+        CHECK( journal.completed().size() == 1000 );
+    }
+    // A journal for some other archive is refused on resume  and
+    // discarded otherwise.
+    bool threw = false;
+    try { Journal( folder, "archive 2", true, 1 ); }
+    catch( exception const& ) { threw = true; }
+    CHECK( threw );
+    CHECK( Journal( folder, "archive 2", false, 1 ).completed().empty() );
+    CHECK( Journal( folder, "archive 2", true, 1 ).completed().empty() );
+
+    // A corrupt (rather than torn) record is an error.
+    write_file( folder + "/done", "1\nx2\n3\n" );
+    threw = false;
+    try { Journal( folder, "archive 2", true, 1 ); }
+    catch( exception const& ) { threw = true; }
+    CHECK( threw );
+}
+
+/****************************************************************
+* History: CSV and the t-test
+****************************************************************/
+void test_csv() {
+    vector<vector<string>> records = {
+        { "plain", "", "with space", "1.5" },
+        { "comma,inside", "\"quoted\"", "both, \"of\" them" },
+        { "line\nbreak", "two\n\nbreaks\n", "crlf\r\nend", "," },
+        { "{\"json\":[1,2],\n \"s\":\"a,b\"}", "\"" },
+        { "" },
+    };
+    string text;
+    for( auto const& r : records ) {
+        for( size_t i = 0; i < r.size(); ++i )
+            text += ( i ? "," : "" ) + csv_field( r[i] );
+        text += '\n';
+    }
+    CHECK( csv_field( "plain" ) == "plain" );
+    CHECK( csv_field( "a\"b" ) == "\"a\"\"b\"" );
+
+    istringstream in( text );
+    vector<string> fields;
+    for( auto const& r : records ) {
+        CHECK( csv_read( in, fields ) );
+        CHECK( fields == r );
+    }
+    CHECK( !csv_read( in, fields ) );
+
+    // A record torn inside a quoted field comes back as far as  it
+    // goes, and does not swallow anything else.
+    istringstream torn( "a,\"b\nc" );
+    CHECK( csv_read( torn, fields ) );
+    CHECK( fields == vector<string>( { "a", "b\nc" } ) );
+    CHECK( !csv_read( torn, fields ) );
+}
+
+void test_t_test() {
+    // Student's t upper tail: closed forms for one and three degrees
+    // of freedom, and a table value for ten, with a single  latest
+    // run against a baseline with a known spread. With one latest
+    // run x the statistic is (x - mean)/(sd*sqrt(1 + 1/n)) on n-1
+    // degrees of freedom.
+    auto single = []( vector<double> const& base, double t ) {
+        double n = double( base.size() ), mean = 0, var = 0;
+        for( auto x : base ) mean += x;
+        mean /= n;
+        for( auto x : base ) var += (x-mean)*(x-mean);
+        var /= n - 1;
+        return p_slower( base, { mean + t*sqrt( var*(1 + 1/n) ) } );
+    };
+    vector<double> two  = { 10, 12 };
+    vector<double> four = { 9, 10, 12, 13 };
+    vector<double> eleven;
+    for( int i = 0; i < 11; ++i )
+        eleven.push_back( 100 + (i*7) % 11 );
+    double const pi = acos( -1.0 );
+    CHECK_NEAR( single( two, 1.0 ),  0.25, 1e-9 );
+    CHECK_NEAR( single( two, -1.0 ), 0.75, 1e-9 );
+    CHECK_NEAR( single( two, 3.0 ),  0.5 - atan( 3.0 )/pi, 1e-9 );
+    // df = 3: 1/2 - (atan(u) + u/(1+u^2))/pi with u = t/sqrt(3).
+    double u = 1.5/sqrt( 3.0 );
+    CHECK_NEAR( single( four, 1.5 ),
+                0.5 - (atan( u ) + u/(1 + u*u))/pi, 1e-9 );
+    CHECK_NEAR( single( eleven, 2.2281388519649 ), 0.025, 1e-6 );
+    CHECK_NEAR( single( eleven, 0 ), 0.5, 1e-9 );
+
+    // Welch's test with unequal variances (the data of the  first
+    // example on Wikipedia's page on it): t = 2.4554, 24.99 degrees
+    // of freedom, one sided p = 0.010689.
+    vector<double> a = { 27.5, 21.0, 19.0, 23.6, 17.0, 17.9, 16.9, 20.1,
+                         21.9, 22.6, 23.1, 19.6, 19.0, 21.7, 21.4 };
+    vector<double> b = { 27.1, 22.0, 20.8, 23.4, 23.4, 23.5, 25.8, 22.0,
+                         24.8, 20.2, 21.9, 22.1, 22.9, 20.5, 24.4 };
+    CHECK_NEAR( p_slower( a, b ), 0.0106890, 1e-6 );
+    CHECK_NEAR( p_slower( b, a ), 1 - 0.0106890, 1e-6 );
+    // No spread at all: certain either way.
+    CHECK( p_slower( { 5, 5, 5 }, { 6, 6 } ) == 0 );
+    CHECK( p_slower( { 5, 5, 5 }, { 4 } ) == 1 );
+}
+
+struct Test {
+    char const*     name;
+    function<void()> run;
+};
+
+} // anon namespace
+
+int main( int argc, char** argv ) {
+    vector<Test> tests = {
+        { "native_reader",  test_native_reader  },
+        { "empty_deflated", test_empty_deflated },
+        { "journal_resume", test_journal_resume },
+        { "csv",            test_csv            },
+        { "t_test",         test_t_test         },
+    };
+    int failed = 0;
+    for( auto const& t : tests ) {
+        // Any arguments name the tests to run.
+        bool wanted = argc < 2;
+        for( int i = 1; i < argc; ++i )
+            wanted = wanted || string( argv[i] ) == t.name;
+        if( !wanted )
+            continue;
+        size_t before = checks_failed;
+        bool   threw  = false;
+        try { t.run(); }
+        catch( exception const& e ) {
+            cerr << "  exception: " << e.what() << endl;
+            threw = true;
+        }
+        bool ok = !threw && checks_failed == before;
+        cout << ( ok ? "ok      " : "FAILED  " ) << t.name << endl;
+        failed += !ok;
+    }
+    return failed;
+}